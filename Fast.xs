@@ -4,6 +4,11 @@
 #include "XSUB.h"
 #include "ppport.h"
 
+#if defined(HAS_MMAP) && !defined(WIN32)
+#include <sys/mman.h>
+#define URI_USE_MMAP 1
+#endif
+
 /*------------------------------------------------------------------------------
  *
  * Macros and definitions
@@ -11,11 +16,11 @@
  -----------------------------------------------------------------------------*/
 
 // Permitted characters
-#define URI_CHARS_AUTH          "!$&'()*+,;:=@"
+#define URI_CHARS_AUTH          "!$&'()[]*+,;:=@"
 #define URI_CHARS_USER          "!$&'()*+,;="
 #define URI_CHARS_PATH          "!$&'()*+,;:=@/"
 #define URI_CHARS_PATH_SEGMENT  "!$&'()*+,;:=@"
-#define URI_CHARS_HOST          "!$&'()[]*+,.;=@/"
+#define URI_CHARS_HOST          "!$&'()[]*+,.:;=@/"
 #define URI_CHARS_QUERY         ":@?/&=;"
 #define URI_CHARS_FRAG          ":@?/"
 
@@ -25,6 +30,10 @@
   (((sv_isobject(obj) && sv_derived_from(obj, "URI::Fast")) ? NULL : croak("error: expected instance of URI::Fast")), \
     ((uri_t*) SvIV(SvRV((obj)))))
 
+// Marks the host and port as needing to be reclassified after the uri_t has
+// been modified.
+#define URI_CHANGED(uri) ((uri)->host_type = URI_HOST_UNKNOWN)
+
 // Size constants
 #define URI_SIZE_scheme 32UL
 #define URI_SIZE_usr    32UL
@@ -43,8 +52,10 @@
 
 // Defines a clearer method
 #define URI_SIMPLE_CLEARER(member) \
-static void clear_##member(pTHX_ SV *uri) { \
-  str_clear(aTHX_ URI(uri)->member); \
+static void clear_##member(pTHX_ SV *sv_uri) { \
+  uri_t *uri = URI_WRITABLE(sv_uri); \
+  str_clear(aTHX_ uri->member); \
+  URI_CHANGED(uri); \
 }
 
 // Returns a (non-mortal) SV from a uri_str_t
@@ -55,7 +66,7 @@ static void clear_##member(pTHX_ SV *uri) { \
 // slot 'member'.
 #define URI_SIMPLE_SETTER(member, allowed) \
 static void set_##member(pTHX_ SV *sv_uri, SV *sv_value) { \
-  uri_t *uri = URI(sv_uri); \
+  uri_t *uri = URI_WRITABLE(sv_uri); \
   if (is_defined(aTHX_ sv_value)) { \
     size_t len_value, len_enc; \
     const char *value = SvPV_const(sv_value, len_value); \
@@ -66,13 +77,14 @@ static void set_##member(pTHX_ SV *sv_uri, SV *sv_value) { \
   else { \
     str_clear(aTHX_ uri->member); \
   } \
+  URI_CHANGED(uri); \
 }
 
 // Defines a setter method that accepts an arbitrary string value and copies it
 // into the slot 'member' without changing it in any way.
 #define URI_RAW_SETTER(member) \
 static void set_raw_##member(pTHX_ SV *sv_uri, SV *sv_value) { \
-  uri_t *uri = URI(sv_uri); \
+  uri_t *uri = URI_WRITABLE(sv_uri); \
   if (is_defined(aTHX_ sv_value)) { \
     size_t len_value; \
     const char *value = SvPV_const(sv_value, len_value); \
@@ -81,6 +93,7 @@ static void set_raw_##member(pTHX_ SV *sv_uri, SV *sv_value) { \
   else { \
     str_clear(aTHX_ uri->member); \
   } \
+  URI_CHANGED(uri); \
 }
 
 // Defines a getter method that returns the raw, encoded value of the member
@@ -200,12 +213,26 @@ size_t strnspn(const char *s, size_t s_len, const char *c)
   return s_len < res ? s_len : res;
 }
 
-// Replacement for strcspn that is length-aware
+// Replacement for strcspn that is length-aware. Never reads past s_len, so
+// it is safe on buffers which are not nul-terminated (e.g. mmap'd files).
 static
 size_t strncspn(const char *s, size_t s_len, const char *c)
 {
-  size_t res = strcspn(s, c);
-  return s_len < res ? s_len : res;
+  U32 set[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  const U8 *p = (const U8*) s;
+  size_t i;
+
+  for (; *c != '\0'; ++c) {
+    set[(U8) *c >> 5] |= (U32) 1 << ((U8) *c & 31);
+  }
+
+  for (i = 0; i < s_len; ++i) {
+    if (set[p[i] >> 5] & ((U32) 1 << (p[i] & 31))) {
+      return i;
+    }
+  }
+
+  return s_len;
 }
 
 // Returns true if char c is in char* set. It is up to the caller to ensure
@@ -248,6 +275,49 @@ size_t maxnum(size_t x, size_t y) {
   return x >= y ? x : y;
 }
 
+/*------------------------------------------------------------------------------
+ * Statistics
+ *
+ * When built with URI_STATS defined (STATS=1 perl Makefile.PL), allocations
+ * and calls to the core routines are counted, and the counts are reported by
+ * URI::Fast::stats(). Otherwise, the counting macros compile to nothing.
+ *
+ * The counters are shared by the whole process and are not synchronized, so
+ * counts made while several threads are working are approximate.
+ -----------------------------------------------------------------------------*/
+#ifdef URI_STATS
+#define URI_STATS_MEMBERS(X) \
+  X(allocs)        /* string buffers and structs allocated */ \
+  X(reallocs)      /* string buffers resized */ \
+  X(alloc_bytes)   /* bytes allocated, including growth of resized buffers */ \
+  X(uri_new)       /* uri_t structs allocated, one per URI::Fast object plus scratch */ \
+  X(uri_free)      /* uri_t structs freed */ \
+  X(scan_calls)    /* URIs scanned */ \
+  X(scan_bytes)    /* bytes scanned */ \
+  X(encode_calls) \
+  X(encode_bytes) \
+  X(decode_calls) \
+  X(decode_bytes) \
+  X(query_scans)   /* query strings scanned */ \
+  X(query_tokens)  /* keys and key/value pairs found in query strings */
+
+#define URI_STATS_FIELD(name) UV name;
+
+static struct {
+  URI_STATS_MEMBERS(URI_STATS_FIELD)
+} uri_stats;
+
+#define URI_STAT(name)             (++uri_stats.name)
+#define URI_STAT_ADD(name, n)      (uri_stats.name += (n))
+#define URI_STAT_ALLOC(size)       (++uri_stats.allocs, uri_stats.alloc_bytes += (size))
+#define URI_STAT_REALLOC(from, to) (++uri_stats.reallocs, uri_stats.alloc_bytes += (to) > (from) ? (to) - (from) : 0)
+#else
+#define URI_STAT(name)
+#define URI_STAT_ADD(name, n)
+#define URI_STAT_ALLOC(size)
+#define URI_STAT_REALLOC(from, to)
+#endif
+
 /*------------------------------------------------------------------------------
  * Resizable strings
  -----------------------------------------------------------------------------*/
@@ -283,10 +353,12 @@ void str_set(pTHX_ uri_str_t *str, const char *value, size_t len) {
 
   if (str->string == NULL) {
     Newx(str->string, allocate, char);
+    URI_STAT_ALLOC(allocate);
     str->allocated = allocate;
   }
-  else if (len > str->allocated) {
+  else if (len >= str->allocated) {
     Renew(str->string, allocate, char);
+    URI_STAT_REALLOC(str->allocated, allocate);
     str->allocated = allocate;
   }
 
@@ -315,6 +387,7 @@ void str_append(pTHX_ uri_str_t *str, const char *value, size_t len) {
 
     if (allocate != str->allocated) {
       Renew(str->string, allocate, char);
+      URI_STAT_REALLOC(str->allocated, allocate);
       str->allocated = allocate;
     }
 
@@ -324,6 +397,58 @@ void str_append(pTHX_ uri_str_t *str, const char *value, size_t len) {
   }
 }
 
+// Ensures that str has room for at least len chars plus the terminating nul,
+// allocating more memory in multiples of the chunk size if necessary. Does not
+// alter the contents or length of the string.
+static
+void str_grow(pTHX_ uri_str_t *str, size_t len) {
+  size_t allocate;
+
+  if (str->string != NULL && len < str->allocated) {
+    return;
+  }
+
+  allocate = str->chunk * (((len + 1) / str->chunk) + 1);
+
+  if (str->string == NULL) {
+    Newx(str->string, allocate, char);
+    URI_STAT_ALLOC(allocate);
+    str->string[0] = '\0';
+  }
+  else {
+    Renew(str->string, allocate, char);
+    URI_STAT_REALLOC(str->allocated, allocate);
+  }
+
+  str->allocated = allocate;
+}
+
+// As str_grow, but grows by at least half again, so that a buffer which is
+// appended to repeatedly is reallocated a logarithmic number of times.
+static
+void str_reserve(pTHX_ uri_str_t *str, size_t len) {
+  size_t grow = str->allocated + str->allocated / 2;
+
+  if (str->string != NULL && len < str->allocated) {
+    return;
+  }
+
+  str_grow(aTHX_ str, len > grow ? len : grow);
+}
+
+// Shrinks the buffer to fit the string and its terminating nul. The buffer
+// grows again in multiples of the chunk size if the string is changed.
+static
+void str_compact(pTHX_ uri_str_t *str) {
+  if (str->string == NULL || str->allocated <= str->length + 1) {
+    return;
+  }
+
+  Renew(str->string, str->length + 1, char);
+  URI_STAT_REALLOC(str->allocated, str->length + 1);
+  str->allocated = str->length + 1;
+}
+
 // Zeroes out the contents of str. Does not release memory.
 static
 void str_clear(pTHX_ uri_str_t *str) {
@@ -351,6 +476,7 @@ static
 uri_str_t* str_new(pTHX_ size_t alloc_size) {
   uri_str_t *str;
   Newx(str, 1, uri_str_t);
+  URI_STAT_ALLOC(sizeof(uri_str_t));
   str_init(aTHX_ str, alloc_size);
   return str;
 }
@@ -365,6 +491,12 @@ void str_free(pTHX_ uri_str_t *str) {
   Safefree(str);
 }
 
+// str_free with the signature expected by SAVEDESTRUCTOR_X
+static
+void str_free_ptr(pTHX_ void *str) {
+  str_free(aTHX_ (uri_str_t*) str);
+}
+
 
 /*-------------------------------------------------------------------------------
  * Percent encoding
@@ -402,6 +534,9 @@ size_t uri_encode(const char* in, size_t len, char* out, const char* allow, int
   U8 octet;
   U32 code;
 
+  URI_STAT(encode_calls);
+  URI_STAT_ADD(encode_bytes, len);
+
   while (i < len) {
     octet = in[i];
 
@@ -484,6 +619,9 @@ size_t uri_decode(const char *in, size_t len, char *out, const char *ignore) {
   size_t i = 0, j = 0;
   char decoded;
 
+  URI_STAT(decode_calls);
+  URI_STAT_ADD(decode_bytes, len);
+
   while (i < len) {
     decoded = '\0';
 
@@ -645,6 +783,7 @@ void query_scanner_init(
   scanner->source = source;
   scanner->length = length;
   scanner->cursor = 0;
+  URI_STAT(query_scans);
 }
 
 // Returns true if the scanner has reached the end of the input string.
@@ -712,6 +851,7 @@ SCAN_KEY:
     goto SCAN_KEY;
   }
 
+  URI_STAT(query_tokens);
   return;
 }
 
@@ -720,8 +860,22 @@ SCAN_KEY:
  * URI parsing
  -----------------------------------------------------------------------------*/
 
+// Host types. Hosts are classified when the authority is scanned and again,
+// lazily, after the host or port is modified (see URI_CHANGED).
+#define URI_HOST_UNKNOWN   0  // not yet classified
+#define URI_HOST_NONE      1
+#define URI_HOST_REGNAME   2
+#define URI_HOST_IPV4      3
+#define URI_HOST_IPV6      4
+#define URI_HOST_IPVFUTURE 5
+#define URI_HOST_INVALID   6  // malformed IP literal
+
 typedef struct {
   U8         is_iri;
+  U8         readonly;   // true for views of a URI::Fast::Table
+  U8         host_type;  // URI_HOST_*
+  U8         ip[16];     // IP address in network order, if host_type is IPV4 or IPV6
+  I32        port_num;   // numeric port, or -1 if empty, non-numeric, or out of range
   uri_str_t *scheme;
   uri_str_t *query;
   uri_str_t *path;
@@ -732,6 +886,261 @@ typedef struct {
   uri_str_t *pwd;
 } uri_t;
 
+// As URI(obj), for an object which is about to be modified. Croaks if the
+// object is a read-only view.
+#define URI_WRITABLE(obj) uri_writable(aTHX_ URI(obj))
+
+static inline
+uri_t* uri_writable(pTHX_ uri_t *uri) {
+  if (uri->readonly) {
+    croak("error: attempt to modify a read-only URI::Fast object");
+  }
+
+  return uri;
+}
+
+/*
+ * Parses a dotted decimal IPv4 address (RFC 3986 section 3.2.2) into 4 bytes.
+ * Returns false unless the entire string is a valid address. Leading zeros are
+ * not permitted.
+ */
+static
+int ipv4_parse(const char *s, size_t len, U8 *ip) {
+  size_t i = 0, digits;
+  int octet;
+  U32 val;
+
+  for (octet = 0; octet < 4; ++octet) {
+    if (octet > 0) {
+      if (i >= len || s[i] != '.') return 0;
+      ++i;
+    }
+
+    for (val = 0, digits = 0; i < len && isDIGIT(s[i]) && digits < 4; ++i, ++digits) {
+      val = (val * 10) + (s[i] - '0');
+    }
+
+    if (digits == 0 || val > 255 || (digits > 1 && s[i - digits] == '0')) return 0;
+
+    ip[octet] = (U8) val;
+  }
+
+  return i == len;
+}
+
+/*
+ * Parses the text form of an IPv6 address (RFC 4291 section 2.2), optionally
+ * ending in a dotted decimal IPv4 address, into 16 bytes. Returns false unless
+ * the entire string is a valid address.
+ */
+static
+int ipv6_parse(const char *s, size_t len, U8 *ip) {
+  U16 groups[8];
+  int ngroups = 0, gap = -1, digits, i;
+  size_t idx = 0, start;
+  U32 val;
+
+  if (len >= 2 && s[0] == ':' && s[1] == ':') {
+    gap = 0;
+    idx = 2;
+  }
+  else if (len > 0 && s[0] == ':') {
+    return 0;
+  }
+
+  while (idx < len) {
+    if (ngroups == 8) return 0;
+
+    start = idx;
+    for (val = 0, digits = 0; idx < len && isXDIGIT(s[idx]) && digits < 4; ++idx, ++digits) {
+      val = (val << 4) | XDIGIT_VALUE(s[idx]);
+    }
+
+    // Trailing IPv4 address
+    if (idx < len && s[idx] == '.') {
+      U8 ip4[4];
+      if (ngroups > 6 || !ipv4_parse(&s[start], len - start, ip4)) return 0;
+      groups[ngroups++] = (ip4[0] << 8) | ip4[1];
+      groups[ngroups++] = (ip4[2] << 8) | ip4[3];
+      idx = len;
+      break;
+    }
+
+    if (digits == 0) return 0;
+    groups[ngroups++] = (U16) val;
+
+    if (idx == len) break;
+    if (s[idx++] != ':') return 0;
+
+    if (idx < len && s[idx] == ':') {
+      if (gap >= 0) return 0;
+      gap = ngroups;
+      ++idx;
+    }
+    else if (idx == len) {
+      return 0;
+    }
+  }
+
+  // "::" must stand in for at least one group
+  if (gap < 0 ? ngroups != 8 : ngroups > 7) return 0;
+
+  Zero(ip, 16, U8);
+
+  for (i = 0; i < ngroups; ++i) {
+    int pos = (gap < 0 || i < gap) ? i : 8 - (ngroups - i);
+    ip[pos * 2]     = groups[i] >> 8;
+    ip[pos * 2 + 1] = groups[i] & 0xFF;
+  }
+
+  return 1;
+}
+
+/*
+ * Writes the canonical text form of an IPv6 address (RFC 5952) to out, which
+ * must have room for at least 46 bytes: lower case hex without leading zeros,
+ * with the longest run of two or more zero groups compressed to "::", and
+ * IPv4-mapped addresses in dotted decimal. Returns the length of the output.
+ */
+static
+size_t ipv6_format(const U8 *ip, char *out) {
+  static const char hex[] = "0123456789abcdef";
+  int best = -1, best_len = 0, run, i, j;
+  size_t pos = 0;
+  U16 group;
+
+  // IPv4-mapped (::ffff:0:0/96)
+  for (i = 0; i < 10 && ip[i] == 0; ++i);
+
+  if (i == 10 && ip[10] == 0xFF && ip[11] == 0xFF) {
+    return sprintf(out, "::ffff:%u.%u.%u.%u", ip[12], ip[13], ip[14], ip[15]);
+  }
+
+  for (i = 0; i < 8; i += run > 0 ? run : 1) {
+    for (run = 0; i + run < 8 && ip[(i + run) * 2] == 0 && ip[(i + run) * 2 + 1] == 0; ++run);
+
+    if (run > best_len && run > 1) {
+      best     = i;
+      best_len = run;
+    }
+  }
+
+  for (i = 0; i < 8; ++i) {
+    if (i == best) {
+      out[pos++] = ':';
+      out[pos++] = ':';
+      i += best_len - 1;
+      continue;
+    }
+
+    if (i > 0 && i != best + best_len) {
+      out[pos++] = ':';
+    }
+
+    group = (ip[i * 2] << 8) | ip[i * 2 + 1];
+
+    for (j = 12; j > 0 && ((group >> j) & 0xF) == 0; j -= 4);
+    for (; j >= 0; j -= 4) {
+      out[pos++] = hex[(group >> j) & 0xF];
+    }
+  }
+
+  out[pos] = '\0';
+  return pos;
+}
+
+// Returns true if s is a valid IPvFuture literal (RFC 3986 section 3.2.2),
+// minus the square brackets.
+static
+int ipvfuture_valid(const char *s, size_t len) {
+  size_t i = 1;
+
+  if (len < 4 || toLOWER(s[0]) != 'v' || !isXDIGIT(s[1])) return 0;
+
+  while (i < len && isXDIGIT(s[i])) ++i;
+  if (i >= len - 1 || s[i] != '.') return 0;
+
+  for (++i; i < len; ++i) {
+    if (!isALPHANUMERIC(s[i]) && !char_in_str(s[i], "-._~!$&'()*+,;=:")) return 0;
+  }
+
+  return 1;
+}
+
+// Returns the length of the address portion of the IPv6 literal s (minus the
+// square brackets), excluding any zone identifier (RFC 6874).
+static inline
+size_t ipv6_addr_len(const char *s, size_t len) {
+  size_t i;
+
+  for (i = 0; i + 3 < len; ++i) {
+    if (s[i] == '%' && s[i + 1] == '2' && s[i + 2] == '5') return i;
+  }
+
+  return len;
+}
+
+// Returns the numeric value of the port, or -1 if it is empty, non-numeric, or
+// out of range.
+static inline
+I32 port_number(const char *port, size_t len) {
+  size_t i;
+  I32 num = 0;
+
+  for (i = 0; i < len && i < 6 && isDIGIT(port[i]); ++i) {
+    num = (num * 10) + (port[i] - '0');
+  }
+
+  return (i > 0 && i == len && num <= 65535) ? num : -1;
+}
+
+/*
+ * Classifies the host and parses IP literals to binary, and parses the port.
+ */
+static
+void uri_classify(uri_t *uri) {
+  const char *host = uri->host->string;
+  size_t len = uri->host->length;
+
+  if (len == 0) {
+    uri->host_type = URI_HOST_NONE;
+  }
+  else if (host[0] == '[') {
+    if (len < 2 || host[len - 1] != ']') {
+      uri->host_type = URI_HOST_INVALID;
+    }
+    else if (ipv6_parse(&host[1], ipv6_addr_len(&host[1], len - 2), uri->ip)) {
+      uri->host_type = URI_HOST_IPV6;
+    }
+    else if (ipvfuture_valid(&host[1], len - 2)) {
+      uri->host_type = URI_HOST_IPVFUTURE;
+    }
+    else {
+      uri->host_type = URI_HOST_INVALID;
+    }
+  }
+  else if (isDIGIT(host[0]) && ipv4_parse(host, len, uri->ip)) {
+    uri->host_type = URI_HOST_IPV4;
+  }
+  else {
+    uri->host_type = URI_HOST_REGNAME;
+  }
+
+  uri->port_num = port_number(uri->port->string, uri->port->length);
+}
+
+/*
+ * Returns the uri with its host and port classified.
+ */
+static inline
+uri_t* uri_classified(uri_t *uri) {
+  if (uri->host_type == URI_HOST_UNKNOWN) {
+    uri_classify(uri);
+  }
+
+  return uri;
+}
+
 /*
  * Scans the authorization portion of the URI string
  */
@@ -770,10 +1179,10 @@ void uri_scan_auth(pTHX_ uri_t* uri, const char* auth, const size_t len) {
 
     // Maybe an IPV6 address
     flag = 0;
-    if (auth[idx] == '[') {
+    if (idx < len && auth[idx] == '[') {
       brk1 = strncspn(&auth[idx], len - idx, "]");
 
-      if (auth[idx + brk1] == ']') {
+      if (brk1 < len - idx) {
         // Copy, including the square brackets
         str_set(aTHX_ uri->host, &auth[idx], brk1 + 1);
         idx += brk1 + 1;
@@ -790,11 +1199,13 @@ void uri_scan_auth(pTHX_ uri_t* uri, const char* auth, const size_t len) {
       }
     }
 
-    if (auth[idx] == ':') {
+    if (idx < len && auth[idx] == ':') {
       ++idx;
       str_set(aTHX_ uri->port, &auth[idx], len - idx);
     }
   }
+
+  uri_classify(uri);
 }
 
 /*
@@ -813,13 +1224,16 @@ void uri_scan(pTHX_ uri_t *uri, const char *src, size_t len) {
   size_t brk;
   size_t i;
 
-  while (my_isspace(src[idx]) == 1)     ++idx; // Trim leading whitespace
-  while (my_isspace(src[len - 1]) == 1) --len; // Trim trailing whitespace
+  URI_STAT(scan_calls);
+  URI_STAT_ADD(scan_bytes, len);
+
+  while (idx < len && my_isspace(src[idx]) == 1)     ++idx; // Trim leading whitespace
+  while (len > idx && my_isspace(src[len - 1]) == 1) --len; // Trim trailing whitespace
 
   // scheme
   brk = strncspn(&src[idx], len - idx, ":/@?#");
 
-  if (brk > 0 && src[idx + brk] == ':') {
+  if (brk > 0 && brk < len - idx && src[idx + brk] == ':') {
     str_set(aTHX_ uri->scheme, &src[idx], brk);
     idx += brk;
     ++idx; // skip past ":"
@@ -848,7 +1262,7 @@ void uri_scan(pTHX_ uri_t *uri, const char *src, size_t len) {
   }
 
   // query
-  if (src[idx] == '?') {
+  if (idx < len && src[idx] == '?') {
     ++idx; // skip past ?
     brk = strncspn(&src[idx], len - idx, "#");
     if (brk > 0) {
@@ -858,7 +1272,7 @@ void uri_scan(pTHX_ uri_t *uri, const char *src, size_t len) {
   }
 
   // fragment
-  if (src[idx] == '#') {
+  if (idx < len && src[idx] == '#') {
     ++idx; // skip past #
     brk = len - idx;
     if (brk > 0) {
@@ -879,6 +1293,177 @@ int has_authority(pTHX_ uri_t *uri) {
       || uri->port->length > 0;
 }
 
+/*
+ * Allocates and initializes a new, empty uri_t.
+ */
+static
+uri_t* uri_alloc(pTHX_ int is_iri) {
+  uri_t *uri;
+
+  Newx(uri, 1, uri_t);
+  URI_STAT_ALLOC(sizeof(uri_t));
+  URI_STAT(uri_new);
+  Zero(uri, 1, uri_t);
+
+  uri->is_iri = is_iri;
+  uri->scheme = str_new(aTHX_ URI_SIZE_scheme);
+  uri->usr    = str_new(aTHX_ URI_SIZE_usr);
+  uri->pwd    = str_new(aTHX_ URI_SIZE_pwd);
+  uri->host   = str_new(aTHX_ URI_SIZE_host);
+  uri->port   = str_new(aTHX_ URI_SIZE_port);
+  uri->path   = str_new(aTHX_ URI_SIZE_path);
+  uri->query  = str_new(aTHX_ URI_SIZE_query);
+  uri->frag   = str_new(aTHX_ URI_SIZE_frag);
+
+  return uri;
+}
+
+/*
+ * Returns a new uri_t holding a deep copy of another.
+ */
+static
+uri_t* uri_copy(pTHX_ uri_t *from) {
+  uri_t *uri = uri_alloc(aTHX_ from->is_iri);
+
+  uri->readonly  = from->readonly;
+  uri->host_type = from->host_type;
+  uri->port_num  = from->port_num;
+  Copy(from->ip, uri->ip, 16, U8);
+
+  str_copy(aTHX_ from->scheme, uri->scheme);
+  str_copy(aTHX_ from->usr,    uri->usr);
+  str_copy(aTHX_ from->pwd,    uri->pwd);
+  str_copy(aTHX_ from->host,   uri->host);
+  str_copy(aTHX_ from->port,   uri->port);
+  str_copy(aTHX_ from->path,   uri->path);
+  str_copy(aTHX_ from->query,  uri->query);
+  str_copy(aTHX_ from->frag,   uri->frag);
+
+  return uri;
+}
+
+/*
+ * Clears every member of a uri_t without releasing any memory.
+ */
+static
+void uri_clear(pTHX_ uri_t *uri) {
+  str_clear(aTHX_ uri->scheme);
+  str_clear(aTHX_ uri->usr);
+  str_clear(aTHX_ uri->pwd);
+  str_clear(aTHX_ uri->host);
+  str_clear(aTHX_ uri->port);
+  str_clear(aTHX_ uri->path);
+  str_clear(aTHX_ uri->query);
+  str_clear(aTHX_ uri->frag);
+  uri->host_type = URI_HOST_UNKNOWN;
+}
+
+/*
+ * Releases a uri_t and all of its members.
+ */
+static
+void uri_free(pTHX_ uri_t *uri) {
+  str_free(aTHX_ uri->scheme);
+  str_free(aTHX_ uri->usr);
+  str_free(aTHX_ uri->pwd);
+  str_free(aTHX_ uri->host);
+  str_free(aTHX_ uri->port);
+  str_free(aTHX_ uri->path);
+  str_free(aTHX_ uri->query);
+  str_free(aTHX_ uri->frag);
+  Safefree(uri);
+  URI_STAT(uri_free);
+}
+
+/*
+ * Returns the number of bytes allocated for a uri_t: the struct, its members'
+ * structs, and their buffers.
+ */
+static
+size_t uri_memory_size(uri_t *uri) {
+  return sizeof(uri_t)
+       + sizeof(uri_str_t) * 8
+       + uri->scheme->allocated
+       + uri->usr->allocated
+       + uri->pwd->allocated
+       + uri->host->allocated
+       + uri->port->allocated
+       + uri->path->allocated
+       + uri->query->allocated
+       + uri->frag->allocated;
+}
+
+/*
+ * Shrinks each member's buffer to fit its contents. Members grow in chunks and
+ * never shrink, so a URI which has been modified may hold much more memory
+ * than it needs.
+ */
+static
+void uri_compact(pTHX_ uri_t *uri) {
+  str_compact(aTHX_ uri->scheme);
+  str_compact(aTHX_ uri->usr);
+  str_compact(aTHX_ uri->pwd);
+  str_compact(aTHX_ uri->host);
+  str_compact(aTHX_ uri->port);
+  str_compact(aTHX_ uri->path);
+  str_compact(aTHX_ uri->query);
+  str_compact(aTHX_ uri->frag);
+}
+
+/*
+ * Returns the utf8-encoded bytes of a URI source string and sets *len. Strings
+ * not flagged as utf8 are encoded into a mortal copy first, unless they are
+ * entirely ASCII, in which case the encoded bytes are identical and no copy is
+ * made.
+ */
+static
+const char* uri_source(pTHX_ SV *uri_str, size_t *len) {
+  const char *src;
+  size_t i;
+
+  // Copy input string *before* calling DO_UTF8() in case the SV is an object
+  // with string overloading, which may trigger the utf8 flag.
+  src = SvPV_nomg_const(uri_str, *len);
+
+  // Ensure the pv bytes are utf8-encoded
+  if (!DO_UTF8(uri_str)) {
+    for (i = 0; i < *len; ++i) {
+      if ((U8) src[i] > 127) {
+        uri_str = sv_2mortal(newSVpvn(src, *len));
+        sv_utf8_encode(uri_str);
+        src = SvPV_const(uri_str, *len);
+        break;
+      }
+    }
+  }
+
+  return src;
+}
+
+/*
+ * Returns the uri_t for an argument which may be either a URI::Fast object or
+ * a URI string. Strings are scanned into the caller-supplied scratch uri_t,
+ * which is cleared first, so that no object need be built.
+ */
+static
+uri_t* uri_arg(pTHX_ SV *sv, uri_t *scratch) {
+  const char *src;
+  size_t len;
+
+  if (sv_isobject(sv) && sv_derived_from(sv, "URI::Fast")) {
+    return (uri_t*) SvIV(SvRV(sv));
+  }
+
+  uri_clear(aTHX_ scratch);
+
+  if (is_defined(aTHX_ sv)) {
+    src = uri_source(aTHX_ sv, &len);
+    uri_scan(aTHX_ scratch, src, len);
+  }
+
+  return scratch;
+}
+
 /*------------------------------------------------------------------------------
  *
  * Perl API
@@ -920,40 +1505,83 @@ URI_RAW_GETTER(path);
 URI_RAW_GETTER(query);
 URI_RAW_GETTER(frag);
 
+// Returns the exact length of the serialized authority section
 static
-SV* get_raw_auth(pTHX_ SV *uri_obj) {
-  uri_t *uri = URI(uri_obj);
-  SV *out = newSVpvn("", 0);
+size_t auth_length(uri_t *uri) {
+  size_t len = 0;
 
-  if (uri->is_iri) {
-    SvUTF8_on(out);
+  if (uri->usr->length > 0) {
+    len += uri->usr->length + 1;
+    if (uri->pwd->length > 0) len += uri->pwd->length + 1;
   }
 
-  if (str_len(uri->usr) > 0) {
-    if (str_len(uri->pwd) > 0) {
-      sv_catpvn(out, str_get(uri->usr), str_len(uri->usr));
-      sv_catpvn(out, ":", 1);
-      sv_catpvn(out, str_get(uri->pwd), str_len(uri->pwd));
-      sv_catpvn(out, "@", 1);
-    } else {
-      sv_catpvn(out, str_get(uri->usr), str_len(uri->usr));
-      sv_catpvn(out, "@", 1);
+  if (uri->host->length > 0) {
+    len += uri->host->length;
+    if (uri->port->length > 0) len += uri->port->length + 1;
+  }
+
+  return len;
+}
+
+// Writes the serialized authority section to out, which must have room for
+// auth_length() bytes, and returns a pointer past the last byte written.
+static
+char* auth_write(uri_t *uri, char *out) {
+  if (uri->usr->length > 0) {
+    Copy(uri->usr->string, out, uri->usr->length, char);
+    out += uri->usr->length;
+
+    if (uri->pwd->length > 0) {
+      *out++ = ':';
+      Copy(uri->pwd->string, out, uri->pwd->length, char);
+      out += uri->pwd->length;
     }
+
+    *out++ = '@';
   }
 
-  if (str_len(uri->host) > 0) {
-    if (str_len(uri->port) > 0) {
-      sv_catpvn(out, str_get(uri->host), str_len(uri->host));
-      sv_catpvn(out, ":", 1);
-      sv_catpvn(out, str_get(uri->port), str_len(uri->port));
-    } else {
-      sv_catpvn(out, str_get(uri->host), str_len(uri->host));
+  if (uri->host->length > 0) {
+    Copy(uri->host->string, out, uri->host->length, char);
+    out += uri->host->length;
+
+    if (uri->port->length > 0) {
+      *out++ = ':';
+      Copy(uri->port->string, out, uri->port->length, char);
+      out += uri->port->length;
     }
   }
 
   return out;
 }
 
+// Returns a new SV with room for len bytes, to which the caller will write
+// exactly len bytes before calling sv_written.
+static inline
+SV* sv_for_write(pTHX_ size_t len, int is_iri) {
+  SV *out = newSV(len + 1);
+  SvPOK_on(out);
+
+  if (is_iri) {
+    SvUTF8_on(out);
+  }
+
+  return out;
+}
+
+static inline
+void sv_written(pTHX_ SV *sv, const char *end) {
+  SvCUR_set(sv, end - SvPVX(sv));
+  *SvEND(sv) = '\0';
+}
+
+static
+SV* get_raw_auth(pTHX_ SV *uri_obj) {
+  uri_t *uri = URI(uri_obj);
+  SV *out = sv_for_write(aTHX_ auth_length(uri), uri->is_iri);
+  sv_written(aTHX_ out, auth_write(uri, SvPVX(out)));
+  return out;
+}
+
 /*------------------------------------------------------------------------------
  * Decoding getters
  -----------------------------------------------------------------------------*/
@@ -962,7 +1590,24 @@ URI_SIMPLE_GETTER(scheme);
 URI_SIMPLE_GETTER(usr);
 URI_SIMPLE_GETTER(pwd);
 URI_SIMPLE_GETTER(host);
-URI_SIMPLE_GETTER(port);
+// Returns the port as a number when it is numeric and in range, avoiding any
+// string conversion; otherwise returns the decoded string.
+static
+SV* get_port(pTHX_ SV *sv_uri) {
+  uri_t *uri = uri_classified(URI(sv_uri));
+  uri_str_t *str = uri->port;
+
+  if (uri->port_num >= 0) {
+    return newSViv(uri->port_num);
+  }
+
+  if (str->length == 0) return newSVpvn("", 0);
+  char decoded[ str->length + 1 ];
+  size_t len = uri_decode(str->string, str->length, decoded, "");
+  SV *out = newSVpvn(decoded, len);
+  sv_utf8_decode(out);
+  return out;
+}
 URI_SIMPLE_GETTER(frag);
 
 URI_COMPOUND_GETTER(path);
@@ -1110,9 +1755,12 @@ SV* query_hash(pTHX_ SV *sv_uri) {
   return newRV_noinc((SV*) out);
 }
 
+/*
+ * Returns an array ref of the decoded values of the parameter sv_key within
+ * the raw query string. Parameters without a value are undef.
+ */
 static
-SV* get_param(pTHX_ SV* sv_uri, SV* sv_key) {
-  uri_t *uri = URI(sv_uri);
+SV* query_param(pTHX_ const char *query, size_t query_len, SV* sv_key, int is_iri) {
   size_t klen, vlen, elen;
   const char *key;
   uri_query_scanner_t scanner;
@@ -1137,9 +1785,9 @@ SV* get_param(pTHX_ SV* sv_uri, SV* sv_key) {
   }
 
   char enc_key[(klen * 3) + 2];
-  elen = uri_encode(key, klen, enc_key, ":@?/", uri->is_iri);
+  elen = uri_encode(key, klen, enc_key, ":@?/", is_iri);
 
-  query_scanner_init(&scanner, uri->query->string, uri->query->length);
+  query_scanner_init(&scanner, query, query_len);
 
   while (!query_scanner_done(&scanner)) {
     query_scanner_next(&scanner, &token);
@@ -1162,6 +1810,12 @@ SV* get_param(pTHX_ SV* sv_uri, SV* sv_key) {
   return newRV_noinc((SV*) out);
 }
 
+static
+SV* get_param(pTHX_ SV* sv_uri, SV* sv_key) {
+  uri_t *uri = URI(sv_uri);
+  return query_param(aTHX_ uri->query->string, uri->query->length, sv_key, uri->is_iri);
+}
+
 /*------------------------------------------------------------------------------
  * Raw setters
  -----------------------------------------------------------------------------*/
@@ -1177,7 +1831,7 @@ URI_RAW_SETTER(port);
 
 static
 void set_raw_auth(pTHX_ SV *sv_uri, SV *sv_value) {
-  uri_t *uri = URI(sv_uri);
+  uri_t *uri = URI_WRITABLE(sv_uri);
 
   str_clear(aTHX_ uri->usr);
   str_clear(aTHX_ uri->pwd);
@@ -1212,7 +1866,9 @@ URI_SIMPLE_SETTER(host,   URI_CHARS_HOST);
 
 static
 void set_port(pTHX_ SV *sv_uri, SV *sv_value) {
-  uri_t *uri = URI(sv_uri);
+  uri_t *uri = URI_WRITABLE(sv_uri);
+  URI_CHANGED(uri);
+
   if (!is_defined(aTHX_ sv_value)) {
     str_clear(aTHX_ uri->port);
     return;
@@ -1225,7 +1881,7 @@ void set_port(pTHX_ SV *sv_uri, SV *sv_value) {
 
 static
 void set_auth(pTHX_ SV *sv_uri, SV *sv_value) {
-  uri_t *uri = URI(sv_uri);
+  uri_t *uri = URI_WRITABLE(sv_uri);
 
   str_clear(aTHX_ uri->usr);
   str_clear(aTHX_ uri->pwd);
@@ -1250,7 +1906,7 @@ void set_auth(pTHX_ SV *sv_uri, SV *sv_value) {
 
 static
 void set_path_array(pTHX_ SV *sv_uri, SV *sv_path) {
-  uri_t *uri = URI(sv_uri);
+  uri_t *uri = URI_WRITABLE(sv_uri);
   SV **refval, *tmp;
   AV *av_path;
   size_t i, av_idx, seg_len;
@@ -1302,7 +1958,7 @@ void set_path_array(pTHX_ SV *sv_uri, SV *sv_path) {
 
 static
 void update_query_keyset(pTHX_ SV *sv_uri, SV *sv_key_set, SV *sv_separator) {
-  uri_t  *uri = URI(sv_uri);
+  uri_t  *uri = URI_WRITABLE(sv_uri);
   HE     *ent;
   HV     *keys, *enc_keys;
   I32    iterlen, i, klen;
@@ -1409,7 +2065,7 @@ void update_query_keyset(pTHX_ SV *sv_uri, SV *sv_key_set, SV *sv_separator) {
 
 static
 void set_param(pTHX_ SV *sv_uri, SV *sv_key, SV *sv_values, SV *sv_separator) {
-  uri_t *uri = URI(sv_uri);
+  uri_t *uri = URI_WRITABLE(sv_uri);
   const char *strval;
   size_t vlen, reflen, av_idx, i = 0, off = 0;
   AV *av_values;
@@ -1511,52 +2167,127 @@ void set_param(pTHX_ SV *sv_uri, SV *sv_key, SV *sv_values, SV *sv_separator) {
  * Other stuff
  -----------------------------------------------------------------------------*/
 
+/*
+ * Serialization computes the exact length of the output from the lengths of
+ * its components so that the output buffer is sized once, and then copies
+ * each component directly into it.
+ */
+
+// Returns the exact length of the serialized uri
 static
-SV* to_string(pTHX_ SV *uri_obj) {
-  uri_t *uri = URI(uri_obj);
-  SV *out = newSVpvn("", 0);
-  SV *auth = sv_2mortal(get_raw_auth(aTHX_ uri_obj));
+size_t uri_string_length(uri_t *uri) {
+  size_t auth = auth_length(uri);
+  size_t len  = uri->path->length;
 
-  if (uri->is_iri) {
-    SvUTF8_on(out);
+  if (uri->scheme->length > 0) {
+    len += uri->scheme->length + 1;
+    if (auth > 0) len += 2;
+  }
+
+  if (auth > 0) {
+    len += auth;
+    if (uri->path->length > 0 && uri->path->string[0] != '/') len += 1;
   }
 
-  if (str_len(uri->scheme) > 0) {
-    sv_catpvn(out, str_get(uri->scheme), str_len(uri->scheme));
-    sv_catpvn(out, ":", 1);
+  if (uri->query->length > 0) len += uri->query->length + 1;
+  if (uri->frag->length > 0)  len += uri->frag->length + 1;
 
-    if (SvTRUE(auth)) {
-      // When the authority section is present, the scheme must be followed by
-      // two forward slashes
-      sv_catpvn(out, "//", 2);
+  return len;
+}
+
+// Writes the serialized uri to out, which must have room for
+// uri_string_length() bytes, and returns a pointer past the last byte written.
+static
+char* uri_string_write(uri_t *uri, char *out) {
+  int has_auth = auth_length(uri) > 0;
+
+  if (uri->scheme->length > 0) {
+    Copy(uri->scheme->string, out, uri->scheme->length, char);
+    out += uri->scheme->length;
+    *out++ = ':';
+
+    // When the authority section is present, the scheme must be followed by
+    // two forward slashes
+    if (has_auth) {
+      *out++ = '/';
+      *out++ = '/';
     }
   }
 
-  if (SvTRUE(auth)) {
-    sv_catsv(out, auth);
+  if (has_auth) {
+    out = auth_write(uri, out);
 
     // When the authority section is present, any path must be separated from
     // the authority section by a forward slash
-    if (str_len(uri->path) > 0 && (str_get(uri->path))[0] != '/') {
-      sv_catpvn(out, "/", 1);
+    if (uri->path->length > 0 && uri->path->string[0] != '/') {
+      *out++ = '/';
     }
   }
 
-  sv_catpvn(out, str_get(uri->path), str_len(uri->path));
+  if (uri->path->length > 0) {
+    Copy(uri->path->string, out, uri->path->length, char);
+    out += uri->path->length;
+  }
 
-  if (str_len(uri->query) > 0) {
-    sv_catpvn(out, "?", 1);
-    sv_catpvn(out, str_get(uri->query), str_len(uri->query));
+  if (uri->query->length > 0) {
+    *out++ = '?';
+    Copy(uri->query->string, out, uri->query->length, char);
+    out += uri->query->length;
   }
 
-  if (str_len(uri->frag) > 0) {
-    sv_catpvn(out, "#", 1);
-    sv_catpvn(out, str_get(uri->frag), str_len(uri->frag));
+  if (uri->frag->length > 0) {
+    *out++ = '#';
+    Copy(uri->frag->string, out, uri->frag->length, char);
+    out += uri->frag->length;
   }
 
   return out;
 }
 
+static
+SV* to_string(pTHX_ SV *uri_obj) {
+  uri_t *uri = URI(uri_obj);
+  SV *out = sv_for_write(aTHX_ uri_string_length(uri), uri->is_iri);
+  sv_written(aTHX_ out, uri_string_write(uri, SvPVX(out)));
+  return out;
+}
+
+/*
+ * Appends the serialized uri to the caller's buffer. When the buffer's utf8
+ * flag matches the uri's, the output is written directly into the buffer
+ * after growing it once. Otherwise, the buffer or the output must be
+ * upgraded, which is left to sv_catsv.
+ */
+static
+void append_to(pTHX_ SV *uri_obj, SV *buf) {
+  uri_t *uri = URI(uri_obj);
+  size_t len, cur;
+  char *end;
+
+  if (!SvOK(buf)) {
+    sv_setpvn(buf, "", 0);
+
+    if (uri->is_iri) {
+      SvUTF8_on(buf);
+    }
+  }
+
+  if (!SvUTF8(buf) != !uri->is_iri) {
+    sv_catsv(buf, sv_2mortal(to_string(aTHX_ uri_obj)));
+    return;
+  }
+
+  len = uri_string_length(uri);
+  SvPV_force_nolen(buf);
+  cur = SvCUR(buf);
+  SvGROW(buf, cur + len + 1);
+
+  end = uri_string_write(uri, SvPVX(buf) + cur);
+  SvCUR_set(buf, end - SvPVX(buf));
+  *SvEND(buf) = '\0';
+  SvSETMAGIC(buf);
+}
+
 static
 void explain(pTHX_ SV* sv_uri) {
   uri_t *uri = URI(sv_uri);
@@ -1585,68 +2316,106 @@ void debug(pTHX_ SV* sv_uri) {
   warn("frag: %s\n",    uri->frag->string);
 }
 
+/*
+ * Scans a URI string into an empty uri_t, ensuring that the source is utf8
+ * encoded.
+ */
 static
-SV* new(pTHX_ const char* class, SV* uri_str, int is_iri) {
+void uri_scan_sv(pTHX_ uri_t *uri, SV *uri_str) {
   const char* src;
   size_t len;
+
+  if (!SvTRUE(uri_str)) {
+    src = "";
+    len = 0;
+  }
+  else {
+    src = uri_source(aTHX_ uri_str, &len);
+  }
+
+  uri_scan(aTHX_ uri, src, len);
+}
+
+/*------------------------------------------------------------------------------
+ * Threads
+ *
+ * Objects hold a pointer to their C struct as the IV of the blessed scalar.
+ * When an interpreter is cloned for a new thread, the IV is copied as-is, so
+ * each object is given a bit of magic whose dup hook, called on the copy of
+ * the scalar, replaces the IV with a pointer to a deep copy of the struct. The
+ * magic's mg_obj is the scalar itself (which perl does not refcount), so that
+ * the hook can find the new scalar.
+ *----------------------------------------------------------------------------*/
+
+// Defines the dup hook and magic vtable for a type, given a function which
+// returns a deep copy of the type's struct.
+#ifdef USE_ITHREADS
+#define URI_DUP_VTBL(name, type, copy) \
+static int name##_mg_dup(pTHX_ MAGIC *mg, CLONE_PARAMS *param) { \
+  SV *inner = mg->mg_obj; \
+  PERL_UNUSED_ARG(param); \
+  SvIV_set(inner, (IV) copy(aTHX_ (type*) SvIVX(inner))); \
+  return 0; \
+} \
+static MGVTBL name##_vtbl = { 0, 0, 0, 0, 0, 0, name##_mg_dup, 0 };
+
+#define URI_THREADSAFE(inner, name) \
+  (sv_magicext((inner), (inner), PERL_MAGIC_ext, &name##_vtbl, NULL, 0)->mg_flags |= MGf_DUP)
+#else
+#define URI_DUP_VTBL(name, type, copy)
+#define URI_THREADSAFE(inner, name)
+#endif
+
+URI_DUP_VTBL(uri, uri_t, uri_copy)
+
+static
+SV* new(pTHX_ const char* class, SV* uri_str, int is_iri) {
   uri_t* uri;
   SV*    obj;
   SV*    obj_ref;
 
   // Initialize the struct
-  Newx(uri, 1, uri_t);
-  Zero(uri, 1, uri_t);
-
-  uri->is_iri = is_iri;
-  uri->scheme = str_new(aTHX_ URI_SIZE_scheme);
-  uri->usr    = str_new(aTHX_ URI_SIZE_usr);
-  uri->pwd    = str_new(aTHX_ URI_SIZE_pwd);
-  uri->host   = str_new(aTHX_ URI_SIZE_host);
-  uri->port   = str_new(aTHX_ URI_SIZE_port);
-  uri->path   = str_new(aTHX_ URI_SIZE_path);
-  uri->query  = str_new(aTHX_ URI_SIZE_query);
-  uri->frag   = str_new(aTHX_ URI_SIZE_frag);
+  uri = uri_alloc(aTHX_ is_iri);
 
   // Build the blessed instance
   obj = newSViv((IV) uri);
+  URI_THREADSAFE(obj, uri);
   obj_ref = newRV_noinc(obj);
   sv_bless(obj_ref, gv_stashpv(class, GV_ADD));
 
   // Scan the input string to fill the struct
-  if (!SvTRUE(uri_str)) {
-    src = "";
-    len = 0;
-  }
-  else {
-    // Copy input string *before* calling DO_UTF8() in case the SV is an object
-    // with string overloading, which may trigger the utf8 flag.
-    src = SvPV_nomg_const(uri_str, len);
+  uri_scan_sv(aTHX_ uri, uri_str);
 
-    // Ensure the pv bytes are utf8-encoded
-    if (!DO_UTF8(uri_str)) {
-      uri_str = sv_2mortal(newSVpvn(src, len));
-      sv_utf8_encode(uri_str);
-      src = SvPV_const(uri_str, len);
-    }
-  }
+  return obj_ref;
+}
 
-  uri_scan(aTHX_ uri, src, len);
+/*
+ * Clears the uri_t and scans a new URI string into it. Because str_set reuses
+ * each member's allocated buffer when the new value fits, reparsing URIs of
+ * similar length requires no allocation.
+ */
+static
+void reparse(pTHX_ SV *uri_obj, SV *uri_str) {
+  uri_t *uri = URI_WRITABLE(uri_obj);
 
-  return obj_ref;
+  // Reparsing an object into itself would clear it before it is read
+  if (SvROK(uri_str) && SvRV(uri_str) == SvRV(uri_obj)) {
+    return;
+  }
+
+  uri_clear(aTHX_ uri);
+  uri_scan_sv(aTHX_ uri, uri_str);
 }
 
 static
 void DESTROY(pTHX_ SV *sv_uri) {
-  uri_t *uri = URI(sv_uri);
-  str_free(aTHX_ uri->scheme);
-  str_free(aTHX_ uri->usr);
-  str_free(aTHX_ uri->pwd);
-  str_free(aTHX_ uri->host);
-  str_free(aTHX_ uri->port);
-  str_free(aTHX_ uri->path);
-  str_free(aTHX_ uri->query);
-  str_free(aTHX_ uri->frag);
-  Safefree(uri);
+  // Storable blesses the object before STORABLE_thaw fills it in, so it may be
+  // destroyed empty if thawing fails.
+  if (SvROK(sv_uri) && !SvIOK(SvRV(sv_uri))) {
+    return;
+  }
+
+  uri_free(aTHX_ URI(sv_uri));
 }
 
 /*
@@ -1768,19 +2537,128 @@ void uri_split(pTHX_ SV *uri) {
   PUTBACK;
 }
 
-/*
- * Collapses dotted segments in a path string based on the rules defined in RFC
- * 3986 section 5.2.
- */
+/*------------------------------------------------------------------------------
+ * Component extractors
+ *
+ * Locate a single component within a URI string without building an object.
+ * Each follows the same rules as uri_scan and uri_scan_auth, but stops as soon
+ * as the requested component has been found.
+ *----------------------------------------------------------------------------*/
+
+// Trims white space as uri_scan does and returns the length of the scheme,
+// setting *idx to the start of the string and *len to its trimmed end. The
+// scheme, if any, begins at *idx.
 static
-void remove_dot_segments(pTHX_ uri_str_t *out, const char *path, size_t len) {
-  if (len == 0) {
-    return;
+size_t peek_scheme(const char *src, size_t *idx, size_t *len) {
+  size_t brk;
+
+  while (*idx < *len && my_isspace(src[*idx]) == 1)     ++*idx;
+  while (*len > *idx && my_isspace(src[*len - 1]) == 1) --*len;
+
+  brk = strncspn(&src[*idx], *len - *idx, ":/@?#");
+
+  return brk > 0 && brk < *len - *idx && src[*idx + brk] == ':' ? brk : 0;
+}
+
+// Sets *start to the offset of the host within src and returns its length
+static
+size_t peek_host(const char *src, size_t len, size_t *start) {
+  size_t idx = 0, end, brk;
+  size_t scheme = peek_scheme(src, &idx, &len);
+
+  if (scheme > 0) {
+    idx += scheme + 1;
+  }
+
+  if (idx + 1 >= len || src[idx] != '/' || src[idx + 1] != '/') {
+    return 0;
+  }
+
+  idx += 2;
+  end  = idx + strncspn(&src[idx], len - idx, "/?#");
+
+  // Skip credentials
+  brk = strncspn(&src[idx], end - idx, "@");
+  if (brk > 0 && brk != end - idx) {
+    idx += brk + 1;
+  }
+
+  // Maybe an IPV6 address, including the brackets
+  if (idx < end && src[idx] == '[') {
+    brk = strncspn(&src[idx], end - idx, "]");
+
+    if (brk < end - idx) {
+      *start = idx;
+      return brk + 1;
+    }
+  }
+
+  *start = idx;
+  return strncspn(&src[idx], end - idx, ":");
+}
+
+// Sets *start to the offset of the query within src and returns its length,
+// or returns -1 if there is no query.
+static
+SSize_t peek_query(const char *src, size_t len, size_t *start) {
+  size_t idx;
+
+  while (len > 0 && my_isspace(src[len - 1]) == 1) --len;
+
+  idx = strncspn(src, len, "?#");
+
+  if (idx == len || src[idx] == '#') {
+    return -1;
+  }
+
+  *start = idx + 1;
+  return strncspn(&src[idx + 1], len - idx - 1, "#");
+}
+
+// Decodes a component as URI_SIMPLE_GETTER does
+static
+SV* peek_decoded(pTHX_ const char *src, size_t len) {
+  if (len == 0) return newSVpvn("", 0);
+  char decoded[ len + 1 ];
+  size_t dlen = uri_decode(src, len, decoded, "");
+  SV *out = newSVpvn(decoded, dlen);
+  sv_utf8_decode(out);
+  return out;
+}
+
+static
+SV* peek_component(pTHX_ SV *sv, int which) {
+  const char *src;
+  size_t len, start = 0, n;
+
+  if (sv_isobject(sv) && sv_derived_from(sv, "URI::Fast")) {
+    return which == 0 ? get_scheme(aTHX_ sv) : get_host(aTHX_ sv);
+  }
+
+  if (!SvTRUE(sv)) {
+    return newSVpvn("", 0);
+  }
+
+  src = uri_source(aTHX_ sv, &len);
+
+  if (which == 0) {
+    n = peek_scheme(src, &start, &len);
+  } else {
+    n = peek_host(src, len, &start);
   }
 
-  size_t brk, idx = 0;
-  char in[len];
-  Copy(path, in, len + 1, char);
+  return peek_decoded(aTHX_ &src[start], n);
+}
+
+/*
+ * Collapses dotted segments in a path buffer in place based on the rules
+ * defined in RFC 3986 section 5.2. The write cursor never passes the read
+ * cursor, so no copy of the input is needed. The buffer must be nul-terminated
+ * at len. Returns the new length of the path.
+ */
+static
+size_t remove_dot_segments_inplace(char *in, size_t len) {
+  size_t brk, i, idx = 0, out = 0;
 
   while (idx < len) {
     // in begins with "./" or "../": ignore prefix completely
@@ -1805,14 +2683,14 @@ void remove_dot_segments(pTHX_ uri_str_t *out, const char *path, size_t len) {
     // in begins with /../: replace with /, remove final segment from out
     else if (strncmp(&in[idx], "/../", 4) == 0) {
       idx += 3; // inc to the final / in /./ instead of editing the buffer
-      str_rtrim(aTHX_ out, '/');
+      for (i = out; i > 0; --i) if (in[i - 1] == '/') { out = i - 1; break; }
     }
 
     // in begins with /.. and .. is a complete $in segment: replace with /, remove final segment from out
     else if (strncmp(&in[idx], "/..", 3) == 0 && idx + 3 == len) {
       idx += 2;
       in[idx] = '/';
-      str_rtrim(aTHX_ out, '/');
+      for (i = out; i > 0; --i) if (in[i - 1] == '/') { out = i - 1; break; }
     }
 
     // in is "." or "..": done
@@ -1824,69 +2702,484 @@ void remove_dot_segments(pTHX_ uri_str_t *out, const char *path, size_t len) {
     // else copy everything up to but not including the next '/' from in to out
     else {
       if (in[idx] == '/') {
-        brk = minnum(len - idx, 1 + strncspn(&in[idx + 1], len - idx, "/"));
+        brk = minnum(len - idx, 1 + strncspn(&in[idx + 1], len - idx - 1, "/"));
       }
       else {
         brk = strncspn(&in[idx], len - idx, "/");
       }
 
-      str_append(aTHX_ out, &in[idx], brk);
+      if (out != idx) {
+        Move(&in[idx], &in[out], brk, char);
+      }
+
+      out += brk;
       idx += brk;
     }
   }
+
+  return out;
+}
+
+/*
+ * Collapses dotted segments in a path string based on the rules defined in RFC
+ * 3986 section 5.2, writing the result to out.
+ */
+static
+void remove_dot_segments(pTHX_ uri_str_t *out, const char *path, size_t len) {
+  if (len == 0) {
+    return;
+  }
+
+  str_set(aTHX_ out, path, len);
+  out->length = remove_dot_segments_inplace(out->string, len);
+  out->string[out->length] = '\0';
 }
 
 /*------------------------------------------------------------------------------
- * Absolution
+ * Internationalized domain names
  *
- * As defined in https://www.rfc-editor.org/rfc/rfc3986.txt section 5.2
+ * Conversion of host names between Unicode and the ASCII compatible encoding
+ * (punycode with the "xn--" prefix) used by DNS, label by label, as described
+ * in RFC 3492 and RFC 5891. Labels are converted directly between the host
+ * buffer and the output buffer; the only intermediate storage is an array of
+ * code points for the label being converted.
  *----------------------------------------------------------------------------*/
+#define URI_PUNY_BASE         36
+#define URI_PUNY_TMIN         1
+#define URI_PUNY_TMAX         26
+#define URI_PUNY_SKEW         38
+#define URI_PUNY_DAMP         700
+#define URI_PUNY_INITIAL_BIAS 72
+#define URI_PUNY_INITIAL_N    128
+
+// Upper bounds on the output of host_to_ascii and host_to_unicode, in bytes,
+// for a host of len bytes.
+#define URI_IDN_ASCII_MAX(len)   ((len) * 8 + 8)
+#define URI_IDN_UNICODE_MAX(len) ((len) * 4 + 4)
+
 static
-void absolute(pTHX_ SV *sv_target, SV *sv_uri, SV *sv_base) {
-  uri_t *target = URI(sv_target);
-  uri_t *rel    = URI(sv_uri);
-  uri_t *base   = URI(sv_base);
+U32 puny_adapt(U32 delta, U32 points, int first) {
+  U32 k = 0;
 
-  const char *class = class_name(aTHX_ sv_target);
+  delta  = first ? delta / URI_PUNY_DAMP : delta / 2;
+  delta += delta / points;
 
-  // Relative URIs may begin with // to indicate an authority section without a
-  // scheme, which is illegal in standard URI syntax (authority may only come
-  // after a scheme, which is required, separated by //). This workaround helps
-  // the parser along by identifying the authority section as such.
-  if (rel->scheme->length == 0
-   && rel->host->length == 0
-   && rel->path->length >= 2
-   && strncmp(rel->path->string, "//", 2) == 0)
-  {
-    SV *fixed = newSVpvn("x:", 2);
-    sv_catsv(fixed, sv_2mortal(to_string(aTHX_ sv_uri)));
+  while (delta > ((URI_PUNY_BASE - URI_PUNY_TMIN) * URI_PUNY_TMAX) / 2) {
+    delta /= URI_PUNY_BASE - URI_PUNY_TMIN;
+    k += URI_PUNY_BASE;
+  }
 
-    SV *sv_tmp = sv_2mortal(new(aTHX_ class, sv_2mortal(fixed), 0));
-    rel = URI(sv_tmp);
+  return k + (URI_PUNY_BASE - URI_PUNY_TMIN + 1) * delta / (delta + URI_PUNY_SKEW);
+}
 
-    str_clear(aTHX_ rel->scheme);
-  }
+static inline
+U32 puny_threshold(U32 k, U32 bias) {
+  return k <= bias                  ? URI_PUNY_TMIN
+       : k >= bias + URI_PUNY_TMAX  ? URI_PUNY_TMAX
+       : k - bias;
+}
 
-  if (rel->scheme->length != 0) {
-    remove_dot_segments(aTHX_ target->path, rel->path->string, rel->path->length);
-    str_copy(aTHX_ rel->scheme, target->scheme);
-    str_copy(aTHX_ rel->usr,    target->usr);
-    str_copy(aTHX_ rel->pwd,    target->pwd);
-    str_copy(aTHX_ rel->host,   target->host);
+static inline
+char puny_digit(U32 d) {
+  return d < 26 ? 'a' + d : '0' + (d - 26);
+}
+
+static inline
+int puny_value(char c) {
+  return c >= 'a' && c <= 'z' ? c - 'a'
+       : c >= 'A' && c <= 'Z' ? c - 'A'
+       : c >= '0' && c <= '9' ? c - '0' + 26
+       : -1;
+}
+
+/*
+ * Decodes the UTF-8 sequence in the first len bytes of in into code points.
+ * Returns the number of code points, or -1 if the sequence is invalid.
+ */
+static
+SSize_t idn_utf8_decode(const U8 *in, size_t len, U32 *out) {
+  size_t i = 0, n, j;
+  SSize_t count = 0;
+  U32 cp;
+
+  while (i < len) {
+    U8 c = in[i];
+
+    if      (c < 0x80)           { cp = c;        n = 0; }
+    else if ((c & 0xE0) == 0xC0) { cp = c & 0x1F; n = 1; }
+    else if ((c & 0xF0) == 0xE0) { cp = c & 0x0F; n = 2; }
+    else if ((c & 0xF8) == 0xF0) { cp = c & 0x07; n = 3; }
+    else return -1;
+
+    if (n > 0 && i + n >= len) return -1;
+
+    for (j = 1; j <= n; ++j) {
+      if ((in[i + j] & 0xC0) != 0x80) return -1;
+      cp = (cp << 6) | (in[i + j] & 0x3F);
+    }
+
+    if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return -1;
+
+    out[count++] = cp;
+    i += n + 1;
+  }
+
+  return count;
+}
+
+static
+size_t idn_utf8_encode(U32 cp, char *out) {
+  if (cp < 0x80) {
+    out[0] = cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    out[0] = 0xC0 | (cp >> 6);
+    out[1] = 0x80 | (cp & 0x3F);
+    return 2;
+  }
+  if (cp < 0x10000) {
+    out[0] = 0xE0 | (cp >> 12);
+    out[1] = 0x80 | ((cp >> 6) & 0x3F);
+    out[2] = 0x80 | (cp & 0x3F);
+    return 3;
+  }
+  out[0] = 0xF0 | (cp >> 18);
+  out[1] = 0x80 | ((cp >> 12) & 0x3F);
+  out[2] = 0x80 | ((cp >> 6) & 0x3F);
+  out[3] = 0x80 | (cp & 0x3F);
+  return 4;
+}
+
+/*
+ * Punycode encodes a label of len UTF-8 bytes into out, prefixed with "xn--".
+ * ASCII letters are lower cased. Returns the length of the output, or 0 if
+ * the label cannot be encoded, in which case the label should be left as-is.
+ */
+static
+size_t idn_label_to_ascii(const char *label, size_t len, char *out) {
+  U32 cps[len];
+  SSize_t count = idn_utf8_decode((const U8*) label, len, cps);
+  U32 n = URI_PUNY_INITIAL_N, bias = URI_PUNY_INITIAL_BIAS, delta = 0;
+  U32 h, b = 0, m, q, k, t;
+  SSize_t i;
+  size_t pos = 4;
+
+  if (count <= 0) return 0;
+
+  Copy("xn--", out, 4, char);
+
+  for (i = 0; i < count; ++i) {
+    if (cps[i] < 0x80) {
+      out[pos++] = toLOWER((char) cps[i]);
+      ++b;
+    }
+  }
+
+  h = b;
+  if (b > 0) out[pos++] = '-';
+
+  while (h < (U32) count) {
+    // Next smallest code point to encode
+    m = 0xFFFFFFFF;
+    for (i = 0; i < count; ++i) {
+      if (cps[i] >= n && cps[i] < m) m = cps[i];
+    }
+
+    if ((m - n) > (0xFFFFFFFF - delta) / (h + 1)) return 0; // overflow
+    delta += (m - n) * (h + 1);
+    n = m;
+
+    for (i = 0; i < count; ++i) {
+      if (cps[i] < n && ++delta == 0) return 0; // overflow
+
+      if (cps[i] == n) {
+        for (q = delta, k = URI_PUNY_BASE;; k += URI_PUNY_BASE) {
+          t = puny_threshold(k, bias);
+          if (q < t) break;
+          out[pos++] = puny_digit(t + (q - t) % (URI_PUNY_BASE - t));
+          q = (q - t) / (URI_PUNY_BASE - t);
+        }
+
+        out[pos++] = puny_digit(q);
+        bias  = puny_adapt(delta, h + 1, h == b);
+        delta = 0;
+        ++h;
+      }
+    }
+
+    ++delta;
+    ++n;
+  }
+
+  return pos;
+}
+
+/*
+ * Decodes a punycode label of len bytes, including its "xn--" prefix, into
+ * UTF-8. Returns the length of the output, or 0 if the label is not valid
+ * punycode or does not decode to any non-ASCII characters, in which case the
+ * label should be left as-is.
+ */
+static
+size_t idn_label_to_unicode(const char *label, size_t len, char *out) {
+  U32 cps[len];
+  U32 n = URI_PUNY_INITIAL_N, bias = URI_PUNY_INITIAL_BIAS, i = 0;
+  U32 oldi, w, k, t, count = 0;
+  size_t b = 0, in, pos = 0, j;
+  int digit;
+
+  label += 4;
+  len   -= 4;
+
+  // Basic code points precede the last delimiter
+  for (j = 0; j < len; ++j) {
+    if (label[j] == '-') b = j;
+  }
+
+  for (j = 0; j < b; ++j) {
+    if ((U8) label[j] >= 0x80) return 0;
+    cps[count++] = (U8) label[j];
+  }
+
+  for (in = b > 0 ? b + 1 : 0; in < len; ++count) {
+    for (oldi = i, w = 1, k = URI_PUNY_BASE;; k += URI_PUNY_BASE) {
+      if (in >= len) return 0;
+
+      digit = puny_value(label[in++]);
+      if (digit < 0) return 0;
+      if ((U32) digit > (0xFFFFFFFF - i) / w) return 0; // overflow
+      i += digit * w;
+
+      t = puny_threshold(k, bias);
+      if ((U32) digit < t) break;
+
+      if (w > 0xFFFFFFFF / (URI_PUNY_BASE - t)) return 0; // overflow
+      w *= URI_PUNY_BASE - t;
+    }
+
+    bias = puny_adapt(i - oldi, count + 1, oldi == 0);
+
+    if (i / (count + 1) > 0x10FFFF - n) return 0;
+    n += i / (count + 1);
+    i %= (count + 1);
+
+    if (n < 0x80 || n > 0x10FFFF || (n >= 0xD800 && n <= 0xDFFF)) return 0;
+
+    Move(&cps[i], &cps[i + 1], count - i, U32);
+    cps[i++] = n;
+  }
+
+  if (count == b) return 0;
+
+  for (j = 0; j < count; ++j) {
+    pos += idn_utf8_encode(cps[j], &out[pos]);
+  }
+
+  return pos;
+}
+
+static inline
+int idn_is_ace(const char *label, size_t len) {
+  return len > 4
+      && toLOWER(label[0]) == 'x'
+      && toLOWER(label[1]) == 'n'
+      && label[2] == '-'
+      && label[3] == '-';
+}
+
+/*
+ * Converts each label of a UTF-8 host name into out, which must have room for
+ * at least URI_IDN_ASCII_MAX(len) (to_ascii) or URI_IDN_UNICODE_MAX(len) bytes.
+ * Labels which do not require conversion, or which cannot be converted, are
+ * copied unchanged. IP literals are copied unchanged. Returns the length of
+ * the output.
+ */
+static
+size_t host_convert(const char *host, size_t len, char *out, int to_ascii) {
+  size_t start = 0, end, pos = 0, n, i;
+  int convert;
+
+  if (len > 0 && host[0] == '[') {
+    Copy(host, out, len, char);
+    return len;
+  }
+
+  while (start <= len) {
+    end = start + strncspn(&host[start], len - start, ".");
+
+    if (to_ascii) {
+      for (convert = 0, i = start; i < end && !convert; ++i) {
+        convert = (U8) host[i] > 127;
+      }
+    }
+    else {
+      convert = idn_is_ace(&host[start], end - start);
+    }
+
+    n = !convert ? 0
+      : to_ascii ? idn_label_to_ascii(&host[start], end - start, &out[pos])
+      :            idn_label_to_unicode(&host[start], end - start, &out[pos]);
+
+    if (n == 0) {
+      Copy(&host[start], &out[pos], end - start, char);
+      n = end - start;
+    }
+
+    pos += n;
+
+    if (end < len) out[pos++] = '.';
+    start = end + 1;
+  }
+
+  return pos;
+}
+
+// Returns true if the host requires conversion to (or from) its ASCII form.
+static
+int host_needs_conversion(uri_str_t *host, int to_ascii) {
+  size_t i;
+
+  for (i = 0; i < host->length; ++i) {
+    if (to_ascii) {
+      if (host->string[i] == '%' || (U8) host->string[i] > 127) return 1;
+    }
+    else if ((i == 0 || host->string[i - 1] == '.') && idn_is_ace(&host->string[i], host->length - i)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Returns the host converted to its ASCII (to_ascii true) or Unicode form. The
+ * host buffer is percent-decoded first, if necessary. The result is written
+ * directly into the new SV's buffer.
+ */
+static
+SV* get_host_idn(pTHX_ SV *sv_uri, int to_ascii) {
+  uri_str_t *str = URI(sv_uri)->host;
+  const char *host = str->string;
+  size_t len = str->length;
+  int encoded;
+  SV *out;
+
+  if (len == 0) {
+    return newSVpvn("", 0);
+  }
+
+  if (!host_needs_conversion(str, to_ascii)) {
+    out = newSVpvn(host, len);
+    if (!to_ascii) sv_utf8_decode(out);
+    return out;
+  }
+
+  encoded = memchr(host, '%', len) != NULL;
+  char decoded[ encoded ? len + 1 : 1 ];
+
+  if (encoded) {
+    len  = uri_decode_utf8(host, len, decoded);
+    host = decoded;
+  }
+
+  out = newSV(to_ascii ? URI_IDN_ASCII_MAX(len) : URI_IDN_UNICODE_MAX(len));
+  SvPOK_only(out);
+  SvCUR_set(out, host_convert(host, len, SvPVX(out), to_ascii));
+  *SvEND(out) = '\0';
+
+  if (!to_ascii) sv_utf8_decode(out);
+
+  return out;
+}
+
+// Replaces the host of the uri with its ASCII or Unicode form.
+static
+void normalize_host_idn(pTHX_ uri_t *uri, int to_ascii) {
+  uri_str_t *str = uri->host;
+  size_t len = str->length, cap;
+  char *out;
+
+  if (len == 0 || !host_needs_conversion(str, to_ascii)) {
+    return;
+  }
+
+  char decoded[len + 1];
+  len = uri_decode_utf8(str->string, len, decoded);
+
+  cap = to_ascii ? URI_IDN_ASCII_MAX(len) : URI_IDN_UNICODE_MAX(len);
+  Newx(out, cap, char);
+  len = host_convert(decoded, len, out, to_ascii);
+  str_set(aTHX_ str, out, len);
+  Safefree(out);
+}
+
+/*------------------------------------------------------------------------------
+ * Absolution
+ *
+ * As defined in https://www.rfc-editor.org/rfc/rfc3986.txt section 5.2
+ *----------------------------------------------------------------------------*/
+static
+void absolute(pTHX_ SV *sv_target, SV *sv_uri, SV *sv_base) {
+  uri_t *target = URI(sv_target);
+  uri_t *rel    = URI(sv_uri);
+  uri_t *base   = URI(sv_base);
+
+  const char *path = str_get(rel->path);
+  size_t path_len  = str_len(rel->path);
+  int has_auth     = rel->usr->length > 0 || rel->host->length > 0;
+
+  // Relative URIs may begin with // to indicate an authority section without a
+  // scheme, which is illegal in standard URI syntax (authority may only come
+  // after a scheme, which is required, separated by //). Rather than
+  // stringifying and reparsing the relative URI, the authority is scanned
+  // directly out of the path buffer into the target.
+  if (rel->scheme->length == 0
+   && rel->host->length == 0
+   && path_len >= 2
+   && strncmp(path, "//", 2) == 0)
+  {
+    size_t auth_len = strncspn(&path[2], path_len - 2, "/");
+
+    if (auth_len > 0) {
+      str_clear(aTHX_ target->usr);
+      str_clear(aTHX_ target->pwd);
+      str_clear(aTHX_ target->host);
+      str_clear(aTHX_ target->port);
+      uri_scan_auth(aTHX_ target, &path[2], auth_len);
+      has_auth = 1;
+    }
+
+    path     += 2 + auth_len;
+    path_len -= 2 + auth_len;
+  }
+
+  if (rel->scheme->length != 0) {
+    remove_dot_segments(aTHX_ target->path, path, path_len);
+    str_copy(aTHX_ rel->scheme, target->scheme);
+    str_copy(aTHX_ rel->usr,    target->usr);
+    str_copy(aTHX_ rel->pwd,    target->pwd);
+    str_copy(aTHX_ rel->host,   target->host);
     str_copy(aTHX_ rel->port,   target->port);
     str_copy(aTHX_ rel->query,  target->query);
   }
   else {
-    if (rel->usr->length > 0 || rel->host->length > 0) {
-      remove_dot_segments(aTHX_ target->path, rel->path->string, rel->path->length);
-      str_copy(aTHX_ rel->usr,    target->usr);
-      str_copy(aTHX_ rel->pwd,    target->pwd);
-      str_copy(aTHX_ rel->host,   target->host);
-      str_copy(aTHX_ rel->port,   target->port);
+    if (has_auth) {
+      remove_dot_segments(aTHX_ target->path, path, path_len);
+
+      // When the authority was scanned out of the path, it has already been
+      // written to the target.
+      if (rel->usr->length > 0 || rel->host->length > 0) {
+        str_copy(aTHX_ rel->usr,    target->usr);
+        str_copy(aTHX_ rel->pwd,    target->pwd);
+        str_copy(aTHX_ rel->host,   target->host);
+        str_copy(aTHX_ rel->port,   target->port);
+      }
+
       str_copy(aTHX_ rel->query,  target->query);
     }
     else {
-      if (rel->path->length == 0) {
+      if (path_len == 0) {
         str_copy(aTHX_ base->path, target->path);
 
         if (rel->query->length != 0) {
@@ -1896,15 +3189,15 @@ void absolute(pTHX_ SV *sv_target, SV *sv_uri, SV *sv_base) {
         }
       }
       else {
-        if (rel->path->string[0] == '/') {
-          remove_dot_segments(aTHX_ target->path, rel->path->string, rel->path->length);
+        if (path[0] == '/') {
+          remove_dot_segments(aTHX_ target->path, path, path_len);
         }
         else {
-          uri_str_t *merged = str_new(aTHX_ rel->path->length + base->path->length);
+          uri_str_t *merged = str_new(aTHX_ path_len + base->path->length);
 
           if (base->scheme->length > 0 && base->path->length == 0) {
             str_append(aTHX_ merged, "/", 1);
-            str_append(aTHX_ merged, rel->path->string, rel->path->length);
+            str_append(aTHX_ merged, path, path_len);
           }
           else {
             if (base->path->length > 0 && strstr(base->path->string, "/") != NULL) {
@@ -1916,7 +3209,7 @@ void absolute(pTHX_ SV *sv_target, SV *sv_uri, SV *sv_base) {
             }
 
             str_append(aTHX_ merged, "/", 1);
-            str_append(aTHX_ merged, rel->path->string, rel->path->length);
+            str_append(aTHX_ merged, path, path_len);
           }
 
           remove_dot_segments(aTHX_ target->path, merged->string, merged->length);
@@ -1936,651 +3229,6044 @@ void absolute(pTHX_ SV *sv_target, SV *sv_uri, SV *sv_base) {
   }
 
   str_copy(aTHX_ rel->frag, target->frag);
+  URI_CHANGED(target);
 }
 
-/*
- * Decodes and then reencodes a uri_str_t.
- *
- */
 // unreserved  = ALPHA / DIGIT / "-" / "." / "_" / "~"
 //       41-5A / 61-7A / 30-39 / 2D  / 2E  / 5F  / 7E
 static inline
-void normalize_encoding(pTHX_ uri_str_t *str, char *permitted_chars, int allow_utf8) {
-  if (str->length == 0 || (strchr(str->string, '+') == NULL && strchr(str->string, '%') == NULL)) {
-    return;
-  }
-
-  char decoded[str->length + 1];
-  size_t decoded_len = uri_decode(str->string, str->length, decoded, "");
+bool is_unreserved(const U8 c) {
+  return (c >= 'a' && c <= 'z')
+      || (c >= 'A' && c <= 'Z')
+      || (c >= '0' && c <= '9')
+      || c == '-' || c == '.' || c == '_' || c == '~';
+}
 
-  char encoded[(decoded_len * 3) + 2];
-  size_t encoded_len = uri_encode(decoded, decoded_len, encoded, permitted_chars, allow_utf8);
+// Returns true if a literal char c must be percent-encoded in a normalized
+// member permitting the chars in *permitted. Percent signs are left alone,
+// since they are either already part of an escape or are not decodable.
+static inline
+bool needs_encoding(const U8 c, const char *permitted, int allow_utf8) {
+  if (c == '%' || (allow_utf8 && c > 127)) {
+    return 0;
+  }
 
-  str_set(aTHX_ str, encoded, encoded_len);
+  return ((U32*) uri_encode_tbl)[c] != 0 && !char_in_str(c, permitted);
 }
 
 /*
- * Performs minimal normalization. Scheme and hostname are lower cased. All
- * members are scanned for lower case percent-encoded sequences.
+ * Normalizes the encoding of the first len chars of buffer s in a single pass,
+ * in place:
+ *
+ *   (6.2.2.1) upper cases hex digits in percent-encoded sequences
+ *   (6.2.2.2) decodes percent-encoded sequences of unreserved chars
+ *   (6.2.2.1) lower cases literal and decoded chars when lower is set
+ *
+ * For IRIs, percent-encoded non-ASCII octets are decoded as well. Since
+ * decoding only ever shrinks the string, this pass writes over the buffer it is
+ * reading.
+ *
+ * '+' is normalized to %20, and any literal chars which are neither unreserved
+ * nor permitted must be percent-encoded. Because that expands the string, it is
+ * left to normalize_expand; the number of additional bytes it will require is
+ * stored in *grow.
+ *
+ * *dots is set if, after normalization, any segment of the string begins with
+ * a '.', meaning that it may contain dot segments.
+ *
+ * Returns the new length of the string.
  */
 static
-void normalize(pTHX_ SV *uri_obj) {
-  uri_t *uri = URI(uri_obj);
-  size_t i;
+size_t normalize_buf(char *s, size_t len, const char *permitted, int lower, int allow_utf8, size_t *grow, int *dots) {
+  size_t r = 0, w = 0;
+  U8 c, v1, v2;
 
-  // (6.2.2.1) lower case scheme
-  for (i = 0; i < uri->scheme->length; ++i) {
-    uri->scheme->string[i] = toLOWER(uri->scheme->string[i]);
-  }
+  *grow = 0;
+  *dots = 0;
 
-  // (6.2.2.1) lower case hostname
-  for (i = 0; i < uri->host->length; ++i) {
-    uri->host->string[i] = toLOWER(uri->host->string[i]);
-  }
+  while (r < len) {
+    c = s[r];
 
-  // (6.2.2) remove dot segments from path
-  // This is expensive, so skip it unless the uri has a path with a dot in it.
-  if (uri->path->length > 0
-   && strchr(uri->path->string, '.') != NULL)
-  {
-    uri_str_t *tmp = str_new(aTHX_ URI_SIZE_path);
-    remove_dot_segments(aTHX_ tmp, uri->path->string, uri->path->length);
-    str_free(aTHX_ uri->path);
-    uri->path = tmp;
-  }
+    if (c == '%' && r + 2 < len) {
+      v1 = hex[ (U8) s[r + 1] ];
+      v2 = hex[ (U8) s[r + 2] ];
 
-  // (6.2.2.1) upper case hex codes in each section of the uri
-  // (6.2.2.2) decode any percent-encoded sequences decoding to unreserved chars
-  normalize_encoding(aTHX_ uri->usr,   URI_CHARS_USER,  uri->is_iri);
-  normalize_encoding(aTHX_ uri->pwd,   URI_CHARS_USER,  uri->is_iri);
-  normalize_encoding(aTHX_ uri->host,  URI_CHARS_HOST,  uri->is_iri);
-  normalize_encoding(aTHX_ uri->path,  URI_CHARS_PATH,  uri->is_iri);
-  normalize_encoding(aTHX_ uri->query, URI_CHARS_QUERY, uri->is_iri);
-  normalize_encoding(aTHX_ uri->frag,  URI_CHARS_FRAG,  uri->is_iri);
+      if ((v1 | v2) != 0xFF) {
+        c = (v1 << 4) | v2;
 
-  // (6.2.3) empty path should be represented as "/" when authority is present
-  if (uri->path->length == 0 && has_authority(aTHX_ uri)) {
-    str_set(aTHX_ uri->path, "/", 1);
+        if (is_unreserved(c) || (allow_utf8 && c > 127)) {
+          r += 3;
+        }
+        else {
+          s[w++] = '%';
+          s[w++] = toUPPER(s[r + 1]);
+          s[w++] = toUPPER(s[r + 2]);
+          r += 3;
+          continue;
+        }
+      }
+      else {
+        ++r;
+      }
+    }
+    else {
+      if (c == '+' || needs_encoding(c, permitted, allow_utf8)) {
+        *grow += 2;
+      }
+
+      ++r;
+    }
+
+    if (c == '.' && (w == 0 || s[w - 1] == '/')) {
+      *dots = 1;
+    }
+
+    s[w++] = lower ? toLOWER(c) : c;
   }
+
+  s[w] = '\0';
+
+  return w;
 }
 
 /*
- * Returns a new copy of the uri string with tabs, line feeds, and carriage
- * returns stripped, and backslashes replaced with forward slashes.
+ * Expands '+' and chars requiring encoding in the first len chars of s, working
+ * from the right so that the write cursor always stays ahead of the read
+ * cursor. The buffer must have room for len + grow + 1 chars.
  */
-SV* html_url(pTHX_ SV *uri, SV *base) {
-  SV *rv;
-  size_t i = 0;
-  size_t len;
-  const char *in = SvPV_const(uri, len);
-  uri_str_t *out = str_new(aTHX_ 32);
+static
+void normalize_expand(char *s, size_t len, size_t grow, const char *permitted, int allow_utf8) {
+  size_t r = len;
+  size_t w = len + grow;
+  U8 c;
 
-  if (in[0] == '/' && in[1] == '/') {
-    if (base != NULL && (SvOK(base) || SvROK(base))) {
-      uri_t *base_uri = URI(base);
-      if (base_uri->scheme->length > 0) {
-        str_append(aTHX_ out, base_uri->scheme->string, base_uri->scheme->length);
-        str_append(aTHX_ out, ":", 1);
-      }
+  s[w] = '\0';
+
+  while (r > 0) {
+    c = s[--r];
+
+    if (c == '+') {
+      s[--w] = '0';
+      s[--w] = '2';
+      s[--w] = '%';
+    }
+    else if (needs_encoding(c, permitted, allow_utf8)) {
+      w -= 3;
+      Copy(&uri_encode_tbl[ sizeof(U32) * c ], &s[w], 3, char);
+    }
+    else {
+      s[--w] = c;
     }
   }
+}
 
-  // Remove characters specified by the URL standard
-  for (i = 0; i < len; ++i) {
-    switch (in[i]) {
-      // Strip tabs, line feeds, and carriage returns
-      case '\t':
-      case '\r':
-      case '\n':
-        break;
-
-      // Convert backslashes to forward slashes
-      case '\\':
-        str_append(aTHX_ out, "/", 1);
-        break;
+/*
+ * Normalizes a uri_str_t in place (see normalize_buf). The buffer is only
+ * grown if chars must be expanded; members requiring no changes are neither
+ * copied nor reallocated. Returns true if the string may contain dot segments.
+ */
+static
+int normalize_str(pTHX_ uri_str_t *str, const char *permitted, int lower, int allow_utf8) {
+  size_t grow;
+  int dots;
 
-      default:
-        str_append(aTHX_ out, &in[i], 1);
-        break;
-    }
+  if (str->length == 0) {
+    return 0;
   }
 
-  rv = URI_STR_2SV(out);
-  str_free(aTHX_ out);
+  str->length = normalize_buf(str->string, str->length, permitted, lower, allow_utf8, &grow, &dots);
 
-  // If the source uri was utf8, ensure that the flag is flipped for the output
-  // buffer as well.
-  if (DO_UTF8(uri)) {
-    sv_utf8_decode(rv);
+  if (grow > 0) {
+    str_grow(aTHX_ str, str->length + grow);
+    normalize_expand(str->string, str->length, grow, permitted, allow_utf8);
+    str->length += grow;
   }
 
-  return rv;
+  return dots;
 }
 
+/*
+ * Writes the normalized form of a uri_str_t into buf without modifying the
+ * original. buf must have room for at least (3 * length) + 1 chars. When
+ * is_path is set, dot segments are removed as well. Returns the length of the
+ * normalized string.
+ */
+static
+size_t normalize_copy(uri_str_t *str, char *buf, const char *permitted, int lower, int allow_utf8, int is_path) {
+  size_t len, grow;
+  int dots;
 
-MODULE = URI::Fast  PACKAGE = URI::Fast
+  if (str->length == 0) {
+    buf[0] = '\0';
+    return 0;
+  }
 
-PROTOTYPES: DISABLE
+  Copy(str->string, buf, str->length, char);
+  len = normalize_buf(buf, str->length, permitted, lower, allow_utf8, &grow, &dots);
+
+  if (grow > 0) {
+    normalize_expand(buf, len, grow, permitted, allow_utf8);
+    len += grow;
+  }
+
+  if (is_path && dots) {
+    len = remove_dot_segments_inplace(buf, len);
+    buf[len] = '\0';
+  }
+
+  return len;
+}
+
+/*
+ * Performs minimal normalization. Scheme and hostname are lower cased. All
+ * members are scanned for lower case percent-encoded sequences. Each member
+ * is normalized in a single pass over its own buffer.
+ */
+static
+void normalize(pTHX_ SV *uri_obj, int idn) {
+  uri_t *uri = URI_WRITABLE(uri_obj);
+  size_t i;
+
+  // Optionally convert the host to ASCII (idn > 0) or Unicode (idn < 0) form
+  // before it is normalized.
+  if (idn != 0) {
+    normalize_host_idn(aTHX_ uri, idn > 0);
+  }
+
+  // (6.2.2.1) lower case scheme
+  for (i = 0; i < uri->scheme->length; ++i) {
+    uri->scheme->string[i] = toLOWER(uri->scheme->string[i]);
+  }
+
+  normalize_str(aTHX_ uri->usr,   URI_CHARS_USER,  0, uri->is_iri);
+  normalize_str(aTHX_ uri->pwd,   URI_CHARS_USER,  0, uri->is_iri);
+  normalize_str(aTHX_ uri->host,  URI_CHARS_HOST,  1, uri->is_iri);
+  normalize_str(aTHX_ uri->query, URI_CHARS_QUERY, 0, uri->is_iri);
+  normalize_str(aTHX_ uri->frag,  URI_CHARS_FRAG,  0, uri->is_iri);
+
+  // (6.2.2.3) remove dot segments from path. This is only necessary when some
+  // segment of the path begins with a dot.
+  if (normalize_str(aTHX_ uri->path, URI_CHARS_PATH, 0, uri->is_iri)) {
+    uri->path->length = remove_dot_segments_inplace(uri->path->string, uri->path->length);
+    uri->path->string[uri->path->length] = '\0';
+  }
+
+  // (6.2.3) empty path should be represented as "/" when authority is present
+  if (uri->path->length == 0 && has_authority(aTHX_ uri)) {
+    str_set(aTHX_ uri->path, "/", 1);
+  }
+
+  // IPv6 addresses are rewritten in their canonical form (RFC 5952), keeping
+  // any zone identifier
+  uri_classify(uri);
+
+  if (uri->host_type == URI_HOST_IPV6) {
+    const char *host = uri->host->string;
+    size_t len  = uri->host->length;
+    size_t addr = ipv6_addr_len(&host[1], len - 2);
+    size_t zone = len - 2 - addr;
+    char buf[48 + zone];
+
+    buf[0] = '[';
+    i = 1 + ipv6_format(uri->ip, &buf[1]);
+    Copy(&host[1 + addr], &buf[i], zone, char);
+    i += zone;
+    buf[i++] = ']';
+
+    str_set(aTHX_ uri->host, buf, i);
+  }
+}
+
+/*------------------------------------------------------------------------------
+ * Fingerprinting
+ *
+ * A fingerprint is the 64-bit XXH64 hash (seed 0) of the URI's normalized
+ * string form, i.e. $uri->clone->normalize->to_string. The normalized bytes
+ * are streamed through the hash member by member, so the normalized string is
+ * never built. Input words are always read little-endian, so fingerprints are
+ * identical across platforms, processes, and releases.
+ *----------------------------------------------------------------------------*/
+#define URI_XXH_P1 0x9E3779B185EBCA87ULL
+#define URI_XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define URI_XXH_P3 0x165667B19E3779F9ULL
+#define URI_XXH_P4 0x85EBCA77C2B2AE63ULL
+#define URI_XXH_P5 0x27D4EB2F165667C5ULL
+
+#define URI_ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+typedef struct {
+  U64    v[4];     // stripe accumulators
+  U64    total;    // total number of bytes hashed
+  U8     buf[32];  // partial stripe
+  size_t buflen;   // number of bytes in buf
+} uri_hash_t;
+
+static inline
+U64 hash_read64(const U8 *p) {
+  return ((U64) p[0])       | ((U64) p[1] << 8)
+       | ((U64) p[2] << 16) | ((U64) p[3] << 24)
+       | ((U64) p[4] << 32) | ((U64) p[5] << 40)
+       | ((U64) p[6] << 48) | ((U64) p[7] << 56);
+}
+
+static inline
+U64 hash_read32(const U8 *p) {
+  return ((U64) p[0])       | ((U64) p[1] << 8)
+       | ((U64) p[2] << 16) | ((U64) p[3] << 24);
+}
+
+static inline
+U64 hash_round(U64 acc, U64 input) {
+  acc += input * URI_XXH_P2;
+  acc  = URI_ROTL64(acc, 31);
+  return acc * URI_XXH_P1;
+}
+
+static inline
+U64 hash_merge(U64 acc, U64 val) {
+  acc ^= hash_round(0, val);
+  return acc * URI_XXH_P1 + URI_XXH_P4;
+}
+
+static
+void hash_init(uri_hash_t *h) {
+  h->v[0]   = URI_XXH_P1 + URI_XXH_P2;
+  h->v[1]   = URI_XXH_P2;
+  h->v[2]   = 0;
+  h->v[3]   = -URI_XXH_P1;
+  h->total  = 0;
+  h->buflen = 0;
+}
+
+static inline
+void hash_stripe(uri_hash_t *h, const U8 *p) {
+  h->v[0] = hash_round(h->v[0], hash_read64(p));
+  h->v[1] = hash_round(h->v[1], hash_read64(p + 8));
+  h->v[2] = hash_round(h->v[2], hash_read64(p + 16));
+  h->v[3] = hash_round(h->v[3], hash_read64(p + 24));
+}
+
+static
+void hash_update(uri_hash_t *h, const char *data, size_t len) {
+  const U8 *p = (const U8*) data;
+  size_t fill;
+
+  h->total += len;
+
+  if (h->buflen > 0) {
+    fill = minnum(32 - h->buflen, len);
+    Copy(p, &h->buf[h->buflen], fill, U8);
+    h->buflen += fill;
+    p   += fill;
+    len -= fill;
+
+    if (h->buflen < 32) {
+      return;
+    }
+
+    hash_stripe(h, h->buf);
+    h->buflen = 0;
+  }
+
+  while (len >= 32) {
+    hash_stripe(h, p);
+    p   += 32;
+    len -= 32;
+  }
+
+  if (len > 0) {
+    Copy(p, h->buf, len, U8);
+    h->buflen = len;
+  }
+}
+
+static
+U64 hash_final(uri_hash_t *h) {
+  const U8 *p = h->buf;
+  size_t len = h->buflen;
+  U64 acc;
+
+  if (h->total >= 32) {
+    acc = URI_ROTL64(h->v[0], 1)  + URI_ROTL64(h->v[1], 7)
+        + URI_ROTL64(h->v[2], 12) + URI_ROTL64(h->v[3], 18);
+    acc = hash_merge(acc, h->v[0]);
+    acc = hash_merge(acc, h->v[1]);
+    acc = hash_merge(acc, h->v[2]);
+    acc = hash_merge(acc, h->v[3]);
+  }
+  else {
+    acc = URI_XXH_P5;
+  }
+
+  acc += h->total;
+
+  for (; len >= 8; p += 8, len -= 8) {
+    acc ^= hash_round(0, hash_read64(p));
+    acc  = URI_ROTL64(acc, 27) * URI_XXH_P1 + URI_XXH_P4;
+  }
+
+  if (len >= 4) {
+    acc ^= hash_read32(p) * URI_XXH_P1;
+    acc  = URI_ROTL64(acc, 23) * URI_XXH_P2 + URI_XXH_P3;
+    p   += 4;
+    len -= 4;
+  }
+
+  for (; len > 0; ++p, --len) {
+    acc ^= (*p) * URI_XXH_P5;
+    acc  = URI_ROTL64(acc, 11) * URI_XXH_P1;
+  }
+
+  acc ^= acc >> 33;
+  acc *= URI_XXH_P2;
+  acc ^= acc >> 29;
+  acc *= URI_XXH_P3;
+  acc ^= acc >> 32;
+
+  return acc;
+}
+
+/*
+ * Normalized bytes of a URI may be written to a hash, a string, or both at
+ * once. Either member may be NULL.
+ */
+typedef struct {
+  uri_hash_t *hash;
+  uri_str_t  *str;
+} uri_sink_t;
+
+static inline
+void sink_write(pTHX_ uri_sink_t *sink, const char *data, size_t len) {
+  if (sink->hash != NULL) hash_update(sink->hash, data, len);
+  if (sink->str  != NULL) str_append(aTHX_ sink->str, data, len);
+}
+
+// Writes the normalized form of a uri member to the sink.
+static
+void sink_member(pTHX_ uri_sink_t *sink, uri_str_t *str, const char *permitted, int lower, int allow_utf8) {
+  if (str->length == 0) {
+    return;
+  }
+
+  char buf[(str->length * 3) + 1];
+  size_t len = normalize_copy(str, buf, permitted, lower, allow_utf8, 0);
+  sink_write(aTHX_ sink, buf, len);
+}
+
+// Writes the normalized form of the uri's host to the sink, rewriting IPv6
+// addresses in canonical form as normalize() does.
+static
+void sink_host(pTHX_ uri_sink_t *sink, uri_t *uri) {
+  char buf[(uri->host->length * 3) + 1];
+  size_t len = normalize_copy(uri->host, buf, URI_CHARS_HOST, 1, uri->is_iri, 0);
+  size_t addr;
+  U8 ip[16];
+
+  if (len > 2 && buf[0] == '[' && buf[len - 1] == ']') {
+    addr = ipv6_addr_len(&buf[1], len - 2);
+
+    if (ipv6_parse(&buf[1], addr, ip)) {
+      char canon[48];
+      canon[0] = '[';
+      sink_write(aTHX_ sink, canon, 1 + ipv6_format(ip, &canon[1]));
+      sink_write(aTHX_ sink, &buf[1 + addr], len - 1 - addr);
+      return;
+    }
+  }
+
+  sink_write(aTHX_ sink, buf, len);
+}
+
+/*
+ * Writes the normalized string form of a uri_t to a sink without modifying
+ * it. The bytes written are exactly those which to_string() would produce
+ * after normalize().
+ */
+static
+void uri_write_normalized(pTHX_ uri_t *uri, uri_sink_t *sink) {
+  size_t i, len;
+  int has_auth = uri->usr->length > 0 || uri->host->length > 0;
+
+  if (uri->scheme->length > 0) {
+    char scheme[uri->scheme->length];
+
+    for (i = 0; i < uri->scheme->length; ++i) {
+      scheme[i] = toLOWER(uri->scheme->string[i]);
+    }
+
+    sink_write(aTHX_ sink, scheme, uri->scheme->length);
+    sink_write(aTHX_ sink, ":", 1);
+
+    if (has_auth) {
+      sink_write(aTHX_ sink, "//", 2);
+    }
+  }
+
+  if (has_auth) {
+    if (uri->usr->length > 0) {
+      sink_member(aTHX_ sink, uri->usr, URI_CHARS_USER, 0, uri->is_iri);
+
+      if (uri->pwd->length > 0) {
+        sink_write(aTHX_ sink, ":", 1);
+        sink_member(aTHX_ sink, uri->pwd, URI_CHARS_USER, 0, uri->is_iri);
+      }
+
+      sink_write(aTHX_ sink, "@", 1);
+    }
+
+    if (uri->host->length > 0) {
+      sink_host(aTHX_ sink, uri);
+
+      if (uri->port->length > 0) {
+        sink_write(aTHX_ sink, ":", 1);
+        sink_write(aTHX_ sink, uri->port->string, uri->port->length);
+      }
+    }
+  }
+
+  // The path is normalized before writing, since whether a slash must be added
+  // depends on its normalized form.
+  char path[(uri->path->length * 3) + 1];
+  len = normalize_copy(uri->path, path, URI_CHARS_PATH, 0, uri->is_iri, 1);
+
+  if (len == 0) {
+    // (6.2.3) empty path should be represented as "/" when authority is present
+    if (has_authority(aTHX_ uri)) {
+      sink_write(aTHX_ sink, "/", 1);
+    }
+  }
+  else {
+    if (has_auth && path[0] != '/') {
+      sink_write(aTHX_ sink, "/", 1);
+    }
+
+    sink_write(aTHX_ sink, path, len);
+  }
+
+  if (uri->query->length > 0) {
+    sink_write(aTHX_ sink, "?", 1);
+    sink_member(aTHX_ sink, uri->query, URI_CHARS_QUERY, 0, uri->is_iri);
+  }
+
+  if (uri->frag->length > 0) {
+    sink_write(aTHX_ sink, "#", 1);
+    sink_member(aTHX_ sink, uri->frag, URI_CHARS_FRAG, 0, uri->is_iri);
+  }
+}
+
+/*
+ * Computes the fingerprint of a uri_t by streaming its normalized form through
+ * the hash.
+ */
+static
+U64 uri_fingerprint(pTHX_ uri_t *uri) {
+  uri_hash_t h;
+  uri_sink_t sink = { &h, NULL };
+
+  hash_init(&h);
+  uri_write_normalized(aTHX_ uri, &sink);
+
+  return hash_final(&h);
+}
+
+// Returns a new SV holding a fingerprint. Perls without 64-bit integers get a
+// 16 digit hex string instead.
+static
+SV* fingerprint_sv(pTHX_ U64 fp) {
+#if UVSIZE >= 8
+  return newSVuv((UV) fp);
+#else
+  return newSVpvf("%08lx%08lx", (unsigned long) (fp >> 32), (unsigned long) (fp & 0xFFFFFFFF));
+#endif
+}
+
+/*
+ * Returns an array ref of fingerprints for an array ref of URI::Fast objects
+ * and/or URI strings. Strings are scanned into a single scratch uri_t which is
+ * reused for each, so no objects are built.
+ */
+static
+SV* fingerprint_many(pTHX_ SV *sv_uris) {
+  AV *uris, *out;
+  SV **refval, *sv_scratch;
+  uri_t *scratch;
+  SSize_t i, top;
+
+  if (!is_ref(aTHX_ sv_uris) || SvTYPE(SvRV(sv_uris)) != SVt_PVAV) {
+    croak("fingerprint_many: expected array ref");
+  }
+
+  // The scratch uri_t is owned by a mortal object, so it is released even if
+  // stringifying an input croaks.
+  sv_scratch = sv_2mortal(new(aTHX_ "URI::Fast", &PL_sv_undef, 0));
+  scratch = URI(sv_scratch);
+
+  uris = (AV*) SvRV(sv_uris);
+  top  = av_top_index(uris);
+  out  = newAV();
+  sv_2mortal((SV*) out);
+  av_extend(out, top);
+
+  for (i = 0; i <= top; ++i) {
+    refval = av_fetch(uris, i, 0);
+    uri_t *uri = uri_arg(aTHX_ refval == NULL ? &PL_sv_undef : *refval, scratch);
+    av_store(out, i, fingerprint_sv(aTHX_ uri_fingerprint(aTHX_ uri)));
+  }
+
+  return newRV_inc((SV*) out);
+}
+
+/*------------------------------------------------------------------------------
+ * URI sets
+ *
+ * An open-addressing hash set of normalized URI strings. Keys are stored back
+ * to back in a single arena; each slot holds only the key's fingerprint, which
+ * serves both as the hash and as a prefilter before keys are compared, and the
+ * key's offset and length within the arena.
+ *----------------------------------------------------------------------------*/
+#define URI_SET(obj) \
+  (((sv_isobject(obj) && sv_derived_from(obj, "URI::Fast::Set")) ? NULL : croak("error: expected instance of URI::Fast::Set")), \
+    ((uri_set_t*) SvIV(SvRV((obj)))))
+
+#define URI_SET_EMPTY     0
+#define URI_SET_USED      1
+#define URI_SET_TOMBSTONE 2
+
+#define URI_SET_MIN_CAPACITY 16
+
+typedef struct {
+  U64 fp;      // fingerprint of the key
+  U64 offset;  // offset of the key within the arena
+  U32 length;  // length of the key
+  U32 state;   // URI_SET_EMPTY, URI_SET_USED, or URI_SET_TOMBSTONE
+} uri_set_slot_t;
+
+typedef struct {
+  uri_set_slot_t *slots;
+  size_t capacity;     // number of slots; always a power of 2
+  size_t size;         // number of keys in the set
+  size_t tombstones;   // number of slots vacated by removed keys
+  uri_str_t *arena;    // key storage
+  size_t garbage;      // bytes in the arena belonging to removed keys
+  uri_str_t *key;      // scratch buffer for normalizing keys
+  uri_t *scratch;      // scratch uri_t for scanning string arguments
+} uri_set_t;
+
+static
+uri_set_t* set_new(pTHX_ size_t expected) {
+  uri_set_t *set;
+  size_t capacity = URI_SET_MIN_CAPACITY;
+
+  // Size the table to hold the expected number of keys below the max load
+  while (capacity * 3 < expected * 4) {
+    capacity <<= 1;
+  }
+
+  Newx(set, 1, uri_set_t);
+  Newxz(set->slots, capacity, uri_set_slot_t);
+
+  set->capacity   = capacity;
+  set->size       = 0;
+  set->tombstones = 0;
+  set->garbage    = 0;
+  set->arena      = str_new(aTHX_ 4096);
+  set->key        = str_new(aTHX_ 256);
+  set->scratch    = uri_alloc(aTHX_ 0);
+
+  return set;
+}
+
+static
+uri_set_t* set_copy(pTHX_ uri_set_t *from) {
+  uri_set_t *set;
+
+  Newx(set, 1, uri_set_t);
+  Newx(set->slots, from->capacity, uri_set_slot_t);
+  Copy(from->slots, set->slots, from->capacity, uri_set_slot_t);
+
+  set->capacity   = from->capacity;
+  set->size       = from->size;
+  set->tombstones = from->tombstones;
+  set->garbage    = from->garbage;
+  set->arena      = str_new(aTHX_ from->arena->length + 1);
+  set->key        = str_new(aTHX_ 256);
+  set->scratch    = uri_alloc(aTHX_ 0);
+  str_copy(aTHX_ from->arena, set->arena);
+
+  return set;
+}
+
+URI_DUP_VTBL(set, uri_set_t, set_copy)
+
+static
+void set_free(pTHX_ uri_set_t *set) {
+  Safefree(set->slots);
+  str_free(aTHX_ set->arena);
+  str_free(aTHX_ set->key);
+  uri_free(aTHX_ set->scratch);
+  Safefree(set);
+}
+
+// Returns the slot holding the key, or the slot in which the key should be
+// inserted if it is not present (the first tombstone encountered, if any).
+static
+uri_set_slot_t* set_probe(uri_set_t *set, U64 fp, const char *key, size_t len, int *found) {
+  size_t mask = set->capacity - 1;
+  size_t idx  = (size_t) fp & mask;
+  uri_set_slot_t *slot, *tomb = NULL;
+
+  *found = 0;
+
+  while (1) {
+    slot = &set->slots[idx];
+
+    if (slot->state == URI_SET_EMPTY) {
+      return tomb != NULL ? tomb : slot;
+    }
+
+    if (slot->state == URI_SET_TOMBSTONE) {
+      if (tomb == NULL) tomb = slot;
+    }
+    else if (slot->fp == fp
+          && slot->length == len
+          && memcmp(&set->arena->string[slot->offset], key, len) == 0)
+    {
+      *found = 1;
+      return slot;
+    }
+
+    idx = (idx + 1) & mask;
+  }
+}
+
+// Appends a key to the arena. The arena grows geometrically rather than by
+// str_append's fixed chunks, and is never shrunk to fit.
+static
+void set_arena_append(pTHX_ uri_str_t *arena, const char *key, size_t len) {
+  str_reserve(aTHX_ arena, arena->length + len);
+  Copy(key, &arena->string[arena->length], len, char);
+  arena->length += len;
+  arena->string[arena->length] = '\0';
+}
+
+// Rebuilds the table with the given capacity, dropping tombstones and
+// compacting the arena.
+static
+void set_rehash(pTHX_ uri_set_t *set, size_t capacity) {
+  uri_set_slot_t *old = set->slots;
+  size_t old_capacity = set->capacity;
+  uri_str_t *arena = set->arena;
+  uri_set_slot_t *slot;
+  size_t i, idx, mask = capacity - 1;
+
+  Newxz(set->slots, capacity, uri_set_slot_t);
+  set->capacity   = capacity;
+  set->tombstones = 0;
+
+  if (set->garbage > 0) {
+    set->arena = str_new(aTHX_ 4096);
+    str_grow(aTHX_ set->arena, arena->length - set->garbage);
+  }
+
+  for (i = 0; i < old_capacity; ++i) {
+    if (old[i].state != URI_SET_USED) continue;
+
+    idx = (size_t) old[i].fp & mask;
+    while (set->slots[idx].state != URI_SET_EMPTY) {
+      idx = (idx + 1) & mask;
+    }
+
+    slot  = &set->slots[idx];
+    *slot = old[i];
+
+    if (set->garbage > 0) {
+      slot->offset = set->arena->length;
+      set_arena_append(aTHX_ set->arena, &arena->string[ old[i].offset ], old[i].length);
+    }
+  }
+
+  if (set->garbage > 0) {
+    str_free(aTHX_ arena);
+    set->garbage = 0;
+  }
+
+  Safefree(old);
+}
+
+// Writes the normalized key for the argument to the set's key buffer and
+// returns its fingerprint.
+static
+U64 set_key(pTHX_ uri_set_t *set, SV *sv) {
+  uri_hash_t h;
+  uri_sink_t sink = { &h, set->key };
+  uri_t *uri = uri_arg(aTHX_ sv, set->scratch);
+
+  str_clear(aTHX_ set->key);
+  hash_init(&h);
+  uri_write_normalized(aTHX_ uri, &sink);
+
+  return hash_final(&h);
+}
+
+// Adds a URI to the set. Returns true if it was not already present.
+static
+int set_add(pTHX_ uri_set_t *set, SV *sv) {
+  uri_set_slot_t *slot;
+  int found;
+  U64 fp = set_key(aTHX_ set, sv);
+
+  if (set->key->length > U32_MAX) {
+    croak("URI::Fast::Set: key exceeds max length of %lu", (unsigned long) U32_MAX);
+  }
+
+  slot = set_probe(set, fp, str_get(set->key), set->key->length, &found);
+
+  if (found) {
+    return 0;
+  }
+
+  if (slot->state == URI_SET_TOMBSTONE) {
+    --set->tombstones;
+  }
+
+  slot->fp     = fp;
+  slot->offset = set->arena->length;
+  slot->length = set->key->length;
+  slot->state  = URI_SET_USED;
+  set_arena_append(aTHX_ set->arena, str_get(set->key), set->key->length);
+  ++set->size;
+
+  // Keep the load (including tombstones) under 3/4, growing when the keys
+  // themselves are the cause.
+  if ((set->size + set->tombstones) * 4 >= set->capacity * 3) {
+    set_rehash(aTHX_ set, set->size * 2 >= set->capacity ? set->capacity << 1 : set->capacity);
+  }
+
+  return 1;
+}
+
+// Returns true if the set contains the URI.
+static
+int set_contains(pTHX_ uri_set_t *set, SV *sv) {
+  int found;
+  U64 fp = set_key(aTHX_ set, sv);
+  set_probe(set, fp, str_get(set->key), set->key->length, &found);
+  return found;
+}
+
+// Removes a URI from the set. Returns true if it was present.
+static
+int set_remove(pTHX_ uri_set_t *set, SV *sv) {
+  uri_set_slot_t *slot;
+  int found;
+  U64 fp = set_key(aTHX_ set, sv);
+
+  slot = set_probe(set, fp, str_get(set->key), set->key->length, &found);
+
+  if (!found) {
+    return 0;
+  }
+
+  slot->state = URI_SET_TOMBSTONE;
+  set->garbage += slot->length;
+  --set->size;
+  ++set->tombstones;
+
+  // Reclaim the arena once removed keys account for more than half of it
+  if (set->garbage > 4096 && set->garbage * 2 > set->arena->length) {
+    set_rehash(aTHX_ set, set->capacity);
+  }
+
+  return 1;
+}
+
+// Returns the number of bytes allocated by the set.
+static
+size_t set_memory_usage(uri_set_t *set) {
+  return sizeof(uri_set_t)
+       + (set->capacity * sizeof(uri_set_slot_t))
+       + sizeof(uri_str_t) + set->arena->allocated
+       + sizeof(uri_str_t) + set->key->allocated;
+}
+
+/*------------------------------------------------------------------------------
+ * Bloom filters
+ *
+ * A blocked Bloom filter keyed by URI fingerprint. The bits for each key are
+ * confined to a single 512 bit (cache line sized) block, selected by the high
+ * word of the fingerprint, so each lookup touches a single line of memory.
+ *
+ * The serialized form is a 64 byte header followed by the bit array, which is
+ * stored as bytes so the file is independent of byte order:
+ *
+ *   0   magic     "URIFBLM\1"
+ *   8   bits      u64le
+ *   16  hashes    u32le
+ *   20  reserved  u32
+ *   24  count     u64le
+ *   32  reserved  (zero filled to 64 bytes)
+ *----------------------------------------------------------------------------*/
+#define URI_BLOOM(obj) \
+  (((sv_isobject(obj) && sv_derived_from(obj, "URI::Fast::Bloom")) ? NULL : croak("error: expected instance of URI::Fast::Bloom")), \
+    ((uri_bloom_t*) SvIV(SvRV((obj)))))
+
+#define URI_BLOOM_MAGIC       "URIFBLM\1"
+#define URI_BLOOM_HEADER      64
+#define URI_BLOOM_BLOCK_BITS  512
+#define URI_BLOOM_MAX_HASHES  32
+
+typedef struct {
+  U8    *bits;     // bit array
+  U64   nbits;     // size of the bit array; always a multiple of the block size
+  U64   nblocks;
+  U32   hashes;    // bits set per key
+  U64   count;     // number of keys which set at least one new bit
+  int   readonly;  // true when the bits are mapped from a file
+  void  *map;      // mapped file, if any
+  size_t map_len;
+  uri_t *scratch;  // scratch uri_t for scanning string arguments
+} uri_bloom_t;
+
+static inline
+void bloom_write64(U8 *p, U64 v) {
+  int i;
+  for (i = 0; i < 8; ++i) p[i] = (U8) (v >> (i * 8));
+}
+
+static
+uri_bloom_t* bloom_alloc(pTHX_ U64 nbits, U32 hashes) {
+  uri_bloom_t *bloom;
+
+  if (hashes < 1 || hashes > URI_BLOOM_MAX_HASHES) {
+    croak("URI::Fast::Bloom: hashes must be between 1 and %d", URI_BLOOM_MAX_HASHES);
+  }
+
+  // Round up to a whole number of blocks
+  if (nbits < URI_BLOOM_BLOCK_BITS) nbits = URI_BLOOM_BLOCK_BITS;
+  nbits = (nbits + URI_BLOOM_BLOCK_BITS - 1) / URI_BLOOM_BLOCK_BITS * URI_BLOOM_BLOCK_BITS;
+
+  if (nbits / 8 > (U64) (((size_t) -1) - URI_BLOOM_HEADER)) {
+    croak("URI::Fast::Bloom: too many bits");
+  }
+
+  Newxz(bloom, 1, uri_bloom_t);
+  bloom->nbits   = nbits;
+  bloom->nblocks = nbits / URI_BLOOM_BLOCK_BITS;
+  bloom->hashes  = hashes;
+  bloom->scratch = uri_alloc(aTHX_ 0);
+
+  return bloom;
+}
+
+static
+uri_bloom_t* bloom_new(pTHX_ U64 nbits, U32 hashes) {
+  uri_bloom_t *bloom = bloom_alloc(aTHX_ nbits, hashes);
+  Newxz(bloom->bits, bloom->nbits / 8, U8);
+  return bloom;
+}
+
+// Copies of mapped filters are read into memory, but remain read-only
+static
+uri_bloom_t* bloom_copy(pTHX_ uri_bloom_t *from) {
+  uri_bloom_t *bloom = bloom_alloc(aTHX_ from->nbits, from->hashes);
+
+  Newx(bloom->bits, bloom->nbits / 8, U8);
+  Copy(from->bits, bloom->bits, bloom->nbits / 8, U8);
+  bloom->count    = from->count;
+  bloom->readonly = from->readonly;
+
+  return bloom;
+}
+
+URI_DUP_VTBL(bloom, uri_bloom_t, bloom_copy)
+
+static
+void bloom_free(pTHX_ uri_bloom_t *bloom) {
+  if (bloom->map != NULL) {
+#ifdef URI_USE_MMAP
+    munmap(bloom->map, bloom->map_len);
+#else
+    Safefree(bloom->map);
+#endif
+  }
+  else {
+    Safefree(bloom->bits);
+  }
+
+  uri_free(aTHX_ bloom->scratch);
+  Safefree(bloom);
+}
+
+/*
+ * Sets (when set is true) or tests the bits for the fingerprint. Returns true
+ * if any of the bits were previously unset.
+ *
+ * The block is chosen by mapping the high word of the fingerprint onto the
+ * number of blocks; bit positions within the block are generated by double
+ * hashing from the low word and a remix of the whole fingerprint.
+ */
+static inline
+int bloom_apply(uri_bloom_t *bloom, U64 fp, int set) {
+  U64 block = ((fp >> 32) * bloom->nblocks) >> 32;
+  U8  *bits = &bloom->bits[ block * (URI_BLOOM_BLOCK_BITS / 8) ];
+  U32 h1    = (U32) fp;
+  U32 h2    = (U32) ((fp * URI_XXH_P2) >> 32) | 1;
+  U32 i, bit;
+  int missing = 0;
+
+  for (i = 0; i < bloom->hashes; ++i) {
+    bit = (h1 + i * h2) & (URI_BLOOM_BLOCK_BITS - 1);
+
+    if (!(bits[bit >> 3] & (1 << (bit & 7)))) {
+      missing = 1;
+      if (!set) break;
+      bits[bit >> 3] |= (U8) (1 << (bit & 7));
+    }
+  }
+
+  return missing;
+}
+
+static
+U64 bloom_key(pTHX_ uri_bloom_t *bloom, SV *sv) {
+  return uri_fingerprint(aTHX_ uri_arg(aTHX_ sv, bloom->scratch));
+}
+
+// Adds a URI. Returns true if the URI was definitely not already present.
+static
+int bloom_add(pTHX_ uri_bloom_t *bloom, SV *sv) {
+  if (bloom->readonly) {
+    croak("URI::Fast::Bloom: filter is read-only");
+  }
+
+  if (bloom_apply(bloom, bloom_key(aTHX_ bloom, sv), 1)) {
+    ++bloom->count;
+    return 1;
+  }
+
+  return 0;
+}
+
+static
+int bloom_maybe_contains(pTHX_ uri_bloom_t *bloom, SV *sv) {
+  return !bloom_apply(bloom, bloom_key(aTHX_ bloom, sv), 0);
+}
+
+static
+AV* bloom_array_arg(pTHX_ SV *sv, const char *func) {
+  if (!is_ref(aTHX_ sv) || SvTYPE(SvRV(sv)) != SVt_PVAV) {
+    croak("URI::Fast::Bloom::%s: expected array ref", func);
+  }
+
+  return (AV*) SvRV(sv);
+}
+
+// Adds each URI in the array. Returns the number which were definitely not
+// already present.
+static
+UV bloom_add_many(pTHX_ uri_bloom_t *bloom, SV *sv_uris) {
+  AV *uris = bloom_array_arg(aTHX_ sv_uris, "add_many");
+  SSize_t i, top = av_top_index(uris);
+  SV **refval;
+  UV added = 0;
+
+  for (i = 0; i <= top; ++i) {
+    refval = av_fetch(uris, i, 0);
+    added += bloom_add(aTHX_ bloom, refval == NULL ? &PL_sv_undef : *refval);
+  }
+
+  return added;
+}
+
+// Returns an array ref of booleans, one for each URI in the array.
+static
+SV* bloom_maybe_contains_many(pTHX_ uri_bloom_t *bloom, SV *sv_uris) {
+  AV *uris = bloom_array_arg(aTHX_ sv_uris, "maybe_contains_many");
+  SSize_t i, top = av_top_index(uris);
+  SV **refval;
+  AV *out = newAV();
+
+  sv_2mortal((SV*) out);
+  av_extend(out, top);
+
+  for (i = 0; i <= top; ++i) {
+    refval = av_fetch(uris, i, 0);
+    av_store(out, i, boolSV(bloom_maybe_contains(aTHX_ bloom, refval == NULL ? &PL_sv_undef : *refval)));
+  }
+
+  return newRV_inc((SV*) out);
+}
+
+static
+void bloom_save(pTHX_ uri_bloom_t *bloom, const char *path) {
+  U8 header[URI_BLOOM_HEADER];
+  PerlIO *fh;
+  SSize_t len = (SSize_t) (bloom->nbits / 8);
+
+  Zero(header, URI_BLOOM_HEADER, U8);
+  Copy(URI_BLOOM_MAGIC, header, 8, U8);
+  bloom_write64(&header[8], bloom->nbits);
+  bloom_write64(&header[16], bloom->hashes); // u32 followed by reserved zeroes
+  bloom_write64(&header[24], bloom->count);
+
+  fh = PerlIO_open(path, "wb");
+
+  if (fh == NULL) {
+    croak("URI::Fast::Bloom::save: unable to open %s: %s", path, Strerror(errno));
+  }
+
+  if (PerlIO_write(fh, header, URI_BLOOM_HEADER) != URI_BLOOM_HEADER
+   || PerlIO_write(fh, bloom->bits, len) != len)
+  {
+    PerlIO_close(fh);
+    croak("URI::Fast::Bloom::save: error writing %s: %s", path, Strerror(errno));
+  }
+
+  if (PerlIO_close(fh) != 0) {
+    croak("URI::Fast::Bloom::save: error writing %s: %s", path, Strerror(errno));
+  }
+}
+
+/*
+ * Loads a filter saved with bloom_save. Where mmap is available, the file is
+ * mapped read-only and shared, so that any number of processes may load the
+ * same filter without copying it. Otherwise, the file is read into memory.
+ * Either way, the loaded filter is read-only.
+ */
+static
+uri_bloom_t* bloom_load(pTHX_ const char *path) {
+  uri_bloom_t *bloom;
+  Stat_t st;
+  U8 *map;
+  U64 nbits;
+  U32 hashes;
+  size_t map_len;
+  int fd;
+
+  fd = PerlLIO_open(path, O_RDONLY);
+
+  if (fd < 0) {
+    croak("URI::Fast::Bloom::load: unable to open %s: %s", path, Strerror(errno));
+  }
+
+  if (PerlLIO_fstat(fd, &st) != 0) {
+    PerlLIO_close(fd);
+    croak("URI::Fast::Bloom::load: unable to stat %s: %s", path, Strerror(errno));
+  }
+
+  map_len = (size_t) st.st_size;
+
+  if (map_len < URI_BLOOM_HEADER) {
+    PerlLIO_close(fd);
+    croak("URI::Fast::Bloom::load: %s is not a bloom filter", path);
+  }
+
+#ifdef URI_USE_MMAP
+  map = (U8*) mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+  PerlLIO_close(fd);
+
+  if ((void*) map == MAP_FAILED) {
+    croak("URI::Fast::Bloom::load: unable to map %s: %s", path, Strerror(errno));
+  }
+#else
+  {
+    size_t got = 0;
+    SSize_t n;
+
+    Newx(map, map_len, U8);
+
+    while (got < map_len) {
+      n = PerlLIO_read(fd, &map[got], map_len - got);
+      if (n <= 0) break;
+      got += n;
+    }
+
+    PerlLIO_close(fd);
+
+    if (got != map_len) {
+      Safefree(map);
+      croak("URI::Fast::Bloom::load: error reading %s", path);
+    }
+  }
+#endif
+
+  nbits  = hash_read64(&map[8]);
+  hashes = hash_read32(&map[16]);
+
+  if (memcmp(map, URI_BLOOM_MAGIC, 8) != 0
+   || nbits == 0
+   || nbits % URI_BLOOM_BLOCK_BITS != 0
+   || hashes < 1
+   || hashes > URI_BLOOM_MAX_HASHES
+   || nbits / 8 != (U64) (map_len - URI_BLOOM_HEADER))
+  {
+#ifdef URI_USE_MMAP
+    munmap(map, map_len);
+#else
+    Safefree(map);
+#endif
+    croak("URI::Fast::Bloom::load: %s is not a bloom filter", path);
+  }
+
+  bloom = bloom_alloc(aTHX_ nbits, hashes);
+  bloom->count    = hash_read64(&map[24]);
+  bloom->bits     = &map[URI_BLOOM_HEADER];
+  bloom->readonly = 1;
+  bloom->map      = map;
+  bloom->map_len  = map_len;
+
+  return bloom;
+}
+
+/*------------------------------------------------------------------------------
+ * Public suffixes
+ *
+ * Rules from the Public Suffix List are stored as a trie of reversed labels
+ * (e.g. "co.uk" is stored as "uk" -> "co"). Rather than storing a child list
+ * for each node, edges are kept in a single open-addressed table keyed on the
+ * parent node and label, so that each step down the trie is a single probe.
+ * Labels are stored lower cased; hosts are lower cased as they are compared.
+ *----------------------------------------------------------------------------*/
+#define URI_PSL_RULE      1  // a rule ends at this node
+#define URI_PSL_EXCEPTION 2  // an exception rule ends at this node
+
+typedef struct {
+  U32 parent;
+  U32 label;    // offset of the label within the arena
+  U32 length;   // length of the label
+  U32 flags;
+} uri_psl_node_t;
+
+typedef struct {
+  uri_psl_node_t *nodes;  // node 0 is the root
+  size_t nnodes;
+  size_t nodes_allocated;
+  U32 *table;             // node index for each slot; 0 when empty
+  size_t capacity;        // always a power of 2
+  uri_str_t *labels;      // label storage
+} uri_psl_t;
+
+// The loaded list is per interpreter; each new thread receives its own copy
+#define MY_CXT_KEY "URI::Fast::_guts" XS_VERSION
+
+typedef struct {
+  uri_psl_t *psl;
+} my_cxt_t;
+
+START_MY_CXT
+
+static inline
+U64 psl_hash(U32 parent, const char *label, size_t len) {
+  U64 h = URI_XXH_P5 ^ ((U64) parent * URI_XXH_P1);
+  size_t i;
+
+  for (i = 0; i < len; ++i) {
+    h = (h ^ (U8) toLOWER(label[i])) * URI_XXH_P3;
+  }
+
+  return h ^ (h >> 29);
+}
+
+static inline
+int psl_label_eq(uri_psl_t *psl, uri_psl_node_t *node, const char *label, size_t len) {
+  const char *stored = &psl->labels->string[node->label];
+  size_t i;
+
+  if (node->length != len) return 0;
+
+  for (i = 0; i < len; ++i) {
+    if (stored[i] != toLOWER(label[i])) return 0;
+  }
+
+  return 1;
+}
+
+// Returns the index of the child of parent with the given label, or 0.
+static
+U32 psl_child(uri_psl_t *psl, U32 parent, const char *label, size_t len) {
+  size_t mask = psl->capacity - 1;
+  size_t idx  = psl_hash(parent, label, len) & mask;
+  uri_psl_node_t *node;
+
+  while (psl->table[idx] != 0) {
+    node = &psl->nodes[ psl->table[idx] ];
+
+    if (node->parent == parent && psl_label_eq(psl, node, label, len)) {
+      return psl->table[idx];
+    }
+
+    idx = (idx + 1) & mask;
+  }
+
+  return 0;
+}
+
+static
+void psl_free(pTHX_ uri_psl_t *psl) {
+  Safefree(psl->nodes);
+  Safefree(psl->table);
+  str_free(aTHX_ psl->labels);
+  Safefree(psl);
+}
+
+static
+uri_psl_t* psl_copy(pTHX_ uri_psl_t *from) {
+  uri_psl_t *psl;
+
+  Newx(psl, 1, uri_psl_t);
+  Newx(psl->nodes, from->nodes_allocated, uri_psl_node_t);
+  Copy(from->nodes, psl->nodes, from->nnodes, uri_psl_node_t);
+  Newx(psl->table, from->capacity, U32);
+  Copy(from->table, psl->table, from->capacity, U32);
+
+  psl->nnodes          = from->nnodes;
+  psl->nodes_allocated = from->nodes_allocated;
+  psl->capacity        = from->capacity;
+  psl->labels          = str_new(aTHX_ from->labels->length + 1);
+  str_copy(aTHX_ from->labels, psl->labels);
+
+  return psl;
+}
+
+// Frees the interpreter's list when the interpreter is destroyed. Registered
+// with call_atexit for the main interpreter and for each thread.
+static
+void psl_teardown(pTHX_ void *unused) {
+  dMY_CXT;
+  PERL_UNUSED_ARG(unused);
+
+  if (MY_CXT.psl != NULL) {
+    psl_free(aTHX_ MY_CXT.psl);
+    MY_CXT.psl = NULL;
+  }
+}
+
+static
+void psl_grow_table(pTHX_ uri_psl_t *psl) {
+  U32 *old = psl->table;
+  size_t old_capacity = psl->capacity;
+  size_t i, idx, mask;
+  uri_psl_node_t *node;
+
+  psl->capacity = old_capacity == 0 ? 1024 : old_capacity << 1;
+  mask = psl->capacity - 1;
+  Newxz(psl->table, psl->capacity, U32);
+
+  for (i = 0; i < old_capacity; ++i) {
+    if (old[i] == 0) continue;
+
+    node = &psl->nodes[ old[i] ];
+    idx  = psl_hash(node->parent, &psl->labels->string[node->label], node->length) & mask;
+
+    while (psl->table[idx] != 0) {
+      idx = (idx + 1) & mask;
+    }
+
+    psl->table[idx] = old[i];
+  }
+
+  Safefree(old);
+}
+
+// Returns the child of parent with the given label, creating it if necessary.
+static
+U32 psl_insert(pTHX_ uri_psl_t *psl, U32 parent, const char *label, size_t len) {
+  U32 child = psl_child(psl, parent, label, len);
+  uri_psl_node_t *node;
+  size_t i, idx;
+
+  if (child != 0) {
+    return child;
+  }
+
+  if ((psl->nnodes + 1) * 4 >= psl->capacity * 3) {
+    psl_grow_table(aTHX_ psl);
+  }
+
+  if (psl->nnodes == psl->nodes_allocated) {
+    psl->nodes_allocated *= 2;
+    Renew(psl->nodes, psl->nodes_allocated, uri_psl_node_t);
+  }
+
+  child = psl->nnodes++;
+  node  = &psl->nodes[child];
+  node->parent = parent;
+  node->label  = psl->labels->length;
+  node->length = len;
+  node->flags  = 0;
+
+  for (i = 0; i < len; ++i) {
+    char c = toLOWER(label[i]);
+    str_append(aTHX_ psl->labels, &c, 1);
+  }
+
+  idx = psl_hash(parent, label, len) & (psl->capacity - 1);
+
+  while (psl->table[idx] != 0) {
+    idx = (idx + 1) & (psl->capacity - 1);
+  }
+
+  psl->table[idx] = child;
+
+  return child;
+}
+
+/*
+ * Builds a trie from the contents of a Public Suffix List file. Per the list's
+ * format, each line holds a single rule, terminated by white space; lines
+ * beginning with "//" are comments.
+ */
+static
+uri_psl_t* psl_build(pTHX_ const char *src, size_t len) {
+  uri_psl_t *psl;
+  size_t pos = 0, end, rule, label, flags;
+  U32 node;
+
+  Newxz(psl, 1, uri_psl_t);
+  psl->nodes_allocated = 1024;
+  psl->nnodes = 1; // root
+  Newxz(psl->nodes, psl->nodes_allocated, uri_psl_node_t);
+  psl->labels = str_new(aTHX_ 4096);
+  psl_grow_table(aTHX_ psl);
+
+  while (pos < len) {
+    // Find the extent of the rule on this line
+    end = pos + strncspn(&src[pos], len - pos, " \t\r\n");
+
+    if (end > pos && !(end - pos >= 2 && src[pos] == '/' && src[pos + 1] == '/')) {
+      rule  = pos;
+      flags = URI_PSL_RULE;
+
+      if (src[rule] == '!') {
+        flags = URI_PSL_EXCEPTION;
+        ++rule;
+      }
+
+      // Insert each label from right to left
+      node  = 0;
+      label = end;
+
+      while (label > rule) {
+        size_t label_end = label;
+
+        while (label > rule && src[label - 1] != '.') {
+          --label;
+        }
+
+        if (label_end > label) {
+          node = psl_insert(aTHX_ psl, node, &src[label], label_end - label);
+        }
+
+        if (label > rule) --label; // skip the dot
+      }
+
+      if (node != 0) {
+        psl->nodes[node].flags |= flags;
+      }
+    }
+
+    // Skip to the next line
+    while (end < len && src[end] != '\n') ++end;
+    pos = end + 1;
+  }
+
+  return psl;
+}
+
+static
+void load_public_suffix_list(pTHX_ SV *sv_list) {
+  size_t len;
+  const char *src = SvPV_const(sv_list, len);
+  uri_psl_t *psl = psl_build(aTHX_ src, len);
+  dMY_CXT;
+
+  if (MY_CXT.psl != NULL) {
+    psl_free(aTHX_ MY_CXT.psl);
+  }
+
+  MY_CXT.psl = psl;
+}
+
+/*
+ * Applies the Public Suffix List algorithm to a host name. Returns false if
+ * the host cannot have a public suffix (e.g. it is an IP address or contains
+ * empty labels). Otherwise, sets suffix to the offset of the public suffix
+ * within the host and domain to the offset of the registrable domain, or -1
+ * if the host is itself a public suffix. Any trailing dot is excluded from
+ * both.
+ */
+static
+int psl_match(uri_psl_t *psl, const char *host, size_t len, SSize_t *suffix, SSize_t *domain) {
+  U32 node = 0, child, wildcard;
+  size_t end, start, labels = 0, matched = 1, i;
+
+  if (len > 0 && host[len - 1] == '.') --len;
+  if (len == 0 || host[0] == '[' || host[0] == '.' || host[len - 1] == '.') return 0;
+
+  // No top level domain is all digits, so this excludes IPv4 addresses
+  for (i = len; i > 0 && host[i - 1] != '.'; --i) {
+    if (!isDIGIT(host[i - 1])) break;
+  }
+
+  if (i == 0 || host[i - 1] == '.') return 0;
+
+  // Walk the trie from the rightmost label, tracking the number of labels in
+  // the prevailing rule. With no matching rule, the implicit rule "*" applies.
+  end = len;
+
+  while (end > 0) {
+    start = end;
+    while (start > 0 && host[start - 1] != '.') --start;
+    if (start == end) return 0;
+
+    ++labels;
+
+    wildcard = psl_child(psl, node, "*", 1);
+    if (wildcard != 0 && (psl->nodes[wildcard].flags & URI_PSL_RULE)) {
+      matched = labels;
+    }
+
+    child = psl_child(psl, node, &host[start], end - start);
+    if (child == 0) break;
+
+    if (psl->nodes[child].flags & URI_PSL_EXCEPTION) {
+      matched = labels - 1;
+      break;
+    }
+
+    if (psl->nodes[child].flags & URI_PSL_RULE) {
+      matched = labels;
+    }
+
+    node = child;
+    end  = start == 0 ? 0 : start - 1;
+  }
+
+  // Validate the remaining labels and locate the offsets of the suffix and
+  // the label preceding it
+  *suffix = -1;
+  *domain = -1;
+  labels  = 0;
+  end     = len;
+
+  while (end > 0) {
+    start = end;
+    while (start > 0 && host[start - 1] != '.') --start;
+    if (start == end) return 0;
+
+    ++labels;
+
+    if (labels == matched)     *suffix = start;
+    if (labels == matched + 1) *domain = start;
+
+    end = start == 0 ? 0 : start - 1;
+  }
+
+  return *suffix >= 0;
+}
+
+/*
+ * Returns the public suffix of the uri's host (if which is 0) or its
+ * registrable domain (if which is 1), or undef. The result is taken directly
+ * from the host buffer, which is only copied when it must be decoded.
+ */
+static
+SV* get_public_suffix(pTHX_ SV *sv_uri, int which) {
+  uri_t *uri = URI(sv_uri);
+  uri_str_t *str = uri->host;
+  const char *host = str->string;
+  size_t len = str->length, i;
+  SSize_t suffix, domain, off;
+  int encoded;
+  SV *out;
+  dMY_CXT;
+
+  if (MY_CXT.psl == NULL) {
+    croak("%s: no public suffix list loaded (see load_public_suffix_list)",
+      which ? "registrable_domain" : "public_suffix");
+  }
+
+  if (len == 0) {
+    return newSV(0);
+  }
+
+  encoded = memchr(host, '%', len) != NULL;
+  char decoded[ encoded ? len + 1 : 1 ];
+
+  if (encoded) {
+    len  = uri_decode_utf8(host, len, decoded);
+    host = decoded;
+  }
+
+  if (!psl_match(MY_CXT.psl, host, len, &suffix, &domain)) {
+    return newSV(0);
+  }
+
+  off = which ? domain : suffix;
+
+  if (off < 0) {
+    return newSV(0);
+  }
+
+  if (host[len - 1] == '.') --len;
+
+  out = newSVpvn(&host[off], len - off);
+
+  for (i = off; i < len; ++i) {
+    if ((U8) host[i] > 127) {
+      sv_utf8_decode(out);
+      break;
+    }
+  }
+
+  return out;
+}
+
+/*------------------------------------------------------------------------------
+ * Reversed hosts and sorting
+ *----------------------------------------------------------------------------*/
+
+/*
+ * Writes the labels of a host in reverse order (e.g. "www.example.com" becomes
+ * "com.example.www") to out, which must have room for len bytes, lower casing
+ * them if requested. Any trailing dot is dropped. IP addresses are copied in
+ * their original order. Returns the length of the output.
+ */
+static
+size_t host_reverse(uri_t *uri, const char *host, size_t len, char *out, int lower) {
+  size_t end, start, pos = 0, i;
+  U8 type = uri_classified(uri)->host_type;
+
+  if (type != URI_HOST_REGNAME) {
+    for (i = 0; i < len; ++i) {
+      out[i] = lower ? toLOWER(host[i]) : host[i];
+    }
+
+    return len;
+  }
+
+  if (len > 0 && host[len - 1] == '.') --len;
+
+  for (end = len; end > 0; end = start - 1) {
+    start = end;
+    while (start > 0 && host[start - 1] != '.') --start;
+
+    for (i = start; i < end; ++i) {
+      out[pos++] = lower ? toLOWER(host[i]) : host[i];
+    }
+
+    if (start == 0) break;
+    out[pos++] = '.';
+  }
+
+  return pos;
+}
+
+static
+SV* get_reversed_host(pTHX_ SV *sv_uri) {
+  uri_t *uri = URI(sv_uri);
+  uri_str_t *str = uri->host;
+  const char *host = str->string;
+  size_t len = str->length;
+  int encoded;
+  SV *out;
+
+  if (len == 0) {
+    return newSVpvn("", 0);
+  }
+
+  encoded = memchr(host, '%', len) != NULL;
+  char decoded[ encoded ? len + 1 : 1 ];
+
+  if (encoded) {
+    len  = uri_decode_utf8(host, len, decoded);
+    host = decoded;
+  }
+
+  out = newSV(len + 1);
+  SvPOK_only(out);
+  SvCUR_set(out, host_reverse(uri, host, len, SvPVX(out), 0));
+  *SvEND(out) = '\0';
+  sv_utf8_decode(out);
+
+  return out;
+}
+
+// Components which may be used to build sort keys
+#define URI_SORT_SCHEME        1
+#define URI_SORT_USR           2
+#define URI_SORT_PWD           3
+#define URI_SORT_HOST          4
+#define URI_SORT_HOST_REVERSED 5
+#define URI_SORT_PORT          6
+#define URI_SORT_PATH          7
+#define URI_SORT_QUERY         8
+#define URI_SORT_FRAG          9
+#define URI_SORT_MAX_FIELDS    16
+
+typedef struct {
+  U64    prefix;  // first 8 bytes of the key, big endian, zero padded
+  size_t offset;  // offset of the key in the arena
+  size_t length;  // length of the key
+  SSize_t idx;    // index of the item in the input array
+} uri_sort_item_t;
+
+// Parses a comma separated list of components into fields. Returns the number
+// of fields.
+static
+int sort_fields(pTHX_ const char *by, U8 *fields) {
+  static const struct { const char *name; U8 field; } names[] = {
+    {"scheme", URI_SORT_SCHEME}, {"usr", URI_SORT_USR}, {"pwd", URI_SORT_PWD},
+    {"host", URI_SORT_HOST}, {"host_reversed", URI_SORT_HOST_REVERSED},
+    {"port", URI_SORT_PORT}, {"path", URI_SORT_PATH}, {"query", URI_SORT_QUERY},
+    {"frag", URI_SORT_FRAG}, {"fragment", URI_SORT_FRAG},
+  };
+
+  size_t len = strlen(by), pos = 0, brk, i;
+  int count = 0;
+
+  while (pos < len) {
+    while (pos < len && isSPACE(by[pos])) ++pos;
+    brk = strncspn(&by[pos], len - pos, ", ");
+
+    if (brk > 0) {
+      for (i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (strlen(names[i].name) == brk && strnEQ(names[i].name, &by[pos], brk)) break;
+      }
+
+      if (i == sizeof(names) / sizeof(names[0])) {
+        croak("sort_uris: unknown sort field '%.*s'", (int) brk, &by[pos]);
+      }
+
+      if (count == URI_SORT_MAX_FIELDS) {
+        croak("sort_uris: too many sort fields");
+      }
+
+      fields[count++] = names[i].field;
+    }
+
+    pos += brk;
+    while (pos < len && (isSPACE(by[pos]) || by[pos] == ',')) ++pos;
+  }
+
+  if (count == 0) {
+    croak("sort_uris: no sort fields specified");
+  }
+
+  return count;
+}
+
+/*
+ * Appends the sort key for a uri to the arena. Each component is written as
+ * its raw bytes, followed by a nul separator, so that comparing keys as byte
+ * strings compares components in order. Scheme and host names are lower
+ * cased, and numeric ports are zero padded to sort numerically.
+ */
+static
+void sort_key(pTHX_ uri_t *uri, const U8 *fields, int nfields, uri_str_t *arena) {
+  uri_str_t *str;
+  size_t i, len;
+  int f;
+
+  for (f = 0; f < nfields; ++f) {
+    if (f > 0) str_append(aTHX_ arena, "\0", 1);
+
+    switch (fields[f]) {
+      case URI_SORT_SCHEME: str = uri->scheme; break;
+      case URI_SORT_USR:    str = uri->usr;    break;
+      case URI_SORT_PWD:    str = uri->pwd;    break;
+      case URI_SORT_PATH:   str = uri->path;   break;
+      case URI_SORT_QUERY:  str = uri->query;  break;
+      case URI_SORT_FRAG:   str = uri->frag;   break;
+
+      case URI_SORT_HOST:
+      case URI_SORT_HOST_REVERSED:
+        str = uri->host;
+        str_grow(aTHX_ arena, arena->length + str->length);
+
+        if (fields[f] == URI_SORT_HOST_REVERSED) {
+          arena->length += host_reverse(uri, str->string, str->length, &arena->string[arena->length], 1);
+        }
+        else {
+          for (i = 0; i < str->length; ++i) {
+            arena->string[arena->length++] = toLOWER(str->string[i]);
+          }
+        }
+
+        continue;
+
+      case URI_SORT_PORT:
+        if (uri_classified(uri)->port_num >= 0) {
+          char port[12];
+          len = snprintf(port, sizeof(port), "%05d", (int) uri->port_num);
+          str_append(aTHX_ arena, port, len);
+          continue;
+        }
+
+        str = uri->port;
+        break;
+
+      default:
+        continue;
+    }
+
+    if (fields[f] == URI_SORT_SCHEME) {
+      str_grow(aTHX_ arena, arena->length + str->length);
+      for (i = 0; i < str->length; ++i) {
+        arena->string[arena->length++] = toLOWER(str->string[i]);
+      }
+    }
+    else if (str->length > 0) {
+      str_append(aTHX_ arena, str->string, str->length);
+    }
+  }
+}
+
+static inline
+int sort_cmp(const uri_sort_item_t *a, const uri_sort_item_t *b, const char *arena) {
+  size_t len;
+  int cmp;
+
+  if (a->prefix != b->prefix) {
+    return a->prefix < b->prefix ? -1 : 1;
+  }
+
+  // Prefixes match, so the first 8 bytes (or the whole of the shorter key) are
+  // equal
+  if (a->length > 8 && b->length > 8) {
+    len = (a->length < b->length ? a->length : b->length) - 8;
+    cmp = memcmp(&arena[a->offset + 8], &arena[b->offset + 8], len);
+    if (cmp != 0) return cmp;
+  }
+
+  if (a->length != b->length) {
+    return a->length < b->length ? -1 : 1;
+  }
+
+  // Equal keys retain their original order
+  return a->idx < b->idx ? -1 : a->idx > b->idx ? 1 : 0;
+}
+
+/*
+ * Sorts items with a quicksort using a median of three pivot, switching to
+ * insertion sort for small partitions. Recursion is limited to the smaller
+ * partition, and to a depth proportional to log(n), after which the items are
+ * heap sorted to avoid quadratic behavior.
+ */
+static
+void sort_heapify(uri_sort_item_t *items, size_t n, size_t root, const char *arena) {
+  uri_sort_item_t tmp;
+  size_t child;
+
+  while ((child = root * 2 + 1) < n) {
+    if (child + 1 < n && sort_cmp(&items[child], &items[child + 1], arena) < 0) ++child;
+    if (sort_cmp(&items[root], &items[child], arena) >= 0) return;
+
+    tmp = items[root]; items[root] = items[child]; items[child] = tmp;
+    root = child;
+  }
+}
+
+static
+void sort_items(uri_sort_item_t *items, size_t n, const char *arena, int depth) {
+  uri_sort_item_t tmp, pivot;
+  size_t i, j, mid;
+
+  while (n > 16) {
+    if (depth-- == 0) {
+      for (i = n / 2; i > 0; --i) sort_heapify(items, n, i - 1, arena);
+      for (i = n - 1; i > 0; --i) {
+        tmp = items[0]; items[0] = items[i]; items[i] = tmp;
+        sort_heapify(items, i, 0, arena);
+      }
+      return;
+    }
+
+    // Median of three, leaving the pivot in the middle
+    mid = n / 2;
+    if (sort_cmp(&items[mid], &items[0], arena) < 0)     { tmp = items[mid]; items[mid] = items[0]; items[0] = tmp; }
+    if (sort_cmp(&items[n - 1], &items[mid], arena) < 0) { tmp = items[mid]; items[mid] = items[n - 1]; items[n - 1] = tmp; }
+    if (sort_cmp(&items[mid], &items[0], arena) < 0)     { tmp = items[mid]; items[mid] = items[0]; items[0] = tmp; }
+
+    pivot = items[mid];
+    i = 0;
+    j = n - 1;
+
+    // Hoare partition
+    while (1) {
+      while (sort_cmp(&items[i], &pivot, arena) < 0) ++i;
+      while (sort_cmp(&pivot, &items[j], arena) < 0) --j;
+      if (i >= j) break;
+      tmp = items[i]; items[i] = items[j]; items[j] = tmp;
+      ++i;
+      --j;
+    }
+
+    // Recurse into the smaller partition, loop on the larger
+    if (j + 1 < n - j - 1) {
+      sort_items(items, j + 1, arena, depth);
+      items += j + 1;
+      n -= j + 1;
+    }
+    else {
+      sort_items(&items[j + 1], n - j - 1, arena, depth);
+      n = j + 1;
+    }
+  }
+
+  for (i = 1; i < n; ++i) {
+    tmp = items[i];
+    for (j = i; j > 0 && sort_cmp(&tmp, &items[j - 1], arena) < 0; --j) {
+      items[j] = items[j - 1];
+    }
+    items[j] = tmp;
+  }
+}
+
+/*
+ * Returns a new array ref holding the items of the input array (URI::Fast
+ * objects and/or URI strings), sorted by the components named in by.
+ */
+static
+SV* sort_uris(pTHX_ SV *sv_uris, const char *by) {
+  AV *uris, *out;
+  SV **refval, *sv_scratch;
+  uri_t *scratch;
+  uri_str_t *arena;
+  uri_sort_item_t *items;
+  U8 fields[URI_SORT_MAX_FIELDS];
+  int nfields = sort_fields(aTHX_ by, fields), depth = 0;
+  SSize_t i, top;
+  size_t n, b;
+
+  if (!is_ref(aTHX_ sv_uris) || SvTYPE(SvRV(sv_uris)) != SVt_PVAV) {
+    croak("sort_uris: expected array ref");
+  }
+
+  uris = (AV*) SvRV(sv_uris);
+  top  = av_top_index(uris);
+  n    = top + 1;
+
+  // The scratch uri_t is owned by a mortal object, so it is released even if
+  // stringifying an input croaks.
+  sv_scratch = sv_2mortal(new(aTHX_ "URI::Fast", &PL_sv_undef, 0));
+  scratch = URI(sv_scratch);
+
+  // The arena and items are released when this scope is left, whether or not
+  // an input croaks
+  ENTER;
+  arena = str_new(aTHX_ n * 32 + 64);
+  SAVEDESTRUCTOR_X(str_free_ptr, arena);
+  Newx(items, n > 0 ? n : 1, uri_sort_item_t);
+  SAVEFREEPV(items);
+
+  for (i = 0; i <= top; ++i) {
+    refval = av_fetch(uris, i, 0);
+    uri_t *uri = uri_arg(aTHX_ refval == NULL ? &PL_sv_undef : *refval, scratch);
+
+    items[i].idx    = i;
+    items[i].offset = arena->length;
+    sort_key(aTHX_ uri, fields, nfields, arena);
+    items[i].length = arena->length - items[i].offset;
+  }
+
+  // Prefixes are computed once the arena has stopped moving
+  for (i = 0; i <= top; ++i) {
+    const U8 *key = (const U8*) &arena->string[ items[i].offset ];
+    U64 prefix = 0;
+
+    for (b = 0; b < 8; ++b) {
+      prefix = (prefix << 8) | (b < items[i].length ? key[b] : 0);
+    }
+
+    items[i].prefix = prefix;
+  }
+
+  for (b = n; b > 1; b >>= 1) depth += 2;
+  sort_items(items, n, arena->string, depth);
+
+  out = newAV();
+  sv_2mortal((SV*) out);
+  av_extend(out, top);
+
+  for (i = 0; i <= top; ++i) {
+    refval = av_fetch(uris, items[i].idx, 0);
+    av_store(out, i, refval == NULL ? newSV(0) : newSVsv(*refval));
+  }
+
+  LEAVE;
+
+  return newRV_inc((SV*) out);
+}
+
+/*------------------------------------------------------------------------------
+ * Readers
+ *
+ * Reads newline-delimited URIs from a file, which is mapped into memory when
+ * possible, or from a file handle, which is read in large blocks. Each line is
+ * scanned directly from the map or block buffer into a single, reused object.
+ *----------------------------------------------------------------------------*/
+#define URI_READER(obj) \
+  (((sv_isobject(obj) && sv_derived_from(obj, "URI::Fast::Reader")) ? NULL : croak("error: expected instance of URI::Fast::Reader")), \
+    ((uri_reader_t*) SvIV(SvRV((obj)))))
+
+#define URI_READER_BLOCK (1024 * 1024)
+
+typedef struct {
+  SV     *fh;       // file handle, when reading from a handle
+  char   *map;      // mapped file, or NULL
+  size_t map_len;
+  char   *buf;      // line buffer; the map itself or a block buffer
+  size_t buf_size;  // allocated size of the block buffer
+  size_t pos;       // start of the next line in buf
+  size_t end;       // end of the data in buf
+  int    eof;       // true once the handle has been exhausted
+  UV     line;      // number of lines read
+  SV     *obj;      // the reused URI::Fast object
+  uri_t  *uri;      // and its uri_t
+  SV     *ref_obj;  // access logs only: the reused referer object
+  uri_t  *ref;      // and its uri_t
+  int    has_ref;   // true if the current line had a referer
+  UV     skipped;   // access logs only: lines without a request line
+} uri_reader_t;
+
+static
+uri_reader_t* reader_alloc(pTHX_ int is_iri) {
+  uri_reader_t *reader;
+
+  Newxz(reader, 1, uri_reader_t);
+  reader->obj = new(aTHX_ is_iri ? "URI::Fast::IRI" : "URI::Fast", &PL_sv_undef, is_iri);
+  reader->uri = URI(reader->obj);
+
+  return reader;
+}
+
+static
+uri_reader_t* reader_new_fh(pTHX_ SV *fh, int is_iri) {
+  uri_reader_t *reader;
+  IO *io = sv_2io(fh);
+
+  if (io == NULL || IoIFP(io) == NULL) {
+    croak("URI::Fast::Reader: file handle is not open for reading");
+  }
+
+  reader = reader_alloc(aTHX_ is_iri);
+  reader->fh = SvREFCNT_inc(fh);
+  reader->buf_size = URI_READER_BLOCK;
+  Newx(reader->buf, reader->buf_size, char);
+
+  return reader;
+}
+
+/*
+ * Maps a regular file for reading. Returns NULL if the file is not a regular
+ * file (e.g. a named pipe) or if mmap is not supported, in which case the file
+ * should be read through a handle instead.
+ */
+static
+uri_reader_t* reader_new_path(pTHX_ const char *path, int is_iri) {
+#ifdef URI_USE_MMAP
+  uri_reader_t *reader;
+  Stat_t st;
+  char *map = NULL;
+  int fd = PerlLIO_open(path, O_RDONLY);
+
+  if (fd < 0) {
+    croak("URI::Fast::Reader: unable to open %s: %s", path, Strerror(errno));
+  }
+
+  if (PerlLIO_fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    PerlLIO_close(fd);
+    return NULL;
+  }
+
+  if (st.st_size > 0) {
+    map = (char*) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if ((void*) map == MAP_FAILED) {
+      PerlLIO_close(fd);
+      return NULL;
+    }
+
+#ifdef MADV_SEQUENTIAL
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif
+  }
+
+  PerlLIO_close(fd);
+
+  reader = reader_alloc(aTHX_ is_iri);
+  reader->map     = map;
+  reader->map_len = st.st_size;
+  reader->buf     = map;
+  reader->end     = st.st_size;
+  reader->eof     = 1;
+
+  return reader;
+#else
+  PERL_UNUSED_ARG(path);
+  PERL_UNUSED_ARG(is_iri);
+  return NULL;
+#endif
+}
+
+static
+void reader_free(pTHX_ uri_reader_t *reader) {
+  if (reader->map != NULL) {
+#ifdef URI_USE_MMAP
+    munmap(reader->map, reader->map_len);
+#endif
+  }
+  else if (reader->fh != NULL) {
+    Safefree(reader->buf);
+  }
+
+  if (reader->fh != NULL) {
+    SvREFCNT_dec(reader->fh);
+  }
+
+  if (reader->ref_obj != NULL) {
+    SvREFCNT_dec(reader->ref_obj);
+  }
+
+  SvREFCNT_dec(reader->obj);
+  Safefree(reader);
+}
+
+/*
+ * Finds the next line, setting *line and *len, and returns true, or returns
+ * false at the end of the input. Lines are located with memchr, which is
+ * vectorized by most C libraries. When reading from a handle, a partial line
+ * at the end of the block buffer is moved to the front of the buffer (which
+ * is grown as needed for long lines) before the next block is read.
+ */
+static
+int reader_next_line(pTHX_ uri_reader_t *reader, const char **line, size_t *len) {
+  const char *nl;
+  SSize_t got;
+
+  while (1) {
+    if (reader->pos < reader->end) {
+      nl = (const char*) memchr(&reader->buf[reader->pos], '\n', reader->end - reader->pos);
+
+      if (nl != NULL || reader->eof) {
+        *line = &reader->buf[reader->pos];
+        *len  = nl != NULL ? (size_t) (nl - *line) : reader->end - reader->pos;
+        reader->pos += *len + (nl != NULL ? 1 : 0);
+        ++reader->line;
+        return 1;
+      }
+    }
+    else if (reader->eof) {
+      return 0;
+    }
+
+    // Move the partial line to the front and fill the rest of the buffer
+    if (reader->pos > 0) {
+      Move(&reader->buf[reader->pos], reader->buf, reader->end - reader->pos, char);
+      reader->end -= reader->pos;
+      reader->pos  = 0;
+    }
+
+    if (reader->end == reader->buf_size) {
+      reader->buf_size *= 2;
+      Renew(reader->buf, reader->buf_size, char);
+    }
+
+    got = PerlIO_read(IoIFP(sv_2io(reader->fh)), &reader->buf[reader->end], reader->buf_size - reader->end);
+
+    if (got < 0) {
+      croak("URI::Fast::Reader: read error: %s", Strerror(errno));
+    }
+
+    if (got == 0) {
+      reader->eof = 1;
+    }
+
+    reader->end += got;
+  }
+}
+
+/*
+ * Scans the next non-blank line into the reader's uri_t. Returns false at the
+ * end of the input. Leading and trailing white space (including any carriage
+ * return) is trimmed by uri_scan.
+ */
+static
+int reader_next(pTHX_ uri_reader_t *reader) {
+  const char *line;
+  size_t len, i;
+
+  while (reader_next_line(aTHX_ reader, &line, &len)) {
+    for (i = 0; i < len && my_isspace(line[i]); ++i);
+    if (i == len) continue;
+
+    uri_clear(aTHX_ reader->uri);
+    uri_scan(aTHX_ reader->uri, line, len);
+    return 1;
+  }
+
+  return 0;
+}
+
+/*------------------------------------------------------------------------------
+ * Access logs
+ *
+ * Extracts the request-target and referer from Common or Combined Log Format
+ * lines, e.g.:
+ *
+ *   1.2.3.4 - - [10/Oct/2000:13:55:36 -0700] "GET /a?b=1 HTTP/1.1" 200 2326 "http://example.com/" "Mozilla/4.08"
+ *
+ * The request line is the first quoted field and the referer is the quoted
+ * field following it. Both are scanned in place from the reader's buffer.
+ *----------------------------------------------------------------------------*/
+#define URI_ACCESS_LOG(obj) \
+  (((sv_isobject(obj) && sv_derived_from(obj, "URI::Fast::AccessLog")) ? NULL : croak("error: expected instance of URI::Fast::AccessLog")), \
+    ((uri_reader_t*) SvIV(SvRV((obj)))))
+
+// Returns the position of the quote closing the field which begins at start,
+// skipping backslash-escaped characters, or len if the field is unterminated.
+static
+size_t log_quoted_end(const char *line, size_t start, size_t len) {
+  size_t i;
+
+  for (i = start; i < len; ++i) {
+    if (line[i] == '\\') {
+      ++i;
+    }
+    else if (line[i] == '"') {
+      return i;
+    }
+  }
+
+  return len;
+}
+
+/*
+ * Locates the request-target and referer in a log line. Returns false if the
+ * line has no request line with a target (e.g. the "-" logged for a request
+ * which was never sent). *ref_len is set to 0 if there is no referer or it is
+ * "-". Escape sequences within the fields are not decoded.
+ */
+static
+int log_fields(const char *line, size_t len, const char **tgt, size_t *tgt_len, const char **ref, size_t *ref_len) {
+  const char *quote;
+  size_t req, req_end, start, end, i;
+
+  *ref_len = 0;
+
+  // Request line: METHOD SP request-target [SP HTTP-version]
+  quote = (const char*) memchr(line, '"', len);
+  if (quote == NULL) return 0;
+
+  req     = quote - line + 1;
+  req_end = log_quoted_end(line, req, len);
+  if (req_end == len) return 0;
+
+  start = req;
+  while (start < req_end && line[start] != ' ') ++start;
+  while (start < req_end && line[start] == ' ') ++start;
+  if (start == req_end) return 0;
+
+  end = req_end;
+  for (i = req_end; i > start; --i) {
+    if (line[i - 1] == ' ') {
+      end = i - 1;
+      break;
+    }
+  }
+
+  while (end > start && line[end - 1] == ' ') --end;
+
+  *tgt     = &line[start];
+  *tgt_len = end - start;
+
+  // Referer: the next quoted field, after the status and size
+  quote = (const char*) memchr(&line[req_end + 1], '"', len - req_end - 1);
+
+  if (quote != NULL) {
+    start = quote - line + 1;
+    end   = log_quoted_end(line, start, len);
+
+    if (end < len && !(end - start == 1 && line[start] == '-')) {
+      *ref     = &line[start];
+      *ref_len = end - start;
+    }
+  }
+
+  return 1;
+}
+
+static
+void log_attach(pTHX_ uri_reader_t *reader) {
+  int is_iri = reader->uri->is_iri;
+  reader->ref_obj = new(aTHX_ is_iri ? "URI::Fast::IRI" : "URI::Fast", &PL_sv_undef, is_iri);
+  reader->ref     = URI(reader->ref_obj);
+}
+
+/*
+ * Scans the request-target and referer of the next log line into the
+ * reader's two uri_t. Lines without a request line are counted and skipped.
+ * Returns false at the end of the input.
+ */
+static
+int log_next(pTHX_ uri_reader_t *reader) {
+  const char *line, *tgt, *ref;
+  size_t len, tgt_len, ref_len;
+
+  while (reader_next_line(aTHX_ reader, &line, &len)) {
+    if (len == 0) continue;
+
+    if (!log_fields(line, len, &tgt, &tgt_len, &ref, &ref_len)) {
+      ++reader->skipped;
+      continue;
+    }
+
+    uri_clear(aTHX_ reader->uri);
+    uri_scan(aTHX_ reader->uri, tgt, tgt_len);
+
+    uri_clear(aTHX_ reader->ref);
+    reader->has_ref = ref_len > 0;
+
+    if (reader->has_ref) {
+      uri_scan(aTHX_ reader->ref, ref, ref_len);
+    }
+
+    return 1;
+  }
+
+  return 0;
+}
+
+// Appends a component to a column, or undef if it is empty
+static inline
+void log_column_push(pTHX_ AV *col, uri_str_t *str) {
+  av_push(col, str->length > 0 ? newSVpvn(str->string, str->length) : newSV(0));
+}
+
+/*
+ * Reads up to max lines into a hash of arrays, one per component of the
+ * request-target (scheme, host, port, path, query, frag) and of the referer
+ * (referer_scheme, etc.). Returns undef if there are no more lines.
+ */
+static
+SV* log_columns(pTHX_ uri_reader_t *reader, IV max) {
+  static const char *names[] = {
+    "scheme", "host", "port", "path", "query", "frag",
+    "referer_scheme", "referer_host", "referer_port", "referer_path", "referer_query", "referer_frag",
+  };
+
+  HV *cols;
+  AV *col[12];
+  uri_str_t *parts[6];
+  uri_t *uri;
+  IV n = 0;
+  int i, j;
+
+  if (max < 1) {
+    croak("columns: expected a positive number of lines");
+  }
+
+  if (!log_next(aTHX_ reader)) {
+    return newSV(0);
+  }
+
+  cols = newHV();
+
+  for (i = 0; i < 12; ++i) {
+    col[i] = newAV();
+    av_extend(col[i], max < 4096 ? max - 1 : 4095);
+    hv_store(cols, names[i], strlen(names[i]), newRV_noinc((SV*) col[i]), 0);
+  }
+
+  do {
+    for (i = 0; i < 2; ++i) {
+      uri = i == 0 ? reader->uri : reader->ref;
+
+      if (i == 1 && !reader->has_ref) {
+        for (j = 0; j < 6; ++j) av_push(col[6 + j], newSV(0));
+        continue;
+      }
+
+      parts[0] = uri->scheme;
+      parts[1] = uri->host;
+      parts[2] = uri->port;
+      parts[3] = uri->path;
+      parts[4] = uri->query;
+      parts[5] = uri->frag;
+
+      for (j = 0; j < 6; ++j) {
+        if (j == 3) {
+          // the path is always present, if empty
+          av_push(col[i * 6 + j], newSVpvn(uri->path->string, uri->path->length));
+        } else {
+          log_column_push(aTHX_ col[i * 6 + j], parts[j]);
+        }
+      }
+    }
+  } while (++n < max && log_next(aTHX_ reader));
+
+  return newRV_noinc((SV*) cols);
+}
+
+/*
+ * Returns a new copy of the uri string with tabs, line feeds, and carriage
+ * returns stripped, and backslashes replaced with forward slashes.
+ */
+SV* html_url(pTHX_ SV *uri, SV *base) {
+  SV *rv;
+  size_t i = 0;
+  size_t len;
+  const char *in = SvPV_const(uri, len);
+  uri_str_t *out = str_new(aTHX_ 32);
+
+  if (in[0] == '/' && in[1] == '/') {
+    if (base != NULL && (SvOK(base) || SvROK(base))) {
+      uri_t *base_uri = URI(base);
+      if (base_uri->scheme->length > 0) {
+        str_append(aTHX_ out, base_uri->scheme->string, base_uri->scheme->length);
+        str_append(aTHX_ out, ":", 1);
+      }
+    }
+  }
+
+  // Remove characters specified by the URL standard
+  for (i = 0; i < len; ++i) {
+    switch (in[i]) {
+      // Strip tabs, line feeds, and carriage returns
+      case '\t':
+      case '\r':
+      case '\n':
+        break;
+
+      // Convert backslashes to forward slashes
+      case '\\':
+        str_append(aTHX_ out, "/", 1);
+        break;
+
+      default:
+        str_append(aTHX_ out, &in[i], 1);
+        break;
+    }
+  }
+
+  rv = URI_STR_2SV(out);
+  str_free(aTHX_ out);
+
+  // If the source uri was utf8, ensure that the flag is flipped for the output
+  // buffer as well.
+  if (DO_UTF8(uri)) {
+    sv_utf8_decode(rv);
+  }
+
+  return rv;
+}
+
+
+/*------------------------------------------------------------------------------
+ * Parallel parsing
+ *
+ * A file of newline-delimited URIs is mapped into memory and divided into one
+ * contiguous range of lines per worker. Each worker scans, normalizes, and
+ * fingerprints the lines in its range on its own pthread, writing the results
+ * into its own arrays and arena without touching the interpreter. Once all of
+ * the workers have finished, their results are gathered in file order on the
+ * interpreter thread.
+ *
+ * Workers allocate memory with Newx, which only calls into the interpreter on
+ * builds which track allocations per interpreter (e.g. -DDEBUGGING). On those
+ * builds, and on perls without threads, the ranges are processed one after the
+ * other on the calling thread instead.
+ *----------------------------------------------------------------------------*/
+#if defined(USE_ITHREADS) && defined(I_PTHREAD) \
+ && !defined(PERL_TRACK_MEMPOOL) && !defined(DEBUGGING) && !defined(PERL_IMPLICIT_SYS)
+#include <pthread.h>
+#define URI_USE_PTHREADS 1
+#endif
+
+#define URI_PARALLEL_MAX_WORKERS 256
+
+typedef struct {
+#ifdef PERL_IMPLICIT_CONTEXT
+  tTHX       thx;        // satisfies pTHX_ signatures; never used to call perl
+#endif
+  const char *src;       // the worker's range of the file
+  size_t     len;
+  uri_t      *uri;       // scratch uri_t, allocated on the interpreter thread
+  int        normalized; // true to keep the normalized strings
+  U64        *fps;       // fingerprint of each line
+  size_t     count;
+  size_t     allocated;
+  uri_str_t  *arena;     // normalized strings, back to back
+  size_t     *ends;      // end of each string within the arena
+} uri_worker_t;
+
+static
+void worker_push(pTHX_ uri_worker_t *w, U64 fp) {
+  if (w->count == w->allocated) {
+    w->allocated *= 2;
+    Renew(w->fps, w->allocated, U64);
+
+    if (w->normalized) {
+      Renew(w->ends, w->allocated, size_t);
+    }
+  }
+
+  w->fps[w->count] = fp;
+
+  if (w->normalized) {
+    w->ends[w->count] = w->arena->length;
+  }
+
+  ++w->count;
+}
+
+/*
+ * Processes each non-blank line in the worker's range. Runs on a worker thread
+ * (or on the interpreter thread when pthreads are not used) and must not call
+ * into perl.
+ */
+static
+void worker_run(uri_worker_t *w) {
+  dTHXa(w->thx);
+  uri_hash_t h;
+  uri_sink_t sink = { &h, w->normalized ? w->arena : NULL };
+  const char *line = w->src, *end = w->src + w->len, *nl;
+  size_t len, i;
+
+  while (line < end) {
+    nl  = (const char*) memchr(line, '\n', end - line);
+    len = nl != NULL ? (size_t) (nl - line) : (size_t) (end - line);
+
+    for (i = 0; i < len && my_isspace(line[i]); ++i);
+
+    if (i < len) {
+      uri_clear(aTHX_ w->uri);
+      uri_scan(aTHX_ w->uri, line, len);
+      hash_init(&h);
+      uri_write_normalized(aTHX_ w->uri, &sink);
+      worker_push(aTHX_ w, hash_final(&h));
+    }
+
+    line += len + 1;
+  }
+}
+
+#ifdef URI_USE_PTHREADS
+static
+void* worker_thread(void *arg) {
+  worker_run((uri_worker_t*) arg);
+  return NULL;
+}
+#endif
+
+// Returns the number of online processors, or 1 if it cannot be determined.
+static
+UV parallel_default_workers() {
+#if defined(_SC_NPROCESSORS_ONLN)
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (UV) n : 1;
+#else
+  return 1;
+#endif
+}
+
+/*
+ * Reads the file at path into memory, mapping it read-only when possible. Sets
+ * *mapped to indicate how the buffer must be released (see file_unmap). Errors
+ * are reported on behalf of the named caller.
+ */
+static
+char* file_map(pTHX_ const char *caller, const char *path, size_t *len, int *mapped) {
+  Stat_t st;
+  char *buf = NULL;
+  int fd = PerlLIO_open(path, O_RDONLY);
+
+  if (fd < 0) {
+    croak("%s: unable to open %s: %s", caller, path, Strerror(errno));
+  }
+
+  if (PerlLIO_fstat(fd, &st) != 0) {
+    PerlLIO_close(fd);
+    croak("%s: unable to stat %s: %s", caller, path, Strerror(errno));
+  }
+
+  *len = (size_t) st.st_size;
+  *mapped = 0;
+
+  if (*len == 0) {
+    PerlLIO_close(fd);
+    return NULL;
+  }
+
+#ifdef URI_USE_MMAP
+  buf = (char*) mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  if ((void*) buf != MAP_FAILED) {
+    PerlLIO_close(fd);
+    *mapped = 1;
+    return buf;
+  }
+#endif
+
+  {
+    size_t got = 0;
+    SSize_t n;
+
+    Newx(buf, *len, char);
+
+    while (got < *len) {
+      n = PerlLIO_read(fd, &buf[got], *len - got);
+      if (n <= 0) break;
+      got += n;
+    }
+
+    PerlLIO_close(fd);
+
+    if (got != *len) {
+      Safefree(buf);
+      croak("%s: unable to read %s: %s", caller, path, Strerror(errno));
+    }
+  }
+
+  return buf;
+}
+
+static
+void file_unmap(pTHX_ char *buf, size_t len, int mapped) {
+#ifdef URI_USE_MMAP
+  if (mapped) {
+    munmap(buf, len);
+    return;
+  }
+#else
+  PERL_UNUSED_ARG(len);
+  PERL_UNUSED_ARG(mapped);
+#endif
+
+  Safefree(buf);
+}
+
+/*
+ * Parses each line of the file at path using up to nworkers threads and
+ * returns a hash ref holding the number of URIs, their fingerprints packed as
+ * native 64-bit integers, and (optionally) an array ref of their normalized
+ * strings.
+ */
+static
+SV* parse_file_parallel(pTHX_ const char *path, UV nworkers, int is_iri, int normalized) {
+  uri_worker_t *workers;
+  HV *out;
+  SV *fps;
+  size_t len, start, stop, count, i, j;
+  int mapped;
+  char *buf;
+#ifdef URI_USE_PTHREADS
+  pthread_t *threads;
+  U8 *started;
+#endif
+
+  if (nworkers == 0) nworkers = parallel_default_workers();
+  if (nworkers > URI_PARALLEL_MAX_WORKERS) nworkers = URI_PARALLEL_MAX_WORKERS;
+
+  buf = file_map(aTHX_ "parse_file_parallel", path, &len, &mapped);
+
+#ifdef MADV_WILLNEED
+  if (mapped) madvise(buf, len, MADV_WILLNEED);
+#endif
+
+  // Divide the file into ranges of roughly equal size, each ending just past a
+  // newline
+  Newxz(workers, nworkers, uri_worker_t);
+
+  for (i = 0, start = 0; i < nworkers; ++i) {
+    stop = i == nworkers - 1 ? len : (len / nworkers) * (i + 1);
+
+    if (stop < start) {
+      stop = start;
+    }
+
+    while (stop > 0 && stop < len && buf[stop - 1] != '\n') {
+      ++stop;
+    }
+
+#ifdef PERL_IMPLICIT_CONTEXT
+    workers[i].thx = aTHX;
+#endif
+    workers[i].src        = &buf[start];
+    workers[i].len        = stop - start;
+    workers[i].uri        = uri_alloc(aTHX_ is_iri);
+    workers[i].normalized = normalized;
+    workers[i].allocated  = 16 + workers[i].len / 64;
+    Newx(workers[i].fps, workers[i].allocated, U64);
+
+    if (normalized) {
+      workers[i].arena = str_new(aTHX_ workers[i].len + 1);
+      Newx(workers[i].ends, workers[i].allocated, size_t);
+    }
+
+    start = stop;
+  }
+
+  // Any worker whose thread cannot be started is run on this thread instead
+#ifdef URI_USE_PTHREADS
+  Newx(threads, nworkers, pthread_t);
+  Newxz(started, nworkers, U8);
+
+  for (i = 1; i < nworkers; ++i) {
+    started[i] = pthread_create(&threads[i], NULL, worker_thread, &workers[i]) == 0;
+  }
+
+  worker_run(&workers[0]);
+
+  for (i = 1; i < nworkers; ++i) {
+    if (started[i]) {
+      pthread_join(threads[i], NULL);
+    }
+    else {
+      worker_run(&workers[i]);
+    }
+  }
+
+  Safefree(threads);
+  Safefree(started);
+#else
+  for (i = 0; i < nworkers; ++i) {
+    worker_run(&workers[i]);
+  }
+#endif
+
+  file_unmap(aTHX_ buf, len, mapped);
+
+  // Gather the results in file order
+  for (i = 0, count = 0; i < nworkers; ++i) {
+    count += workers[i].count;
+  }
+
+  out = newHV();
+  fps = newSV(count * sizeof(U64) + 1);
+  SvPOK_on(fps);
+  hv_stores(out, "count", newSVuv(count));
+  hv_stores(out, "fingerprints", fps);
+
+  if (normalized) {
+    AV *strs = newAV();
+    av_extend(strs, count);
+    hv_stores(out, "normalized", newRV_noinc((SV*) strs));
+
+    for (i = 0; i < nworkers; ++i) {
+      for (j = 0, start = 0; j < workers[i].count; ++j) {
+        SV *str = newSVpvn(&workers[i].arena->string[start], workers[i].ends[j] - start);
+        if (is_iri) SvUTF8_on(str);
+        av_push(strs, str);
+        start = workers[i].ends[j];
+      }
+    }
+  }
+
+  for (i = 0; i < nworkers; ++i) {
+    sv_catpvn(fps, (const char*) workers[i].fps, workers[i].count * sizeof(U64));
+
+    uri_free(aTHX_ workers[i].uri);
+    Safefree(workers[i].fps);
+
+    if (normalized) {
+      str_free(aTHX_ workers[i].arena);
+      Safefree(workers[i].ends);
+    }
+  }
+
+  Safefree(workers);
+
+  return newRV_noinc((SV*) out);
+}
+
+/*------------------------------------------------------------------------------
+ * Packed records
+ *
+ * A parsed URI may be packed into a compact record for storage in an arena by
+ * URI::Fast::Table and URI::Fast::Array. A record is a single byte with a bit
+ * set for each non-empty component (URI_RECORD_*), followed by the length of
+ * each of those components as a varint, followed by the components' raw bytes.
+ * Separators are not stored, so a typical record is about the same size as the
+ * URI string.
+ *----------------------------------------------------------------------------*/
+#define URI_RECORD_SCHEME 0
+#define URI_RECORD_USR    1
+#define URI_RECORD_PWD    2
+#define URI_RECORD_HOST   3
+#define URI_RECORD_PORT   4
+#define URI_RECORD_PATH   5
+#define URI_RECORD_QUERY  6
+#define URI_RECORD_FRAG   7
+
+// The members of a uri_t, in record order
+#define URI_RECORD_MEMBERS(uri) \
+  { (uri)->scheme, (uri)->usr, (uri)->pwd, (uri)->host, (uri)->port, (uri)->path, (uri)->query, (uri)->frag }
+
+// Returns the maximum size of the record for a uri_t
+static
+size_t record_size(uri_t *uri) {
+  uri_str_t *members[8] = URI_RECORD_MEMBERS(uri);
+  size_t size = 1;
+  int m;
+
+  for (m = 0; m < 8; ++m) {
+    size += members[m]->length + (members[m]->length > 0 ? 10 : 0);
+  }
+
+  return size;
+}
+
+/*
+ * Writes the record for a uri_t to buf, which must have room for at least
+ * record_size() bytes. Returns the number of bytes written.
+ */
+static
+size_t record_write(uri_t *uri, U8 *buf) {
+  uri_str_t *members[8] = URI_RECORD_MEMBERS(uri);
+  size_t pos = 1, v;
+  int m;
+
+  buf[0] = 0;
+
+  for (m = 0; m < 8; ++m) {
+    if (members[m]->length == 0) continue;
+    buf[0] |= 1 << m;
+
+    for (v = members[m]->length; v > 0x7F; v >>= 7) {
+      buf[pos++] = (U8) ((v & 0x7F) | 0x80);
+    }
+
+    buf[pos++] = (U8) v;
+  }
+
+  for (m = 0; m < 8; ++m) {
+    if (members[m]->length == 0) continue;
+    Copy(members[m]->string, &buf[pos], members[m]->length, U8);
+    pos += members[m]->length;
+  }
+
+  return pos;
+}
+
+// Appends the record for a uri_t to an arena
+static
+void record_append(pTHX_ uri_str_t *arena, uri_t *uri) {
+  str_grow(aTHX_ arena, arena->length + record_size(uri));
+  arena->length += record_write(uri, (U8*) &arena->string[arena->length]);
+  arena->string[arena->length] = '\0';
+}
+
+/*
+ * Reads the header of the record at *pos within an arena of len bytes, filling
+ * in the offset (within the arena) and length of each component, and advances
+ * *pos past the end of the record. Returns false if the record is truncated.
+ */
+static
+int record_read(const U8 *arena, U64 len, U64 *pos, U64 *starts, U64 *lens) {
+  U64 at = *pos;
+  U8 present;
+  int m, shift;
+
+  if (at >= len) return 0;
+  present = arena[at++];
+
+  for (m = 0; m < 8; ++m) {
+    lens[m] = 0;
+    if (!(present & (1 << m))) continue;
+
+    for (shift = 0; ; shift += 7) {
+      if (at >= len || shift > 63) return 0;
+      lens[m] |= (U64) (arena[at] & 0x7F) << shift;
+      if (!(arena[at++] & 0x80)) break;
+    }
+  }
+
+  for (m = 0; m < 8; ++m) {
+    if (lens[m] > len - at) return 0;
+    starts[m] = at;
+    at += lens[m];
+  }
+
+  *pos = at;
+  return 1;
+}
+
+/*
+ * Copies the components of the record at pos into a uri_t, replacing all of
+ * its members. Returns false if the record is truncated.
+ */
+static
+int record_to_uri(pTHX_ const U8 *arena, U64 len, U64 pos, uri_t *uri) {
+  uri_str_t *members[8] = URI_RECORD_MEMBERS(uri);
+  U64 starts[8], lens[8];
+  int m;
+
+  if (!record_read(arena, len, &pos, starts, lens)) {
+    return 0;
+  }
+
+  URI_CHANGED(uri);
+
+  for (m = 0; m < 8; ++m) {
+    str_set(aTHX_ members[m], (const char*) &arena[starts[m]], lens[m]);
+  }
+
+  return 1;
+}
+
+/*------------------------------------------------------------------------------
+ * Serialization
+ *
+ * URI::Fast objects are frozen for Storable and Sereal as a single byte, with
+ * the format version in its upper four bits and URI_FROZEN_IRI, followed by a
+ * packed record of the URI's components. Thawing copies the components directly
+ * into a new uri_t without scanning.
+ *----------------------------------------------------------------------------*/
+#define URI_FROZEN_V1  0x10
+#define URI_FROZEN_IRI 0x01
+
+static
+SV* uri_freeze(pTHX_ uri_t *uri) {
+  SV *frozen = newSV(record_size(uri) + 1);
+  U8 *buf = (U8*) SvPVX(frozen);
+  size_t len;
+
+  buf[0] = URI_FROZEN_V1 | (uri->is_iri ? URI_FROZEN_IRI : 0);
+  len = 1 + record_write(uri, &buf[1]);
+  buf[len] = '\0';
+
+  SvCUR_set(frozen, len);
+  SvPOK_on(frozen);
+
+  return frozen;
+}
+
+// Returns a new uri_t from a string produced by uri_freeze
+static
+uri_t* uri_thaw(pTHX_ const char *caller, SV *frozen) {
+  STRLEN len;
+  const U8 *buf = (const U8*) SvPVbyte(frozen, len);
+  U64 starts[8], lens[8];
+  U64 end = 1;
+  uri_t *uri;
+
+  if (len < 2
+   || (buf[0] & 0xF0) != URI_FROZEN_V1
+   || !record_read(buf, len, &end, starts, lens)
+   || end != len)
+  {
+    croak("%s: invalid serialized URI::Fast object", caller);
+  }
+
+  uri = uri_alloc(aTHX_ buf[0] & URI_FROZEN_IRI);
+  record_to_uri(aTHX_ buf, len, 1, uri);
+
+  return uri;
+}
+
+/*------------------------------------------------------------------------------
+ * Tables
+ *
+ * A packed, read-only collection of parsed URIs which is written once and then
+ * mapped into memory by any number of processes. Nothing is parsed when the
+ * table is loaded; each entry's components are stored ready to be copied into
+ * a uri_t.
+ *
+ * The serialized form is a 64 byte header followed by four sections. Integers
+ * are stored as little-endian bytes, so the file is independent of byte order:
+ *
+ *   0   magic     "URIFTBL\1"
+ *   8   count     u64le   number of entries
+ *   16  flags     u32le   URI_TABLE_IRI, URI_TABLE_INDEX
+ *   20  reserved  u32
+ *   24  arena     u64le   size of the arena in bytes
+ *   32  capacity  u64le   number of index slots; 0 without an index
+ *   40  reserved  (zero filled to 64 bytes)
+ *
+ *   offsets       u64le * count      start of each entry within the arena
+ *   arena         a packed record (see above) for each entry
+ *   padding       zero filled to a multiple of 8 bytes
+ *   fingerprints  u64le * count      index only; fingerprint of each entry
+ *   slots         u32le * capacity   index only; open-addressed by
+ *                                    fingerprint, holding entry number + 1
+ *----------------------------------------------------------------------------*/
+#define URI_TABLE(obj) \
+  (((sv_isobject(obj) && sv_derived_from(obj, "URI::Fast::Table")) ? NULL : croak("error: expected instance of URI::Fast::Table")), \
+    ((uri_table_t*) SvIV(SvRV((obj)))))
+
+#define URI_TABLE_MAGIC   "URIFTBL\1"
+#define URI_TABLE_HEADER  64
+#define URI_TABLE_IRI     1
+#define URI_TABLE_INDEX   2
+
+typedef struct {
+  U8        *map;        // mapped (or read) file
+  size_t    map_len;
+  int       mapped;
+  U64       count;
+  U32       flags;
+  const U8  *offsets;
+  const U8  *arena;
+  U64       arena_len;
+  const U8  *fps;        // fingerprints, or NULL without an index
+  const U8  *slots;
+  U64       capacity;
+  uri_t     *scratch;    // scratch uri_t for scanning string arguments
+  uri_t     *entry;      // scratch uri_t for comparing entries
+  uri_str_t *key;        // normalized forms of both
+  uri_str_t *entry_key;
+} uri_table_t;
+
+static inline
+void table_write32(U8 *p, U32 v) {
+  int i;
+  for (i = 0; i < 4; ++i) p[i] = (U8) (v >> (i * 8));
+}
+
+/*
+ * Copies the components of entry i into a uri_t. Croaks if the entry runs past
+ * the end of the arena.
+ */
+static
+void table_entry(pTHX_ uri_table_t *table, U64 i, uri_t *uri) {
+  if (!record_to_uri(aTHX_ table->arena, table->arena_len, hash_read64(&table->offsets[i * 8]), uri)) {
+    croak("URI::Fast::Table: entry %" UVuf " is corrupt", (UV) i);
+  }
+}
+
+// Returns true if two uri_t are equivalent once normalized
+static
+int table_equal(pTHX_ uri_table_t *table, uri_t *a, uri_t *b) {
+  uri_sink_t sink_a = { NULL, table->key };
+  uri_sink_t sink_b = { NULL, table->entry_key };
+
+  str_clear(aTHX_ table->key);
+  str_clear(aTHX_ table->entry_key);
+  uri_write_normalized(aTHX_ a, &sink_a);
+  uri_write_normalized(aTHX_ b, &sink_b);
+
+  return table->key->length == table->entry_key->length
+      && memEQ(table->key->string, table->entry_key->string, table->key->length);
+}
+
+/*
+ * Returns the number of the first entry equivalent to uri, or -1 if there is
+ * none. Each probe compares fingerprints before comparing the normalized
+ * entries themselves.
+ */
+static
+SSize_t table_find(pTHX_ uri_table_t *table, uri_t *uri) {
+  U64 fp = uri_fingerprint(aTHX_ uri);
+  U64 mask = table->capacity - 1;
+  U64 idx = fp & mask;
+  U64 probes;
+  U32 slot;
+
+  // A valid index always has an empty slot, but a corrupt one may not
+  for (probes = 0; probes < table->capacity; ++probes) {
+    slot = (U32) hash_read32(&table->slots[idx * 4]);
+
+    if (slot == 0) {
+      break;
+    }
+
+    if (slot > table->count) {
+      croak("URI::Fast::Table: index is corrupt");
+    }
+
+    if (hash_read64(&table->fps[(slot - 1) * 8]) == fp) {
+      table_entry(aTHX_ table, slot - 1, table->entry);
+
+      if (table_equal(aTHX_ table, uri, table->entry)) {
+        return (SSize_t) slot - 1;
+      }
+    }
+
+    idx = (idx + 1) & mask;
+  }
+
+  return -1;
+}
+
+static
+uri_table_t* table_alloc(pTHX_ U8 *map, size_t map_len, int mapped) {
+  uri_table_t *table;
+  U64 offsets_end, arena_end, index_len;
+
+  if (map_len < URI_TABLE_HEADER || memcmp(map, URI_TABLE_MAGIC, 8) != 0) {
+    return NULL;
+  }
+
+  Newxz(table, 1, uri_table_t);
+  table->map       = map;
+  table->map_len   = map_len;
+  table->mapped    = mapped;
+  table->count     = hash_read64(&map[8]);
+  table->flags     = (U32) hash_read32(&map[16]);
+  table->arena_len = hash_read64(&map[24]);
+  table->capacity  = hash_read64(&map[32]);
+
+  // Validate the section sizes against the size of the file. Each size is
+  // bounded before it is used, so that none of the sums can overflow.
+  if (table->count > (map_len - URI_TABLE_HEADER) / 8 || table->arena_len > map_len) {
+    Safefree(table);
+    return NULL;
+  }
+
+  offsets_end = URI_TABLE_HEADER + table->count * 8;
+  arena_end   = offsets_end + table->arena_len;
+  arena_end  += (8 - arena_end % 8) % 8;
+  index_len   = 0;
+
+  if (arena_end > map_len
+   || (table->flags & URI_TABLE_INDEX
+       && (table->count * 8 > map_len - arena_end
+        || table->capacity > (map_len - arena_end - table->count * 8) / 4)))
+  {
+    Safefree(table);
+    return NULL;
+  }
+
+  if (table->flags & URI_TABLE_INDEX) {
+    index_len = table->count * 8 + table->capacity * 4;
+  }
+
+  if (arena_end + index_len != (U64) map_len
+   || (table->flags & URI_TABLE_INDEX
+       ? table->capacity <= table->count || (table->capacity & (table->capacity - 1)) != 0
+       : table->capacity != 0))
+  {
+    Safefree(table);
+    return NULL;
+  }
+
+  table->offsets = &map[URI_TABLE_HEADER];
+  table->arena   = &map[offsets_end];
+
+  if (table->flags & URI_TABLE_INDEX) {
+    table->fps   = &map[arena_end];
+    table->slots = &map[arena_end + table->count * 8];
+  }
+
+  table->scratch   = uri_alloc(aTHX_ table->flags & URI_TABLE_IRI);
+  table->entry     = uri_alloc(aTHX_ table->flags & URI_TABLE_IRI);
+  table->key       = str_new(aTHX_ 256);
+  table->entry_key = str_new(aTHX_ 256);
+
+  return table;
+}
+
+/*
+ * Loads a table written with table_write. Where mmap is available, the file is
+ * mapped read-only, so that processes loading the same file share a single
+ * copy of it.
+ */
+static
+uri_table_t* table_load(pTHX_ const char *path) {
+  uri_table_t *table;
+  size_t len;
+  int mapped;
+  char *map = file_map(aTHX_ "URI::Fast::Table::load", path, &len, &mapped);
+
+  table = table_alloc(aTHX_ (U8*) map, len, mapped);
+
+  if (table == NULL) {
+    if (map != NULL) file_unmap(aTHX_ map, len, mapped);
+    croak("URI::Fast::Table::load: %s is not a URI table", path);
+  }
+
+  return table;
+}
+
+// Copies of mapped tables are read into memory
+static
+uri_table_t* table_copy(pTHX_ uri_table_t *from) {
+  U8 *map;
+
+  Newx(map, from->map_len, U8);
+  Copy(from->map, map, from->map_len, U8);
+
+  return table_alloc(aTHX_ map, from->map_len, 0);
+}
+
+URI_DUP_VTBL(table, uri_table_t, table_copy)
+
+static
+void table_free(pTHX_ uri_table_t *table) {
+  file_unmap(aTHX_ (char*) table->map, table->map_len, table->mapped);
+  uri_free(aTHX_ table->scratch);
+  uri_free(aTHX_ table->entry);
+  str_free(aTHX_ table->key);
+  str_free(aTHX_ table->entry_key);
+  Safefree(table);
+}
+
+// Returns a new, read-only URI::Fast object holding a copy of entry i
+static
+SV* table_get(pTHX_ uri_table_t *table, U64 i) {
+  int is_iri = table->flags & URI_TABLE_IRI;
+  SV *obj = new(aTHX_ is_iri ? "URI::Fast::IRI" : "URI::Fast", &PL_sv_undef, is_iri);
+  uri_t *uri = URI(obj);
+
+  table_entry(aTHX_ table, i, uri);
+  uri->readonly = 1;
+
+  return obj;
+}
+
+/*
+ * Writes an array ref of URI::Fast objects and/or URI strings to a new table.
+ * The whole table is assembled in memory, then written at once. When building
+ * the index, only the first of any equivalent entries is added to it.
+ */
+static
+void table_write(pTHX_ const char *path, SV *sv_uris, int is_iri, int with_index) {
+  AV *uris;
+  SV **refval, *sv_scratch, *sv_entry;
+  uri_t *scratch, *uri;
+  uri_table_t table;
+  uri_str_t *arena;
+  U8 header[URI_TABLE_HEADER], *offsets, *fps = NULL, *slots = NULL;
+  U64 count, capacity = 0, mask, idx, i, fp;
+  U32 slot, flags;
+  size_t pad;
+  PerlIO *fh;
+  int ok;
+
+  if (!is_ref(aTHX_ sv_uris) || SvTYPE(SvRV(sv_uris)) != SVt_PVAV) {
+    croak("URI::Fast::Table::write: expected array ref");
+  }
+
+  uris  = (AV*) SvRV(sv_uris);
+  count = av_top_index(uris) + 1;
+  flags = (is_iri ? URI_TABLE_IRI : 0) | (with_index ? URI_TABLE_INDEX : 0);
+
+  if (count >= U32_MAX) {
+    croak("URI::Fast::Table::write: too many URIs");
+  }
+
+  // The scratch uri_t are owned by mortal objects, and the buffers below are
+  // released when this scope is left, whether or not an input croaks
+  sv_scratch = sv_2mortal(new(aTHX_ "URI::Fast", &PL_sv_undef, is_iri));
+  sv_entry   = sv_2mortal(new(aTHX_ "URI::Fast", &PL_sv_undef, is_iri));
+  scratch    = URI(sv_scratch);
+
+  ENTER;
+  arena = str_new(aTHX_ 4096);
+  SAVEDESTRUCTOR_X(str_free_ptr, arena);
+
+  Newxz(offsets, count * 8 + 1, U8);
+  SAVEFREEPV(offsets);
+
+  if (with_index) {
+    for (capacity = 16; capacity < count * 2; capacity *= 2);
+    Newxz(fps, count * 8 + 1, U8);
+    Newxz(slots, capacity * 4, U8);
+    SAVEFREEPV(fps);
+    SAVEFREEPV(slots);
+  }
+
+  for (i = 0; i < count; ++i) {
+    refval = av_fetch(uris, i, 0);
+    uri = uri_arg(aTHX_ refval == NULL ? &PL_sv_undef : *refval, scratch);
+
+    bloom_write64(&offsets[i * 8], arena->length);
+    record_append(aTHX_ arena, uri);
+  }
+
+  // The index is built from the arena, so that entries are compared exactly
+  // as they will be when the table is loaded
+  if (with_index) {
+    Zero(&table, 1, uri_table_t);
+    table.count     = count;
+    table.offsets   = offsets;
+    table.arena     = (const U8*) arena->string;
+    table.arena_len = arena->length;
+    table.fps       = fps;
+    table.entry     = URI(sv_entry);
+    table.key       = str_new(aTHX_ 256);
+    table.entry_key = str_new(aTHX_ 256);
+    SAVEDESTRUCTOR_X(str_free_ptr, table.key);
+    SAVEDESTRUCTOR_X(str_free_ptr, table.entry_key);
+    mask = capacity - 1;
+
+    for (i = 0; i < count; ++i) {
+      table_entry(aTHX_ &table, i, scratch);
+      fp = uri_fingerprint(aTHX_ scratch);
+      bloom_write64(&fps[i * 8], fp);
+
+      for (idx = fp & mask; (slot = (U32) hash_read32(&slots[idx * 4])) != 0; idx = (idx + 1) & mask) {
+        if (hash_read64(&fps[(slot - 1) * 8]) == fp) {
+          table_entry(aTHX_ &table, slot - 1, table.entry);
+          if (table_equal(aTHX_ &table, scratch, table.entry)) break;
+        }
+      }
+
+      if (slot == 0) {
+        table_write32(&slots[idx * 4], (U32) (i + 1));
+      }
+    }
+  }
+
+  Zero(header, URI_TABLE_HEADER, U8);
+  Copy(URI_TABLE_MAGIC, header, 8, U8);
+  bloom_write64(&header[8], count);
+  bloom_write64(&header[16], flags); // u32 followed by reserved zeroes
+  bloom_write64(&header[24], arena->length);
+  bloom_write64(&header[32], capacity);
+  pad = (8 - (URI_TABLE_HEADER + count * 8 + arena->length) % 8) % 8;
+
+  fh = PerlIO_open(path, "wb");
+
+  if (fh == NULL) {
+    croak("URI::Fast::Table::write: unable to open %s: %s", path, Strerror(errno));
+  }
+
+  ok = PerlIO_write(fh, header, URI_TABLE_HEADER) == URI_TABLE_HEADER
+    && PerlIO_write(fh, offsets, count * 8) == (SSize_t) (count * 8)
+    && PerlIO_write(fh, arena->string == NULL ? "" : arena->string, arena->length) == (SSize_t) arena->length
+    && PerlIO_write(fh, "\0\0\0\0\0\0\0", pad) == (SSize_t) pad;
+
+  if (ok && with_index) {
+    ok = PerlIO_write(fh, fps, count * 8) == (SSize_t) (count * 8)
+      && PerlIO_write(fh, slots, capacity * 4) == (SSize_t) (capacity * 4);
+  }
+
+  if (!ok) {
+    PerlIO_close(fh);
+    croak("URI::Fast::Table::write: error writing %s: %s", path, Strerror(errno));
+  }
+
+  if (PerlIO_close(fh) != 0) {
+    croak("URI::Fast::Table::write: error writing %s: %s", path, Strerror(errno));
+  }
+
+  LEAVE;
+}
+
+/*------------------------------------------------------------------------------
+ * Arrays
+ *
+ * A growable array of parsed URIs, stored as packed records back to back in a
+ * single arena. To keep the overhead per entry small, only the offset of every
+ * URI_ARRAY_STRIDE'th record is kept; other records are found by skipping
+ * forward over the records' headers from the nearest stored offset.
+ *----------------------------------------------------------------------------*/
+#define URI_ARRAY(obj) \
+  (((sv_isobject(obj) && sv_derived_from(obj, "URI::Fast::Array")) ? NULL : croak("error: expected instance of URI::Fast::Array")), \
+    ((uri_array_t*) SvIV(SvRV((obj)))))
+
+#define URI_ARRAY_STRIDE 16
+
+typedef struct {
+  uri_str_t *arena;
+  U64       *offsets;    // offset of every URI_ARRAY_STRIDE'th record
+  size_t    offsets_allocated;
+  size_t    count;
+  int       is_iri;
+  uri_t     *scratch;    // scratch uri_t for scanning string arguments
+} uri_array_t;
+
+static
+uri_array_t* array_new(pTHX_ int is_iri) {
+  uri_array_t *array;
+
+  Newxz(array, 1, uri_array_t);
+  array->is_iri            = is_iri;
+  array->arena             = str_new(aTHX_ 4096);
+  array->offsets_allocated = 16;
+  array->scratch           = uri_alloc(aTHX_ is_iri);
+  Newx(array->offsets, array->offsets_allocated, U64);
+
+  return array;
+}
+
+static
+uri_array_t* array_copy(pTHX_ uri_array_t *from) {
+  uri_array_t *array = array_new(aTHX_ from->is_iri);
+
+  str_copy(aTHX_ from->arena, array->arena);
+  Renew(array->offsets, from->offsets_allocated, U64);
+  Copy(from->offsets, array->offsets, from->offsets_allocated, U64);
+  array->offsets_allocated = from->offsets_allocated;
+  array->count             = from->count;
+
+  return array;
+}
+
+URI_DUP_VTBL(array, uri_array_t, array_copy)
+
+static
+void array_free(pTHX_ uri_array_t *array) {
+  str_free(aTHX_ array->arena);
+  uri_free(aTHX_ array->scratch);
+  Safefree(array->offsets);
+  Safefree(array);
+}
+
+/*
+ * Appends a URI::Fast object or URI string to the array. The arena grows by
+ * half again as needed (see str_reserve), rather than doubling, to keep unused
+ * space small.
+ */
+static
+void array_push(pTHX_ uri_array_t *array, SV *sv) {
+  uri_t *uri = uri_arg(aTHX_ sv, array->scratch);
+  uri_str_t *arena = array->arena;
+
+  str_reserve(aTHX_ arena, arena->length + record_size(uri));
+
+  if (array->count % URI_ARRAY_STRIDE == 0) {
+    if (array->count / URI_ARRAY_STRIDE == array->offsets_allocated) {
+      array->offsets_allocated += array->offsets_allocated / 2;
+      Renew(array->offsets, array->offsets_allocated, U64);
+    }
+
+    array->offsets[array->count / URI_ARRAY_STRIDE] = arena->length;
+  }
+
+  arena->length += record_write(uri, (U8*) &arena->string[arena->length]);
+  arena->string[arena->length] = '\0';
+  ++array->count;
+}
+
+/*
+ * Sets *pos to the offset of record i within the arena. Returns false if i is
+ * out of range. Negative indices count back from the end of the array.
+ */
+static
+int array_locate(uri_array_t *array, IV i, U64 *pos) {
+  U64 starts[8], lens[8];
+  size_t n;
+
+  if (i < 0) i += (IV) array->count;
+  if (i < 0 || (size_t) i >= array->count) return 0;
+
+  *pos = array->offsets[i / URI_ARRAY_STRIDE];
+
+  for (n = i % URI_ARRAY_STRIDE; n > 0; --n) {
+    record_read((const U8*) array->arena->string, array->arena->length, pos, starts, lens);
+  }
+
+  return 1;
+}
+
+// Returns a new URI::Fast object holding a copy of record i, or undef
+static
+SV* array_get(pTHX_ uri_array_t *array, IV i) {
+  SV *obj;
+  U64 pos;
+
+  if (!array_locate(array, i, &pos)) {
+    return newSV(0);
+  }
+
+  obj = new(aTHX_ array->is_iri ? "URI::Fast::IRI" : "URI::Fast", &PL_sv_undef, array->is_iri);
+  record_to_uri(aTHX_ (const U8*) array->arena->string, array->arena->length, pos, URI(obj));
+
+  return obj;
+}
+
+// Returns the string form of record i, or undef
+static
+SV* array_string(pTHX_ uri_array_t *array, IV i) {
+  uri_t *uri = array->scratch;
+  SV *out;
+  U64 pos;
+
+  if (!array_locate(array, i, &pos)) {
+    return newSV(0);
+  }
+
+  record_to_uri(aTHX_ (const U8*) array->arena->string, array->arena->length, pos, uri);
+  out = sv_for_write(aTHX_ uri_string_length(uri), array->is_iri);
+  sv_written(aTHX_ out, uri_string_write(uri, SvPVX(out)));
+
+  return out;
+}
+
+/*
+ * Returns one component of record i, decoded as the matching URI::Fast getter
+ * would decode it, or undef if i is out of range.
+ */
+static
+SV* array_component(pTHX_ uri_array_t *array, IV i, int which) {
+  U64 starts[8], lens[8], pos;
+  const char *src;
+  size_t len;
+
+  if (!array_locate(array, i, &pos)) {
+    return newSV(0);
+  }
+
+  record_read((const U8*) array->arena->string, array->arena->length, &pos, starts, lens);
+
+  src = &array->arena->string[starts[which]];
+  len = lens[which];
+
+  if (which == URI_RECORD_PATH || which == URI_RECORD_QUERY) {
+    if (len == 0) return newSVpvn("", 0);
+    char decoded[ len + 1 ];
+    size_t dlen = uri_decode_utf8(src, len, decoded);
+    SV *out = newSVpvn(decoded, dlen);
+    sv_utf8_decode(out);
+    return out;
+  }
+
+  // Numeric ports are returned as numbers, as by the port getter
+  if (which == URI_RECORD_PORT) {
+    I32 num = port_number(src, len);
+    if (num >= 0) return newSViv(num);
+  }
+
+  return peek_decoded(aTHX_ src, len);
+}
+
+// Returns the number of bytes allocated for the array's storage
+static
+size_t array_memory_usage(uri_array_t *array) {
+  return sizeof(uri_array_t)
+       + sizeof(uri_str_t) + array->arena->allocated
+       + array->offsets_allocated * sizeof(U64);
+}
+
+/*------------------------------------------------------------------------------
+ * Sorted lists
+ *
+ * A sorted list of distinct, normalized URI strings, front coded in blocks of
+ * URI_SORTED_BLOCK strings. The first string in each block is stored whole;
+ * each string after it is stored as the length of the prefix it shares with
+ * the string before it, followed by the rest of the string. Sorted URIs share
+ * long prefixes (scheme, host, and leading path), so most strings are reduced
+ * to a few bytes.
+ *
+ * The offset of each block is kept in an index. Any string may be reached by
+ * decoding a single block, and a string may be found by a binary search over
+ * the first string of each block followed by a scan of one block.
+ *
+ * The serialized form is a 64 byte header followed by the index and the blocks:
+ *
+ *   0   magic     "URIFSRT\1"
+ *   8   count     u64le   number of strings
+ *   16  block     u32le   strings per block
+ *   20  reserved  u32
+ *   24  data      u64le   size of the blocks in bytes
+ *   32  reserved  (zero filled to 64 bytes)
+ *
+ *   index         u64le * ceil(count / block)   offset of each block
+ *   blocks        varint lengths and string bytes, as above
+ *----------------------------------------------------------------------------*/
+#define URI_SORTED(obj) \
+  (((sv_isobject(obj) && sv_derived_from(obj, "URI::Fast::Sorted")) ? NULL : croak("error: expected instance of URI::Fast::Sorted")), \
+    ((uri_sorted_t*) SvIV(SvRV((obj)))))
+
+#define URI_SORTED_MAGIC  "URIFSRT\1"
+#define URI_SORTED_HEADER 64
+#define URI_SORTED_BLOCK  16
+
+typedef struct {
+  const U8  *index;      // offset of each block, as u64le
+  const U8  *data;       // the blocks
+  U64       data_len;
+  U64       count;
+  U32       block;       // strings per block
+  int       readonly;    // true when loaded from a file
+  U8        *map;        // loaded file, if any
+  size_t    map_len;
+  int       mapped;
+  uri_str_t *index_buf;  // storage for the index and blocks, unless loaded
+  uri_str_t *data_buf;
+  uri_str_t *last;       // the last string added
+  uri_str_t *key;        // normalized form of an argument
+  uri_str_t *cur;        // the string most recently decoded
+  uri_t     *scratch;    // scratch uri_t for scanning string arguments
+} uri_sorted_t;
+
+static
+uri_sorted_t* sorted_alloc(pTHX) {
+  uri_sorted_t *sorted;
+
+  Newxz(sorted, 1, uri_sorted_t);
+  sorted->block   = URI_SORTED_BLOCK;
+  sorted->key     = str_new(aTHX_ 256);
+  sorted->cur     = str_new(aTHX_ 256);
+  sorted->scratch = uri_alloc(aTHX_ 0);
+
+  return sorted;
+}
+
+static
+uri_sorted_t* sorted_new(pTHX) {
+  uri_sorted_t *sorted = sorted_alloc(aTHX);
+
+  sorted->index_buf = str_new(aTHX_ 256);
+  sorted->data_buf  = str_new(aTHX_ 4096);
+  sorted->last      = str_new(aTHX_ 256);
+
+  return sorted;
+}
+
+static
+void sorted_free(pTHX_ uri_sorted_t *sorted) {
+  if (sorted->map != NULL) {
+    file_unmap(aTHX_ (char*) sorted->map, sorted->map_len, sorted->mapped);
+  }
+
+  if (sorted->index_buf != NULL) {
+    str_free(aTHX_ sorted->index_buf);
+    str_free(aTHX_ sorted->data_buf);
+    str_free(aTHX_ sorted->last);
+  }
+
+  str_free(aTHX_ sorted->key);
+  str_free(aTHX_ sorted->cur);
+  uri_free(aTHX_ sorted->scratch);
+  Safefree(sorted);
+}
+
+static
+void sorted_put_varint(pTHX_ uri_str_t *buf, U64 v) {
+  str_reserve(aTHX_ buf, buf->length + 10);
+
+  for (; v > 0x7F; v >>= 7) {
+    buf->string[buf->length++] = (char) ((v & 0x7F) | 0x80);
+  }
+
+  buf->string[buf->length++] = (char) v;
+}
+
+static inline
+U64 sorted_get_varint(pTHX_ uri_sorted_t *sorted, U64 *pos) {
+  U64 v = 0;
+  int shift;
+
+  for (shift = 0; ; shift += 7) {
+    if (*pos >= sorted->data_len || shift > 63) {
+      croak("URI::Fast::Sorted: data is corrupt");
+    }
+
+    v |= (U64) (sorted->data[*pos] & 0x7F) << shift;
+    if (!(sorted->data[(*pos)++] & 0x80)) return v;
+  }
+}
+
+// Compares two strings byte-wise, as sort_items orders them
+static inline
+int sorted_cmp(const char *a, size_t alen, const char *b, size_t blen) {
+  int cmp = memcmp(a, b, alen < blen ? alen : blen);
+  if (cmp != 0) return cmp;
+  return alen < blen ? -1 : alen > blen ? 1 : 0;
+}
+
+/*
+ * Decodes the string at *pos into sorted->cur and advances *pos past it. The
+ * first string in a block is stored whole; others are applied to the previous
+ * contents of sorted->cur.
+ */
+static
+void sorted_next(pTHX_ uri_sorted_t *sorted, U64 *pos, int first) {
+  U64 prefix = first ? 0 : sorted_get_varint(aTHX_ sorted, pos);
+  U64 len = sorted_get_varint(aTHX_ sorted, pos);
+
+  if (prefix > sorted->cur->length || len > sorted->data_len - *pos) {
+    croak("URI::Fast::Sorted: data is corrupt");
+  }
+
+  sorted->cur->length = prefix;
+  str_append(aTHX_ sorted->cur, (const char*) &sorted->data[*pos], len);
+  *pos += len;
+}
+
+// Decodes string i into sorted->cur
+static
+void sorted_decode(pTHX_ uri_sorted_t *sorted, U64 i) {
+  U64 pos = hash_read64(&sorted->index[(i / sorted->block) * 8]);
+  U64 n;
+
+  for (n = 0; n <= i % sorted->block; ++n) {
+    sorted_next(aTHX_ sorted, &pos, n == 0);
+  }
+}
+
+/*
+ * Returns the position of the first string which is not less than key (which
+ * is count if there is none), and sets *found if that string is equal to key.
+ */
+static
+U64 sorted_lower_bound(pTHX_ uri_sorted_t *sorted, const char *key, size_t klen, int *found) {
+  U64 nblocks = (sorted->count + sorted->block - 1) / sorted->block;
+  U64 lo = 0, hi = nblocks, mid, pos, len, i, end;
+  int cmp;
+
+  *found = 0;
+
+  // Find the last block whose first string is not greater than key
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    pos = hash_read64(&sorted->index[mid * 8]);
+    len = sorted_get_varint(aTHX_ sorted, &pos);
+
+    if (len > sorted->data_len - pos) {
+      croak("URI::Fast::Sorted: data is corrupt");
+    }
+
+    if (sorted_cmp((const char*) &sorted->data[pos], len, key, klen) <= 0) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+
+  if (lo == 0) {
+    return 0;
+  }
+
+  i   = (lo - 1) * sorted->block;
+  end = i + sorted->block < sorted->count ? i + sorted->block : sorted->count;
+  pos = hash_read64(&sorted->index[(lo - 1) * 8]);
+
+  for (; i < end; ++i) {
+    sorted_next(aTHX_ sorted, &pos, i % sorted->block == 0);
+    cmp = sorted_cmp(sorted->cur->string, sorted->cur->length, key, klen);
+
+    if (cmp >= 0) {
+      *found = cmp == 0;
+      return i;
+    }
+  }
+
+  return end;
+}
+
+// Writes the normalized form of a URI argument to sorted->key
+static
+void sorted_key(pTHX_ uri_sorted_t *sorted, SV *sv) {
+  uri_sink_t sink = { NULL, sorted->key };
+  str_clear(aTHX_ sorted->key);
+  uri_write_normalized(aTHX_ uri_arg(aTHX_ sv, sorted->scratch), &sink);
+}
+
+/*
+ * Appends a normalized string, which must sort after the last string added.
+ * Returns false if it is equal to the last string, which is not added again.
+ */
+static
+int sorted_append(pTHX_ uri_sorted_t *sorted, const char *str, size_t len) {
+  uri_str_t *data = sorted->data_buf;
+  size_t prefix = 0;
+  int cmp;
+
+  if (sorted->readonly) {
+    croak("URI::Fast::Sorted::add: list is read-only");
+  }
+
+  if (sorted->count > 0) {
+    cmp = sorted_cmp(str, len, sorted->last->string, sorted->last->length);
+
+    if (cmp == 0) {
+      return 0;
+    }
+
+    if (cmp < 0) {
+      croak("URI::Fast::Sorted::add: %.*s sorts before the last URI added", (int) len, str);
+    }
+  }
+
+  if (sorted->count % sorted->block == 0) {
+    U8 offset[8];
+    bloom_write64(offset, data->length);
+    str_append(aTHX_ sorted->index_buf, (const char*) offset, 8);
+  }
+  else {
+    while (prefix < len && prefix < sorted->last->length && str[prefix] == sorted->last->string[prefix]) {
+      ++prefix;
+    }
+
+    sorted_put_varint(aTHX_ data, prefix);
+  }
+
+  sorted_put_varint(aTHX_ data, len - prefix);
+  str_reserve(aTHX_ data, data->length + len - prefix);
+  Copy(&str[prefix], &data->string[data->length], len - prefix, char);
+  data->length += len - prefix;
+  data->string[data->length] = '\0';
+
+  str_set(aTHX_ sorted->last, str, len);
+  ++sorted->count;
+
+  sorted->index    = (const U8*) sorted->index_buf->string;
+  sorted->data     = (const U8*) data->string;
+  sorted->data_len = data->length;
+
+  return 1;
+}
+
+/*
+ * Adds an array ref of URI::Fast objects and/or URI strings, which may be in
+ * any order. Their normalized forms are sorted with sort_items, then appended,
+ * so all must sort after any strings already in the list.
+ */
+static
+UV sorted_add_many(pTHX_ uri_sorted_t *sorted, SV *sv_uris) {
+  AV *uris;
+  SV **refval;
+  uri_str_t *arena;
+  uri_sort_item_t *items;
+  uri_sink_t sink;
+  SSize_t i, top;
+  size_t n, b;
+  int depth = 0;
+  UV added = 0;
+
+  if (!is_ref(aTHX_ sv_uris) || SvTYPE(SvRV(sv_uris)) != SVt_PVAV) {
+    croak("URI::Fast::Sorted: expected array ref");
+  }
+
+  uris = (AV*) SvRV(sv_uris);
+  top  = av_top_index(uris);
+  n    = top + 1;
+
+  // The arena and items are released when this scope is left, whether or not
+  // an input croaks
+  ENTER;
+  arena = str_new(aTHX_ n * 32 + 64);
+  SAVEDESTRUCTOR_X(str_free_ptr, arena);
+  Newx(items, n > 0 ? n : 1, uri_sort_item_t);
+  SAVEFREEPV(items);
+  sink.hash = NULL;
+  sink.str  = arena;
+
+  for (i = 0; i <= top; ++i) {
+    refval = av_fetch(uris, i, 0);
+
+    items[i].idx    = i;
+    items[i].offset = arena->length;
+    uri_write_normalized(aTHX_ uri_arg(aTHX_ refval == NULL ? &PL_sv_undef : *refval, sorted->scratch), &sink);
+    items[i].length = arena->length - items[i].offset;
+  }
+
+  // Prefixes are computed once the arena has stopped moving
+  for (i = 0; i <= top; ++i) {
+    const U8 *key = (const U8*) &arena->string[ items[i].offset ];
+    U64 prefix = 0;
+
+    for (b = 0; b < 8; ++b) {
+      prefix = (prefix << 8) | (b < items[i].length ? key[b] : 0);
+    }
+
+    items[i].prefix = prefix;
+  }
+
+  for (b = n; b > 1; b >>= 1) depth += 2;
+  sort_items(items, n, arena->string, depth);
+
+  for (i = 0; i <= top; ++i) {
+    added += sorted_append(aTHX_ sorted, &arena->string[items[i].offset], items[i].length);
+  }
+
+  LEAVE;
+
+  return added;
+}
+
+// Returns the number of bytes allocated for the list's storage
+static
+size_t sorted_memory_usage(uri_sorted_t *sorted) {
+  if (sorted->map != NULL) {
+    return sizeof(uri_sorted_t) + sorted->map_len;
+  }
+
+  return sizeof(uri_sorted_t)
+       + sizeof(uri_str_t) * 3
+       + sorted->index_buf->allocated
+       + sorted->data_buf->allocated
+       + sorted->last->allocated;
+}
+
+static
+void sorted_save(pTHX_ uri_sorted_t *sorted, const char *path) {
+  U8 header[URI_SORTED_HEADER];
+  U64 index_len = (sorted->count + sorted->block - 1) / sorted->block * 8;
+  PerlIO *fh;
+
+  Zero(header, URI_SORTED_HEADER, U8);
+  Copy(URI_SORTED_MAGIC, header, 8, U8);
+  bloom_write64(&header[8], sorted->count);
+  bloom_write64(&header[16], sorted->block); // u32 followed by reserved zeroes
+  bloom_write64(&header[24], sorted->data_len);
+
+  fh = PerlIO_open(path, "wb");
+
+  if (fh == NULL) {
+    croak("URI::Fast::Sorted::save: unable to open %s: %s", path, Strerror(errno));
+  }
+
+  if (PerlIO_write(fh, header, URI_SORTED_HEADER) != URI_SORTED_HEADER
+   || (index_len > 0 && PerlIO_write(fh, sorted->index, index_len) != (SSize_t) index_len)
+   || (sorted->data_len > 0 && PerlIO_write(fh, sorted->data, sorted->data_len) != (SSize_t) sorted->data_len))
+  {
+    PerlIO_close(fh);
+    croak("URI::Fast::Sorted::save: error writing %s: %s", path, Strerror(errno));
+  }
+
+  if (PerlIO_close(fh) != 0) {
+    croak("URI::Fast::Sorted::save: error writing %s: %s", path, Strerror(errno));
+  }
+}
+
+// Points a list at a buffer holding its serialized form. Returns false if the
+// buffer does not hold a valid list.
+static
+int sorted_attach(uri_sorted_t *sorted, U8 *map, size_t map_len) {
+  U64 count, block, data_len, index_len;
+
+  if (map_len < URI_SORTED_HEADER || memcmp(map, URI_SORTED_MAGIC, 8) != 0) {
+    return 0;
+  }
+
+  count    = hash_read64(&map[8]);
+  block    = hash_read32(&map[16]);
+  data_len = hash_read64(&map[24]);
+
+  if (block == 0 || count > map_len) {
+    return 0;
+  }
+
+  index_len = (count + block - 1) / block * 8;
+
+  if (data_len > map_len || URI_SORTED_HEADER + index_len + data_len != (U64) map_len) {
+    return 0;
+  }
+
+  sorted->count    = count;
+  sorted->block    = (U32) block;
+  sorted->index    = &map[URI_SORTED_HEADER];
+  sorted->data     = &map[URI_SORTED_HEADER + index_len];
+  sorted->data_len = data_len;
+  sorted->readonly = 1;
+  sorted->map      = map;
+  sorted->map_len  = map_len;
+
+  return 1;
+}
+
+/*
+ * Loads a list written with sorted_save. Where mmap is available, the file is
+ * mapped read-only and shared between processes. Loaded lists are read-only.
+ */
+static
+uri_sorted_t* sorted_load(pTHX_ const char *path) {
+  uri_sorted_t *sorted = sorted_alloc(aTHX);
+  size_t len;
+  int mapped;
+  char *map = file_map(aTHX_ "URI::Fast::Sorted::load", path, &len, &mapped);
+
+  if (map == NULL || !sorted_attach(sorted, (U8*) map, len)) {
+    if (map != NULL) file_unmap(aTHX_ map, len, mapped);
+    sorted_free(aTHX_ sorted);
+    croak("URI::Fast::Sorted::load: %s is not a sorted URI list", path);
+  }
+
+  sorted->mapped = mapped;
+
+  return sorted;
+}
+
+// Copies are held in memory. Copies of loaded lists remain read-only.
+static
+uri_sorted_t* sorted_copy(pTHX_ uri_sorted_t *from) {
+  uri_sorted_t *sorted;
+  U8 *map;
+
+  if (from->map != NULL) {
+    sorted = sorted_alloc(aTHX);
+    Newx(map, from->map_len, U8);
+    Copy(from->map, map, from->map_len, U8);
+    sorted_attach(sorted, map, from->map_len);
+    return sorted;
+  }
+
+  sorted = sorted_new(aTHX);
+  str_copy(aTHX_ from->index_buf, sorted->index_buf);
+  str_copy(aTHX_ from->data_buf, sorted->data_buf);
+  str_copy(aTHX_ from->last, sorted->last);
+  sorted->count    = from->count;
+  sorted->index    = (const U8*) sorted->index_buf->string;
+  sorted->data     = (const U8*) sorted->data_buf->string;
+  sorted->data_len = sorted->data_buf->length;
+
+  return sorted;
+}
+
+URI_DUP_VTBL(sorted, uri_sorted_t, sorted_copy)
+
+/*------------------------------------------------------------------------------
+ * Link extraction
+ *
+ * An incremental HTML tokenizer which finds the values of href and src
+ * attributes in HTML fed to it in arbitrary chunks. The tokenizer's state,
+ * including any partial tag or attribute value, is carried across chunks. It
+ * follows the states of the WHATWG tokenizer closely enough to correctly skip
+ * comments, end tags, and the contents of raw text elements like <script>,
+ * but does not otherwise attempt to recover from malformed markup.
+ *----------------------------------------------------------------------------*/
+#define URI_LINKS(obj) \
+  (((sv_isobject(obj) && sv_derived_from(obj, "URI::Fast::Links")) ? NULL : croak("error: expected instance of URI::Fast::Links")), \
+    ((uri_links_t*) SvIV(SvRV((obj)))))
+
+// Longest tag or attribute name tracked; longer names are never of interest
+#define URI_LINKS_NAME_MAX 15
+
+enum {
+  LINKS_DATA,
+  LINKS_TAG_OPEN,
+  LINKS_END_TAG_OPEN,
+  LINKS_TAG_NAME,
+  LINKS_BEFORE_ATTR,
+  LINKS_ATTR_NAME,
+  LINKS_AFTER_ATTR,
+  LINKS_BEFORE_VALUE,
+  LINKS_VALUE_DQ,
+  LINKS_VALUE_SQ,
+  LINKS_VALUE_UQ,
+  LINKS_MARKUP,
+  LINKS_COMMENT,
+  LINKS_BOGUS,
+  LINKS_RAW,
+  LINKS_RAW_END,
+};
+
+typedef struct {
+  int       state;
+  char      tag[URI_LINKS_NAME_MAX + 1];  // lower cased tag name
+  U8        tag_len;
+  U8        end_tag;                      // true if the tag is an end tag
+  char      attr[URI_LINKS_NAME_MAX + 1]; // lower cased attribute name
+  U8        attr_len;
+  char      raw[URI_LINKS_NAME_MAX + 1];  // raw text element being skipped
+  U8        raw_len;
+  U8        matched;                      // chars of the raw text end tag or comment end seen
+  uri_str_t *value;                       // attribute value
+  SV        *base;                        // base URI::Fast object, or NULL
+  int       base_seen;                    // true once a <base href> has been seen
+  SV        *rel;                         // reused object for scanning values
+} uri_links_t;
+
+static
+uri_links_t* links_new(pTHX_ SV *base) {
+  uri_links_t *links;
+
+  Newxz(links, 1, uri_links_t);
+  links->value = str_new(aTHX_ 256);
+  links->rel   = new(aTHX_ "URI::Fast", &PL_sv_undef, 0);
+
+  if (base != NULL && SvOK(base)) {
+    links->base = new(aTHX_ "URI::Fast", base, 0);
+  }
+
+  return links;
+}
+
+static
+void links_free(pTHX_ uri_links_t *links) {
+  str_free(aTHX_ links->value);
+  SvREFCNT_dec(links->rel);
+
+  if (links->base != NULL) {
+    SvREFCNT_dec(links->base);
+  }
+
+  Safefree(links);
+}
+
+// Appends a lower cased char to a tag or attribute name. Names longer than
+// URI_LINKS_NAME_MAX are marked with a length which never matches.
+static inline
+void links_name_add(char *name, U8 *len, char c) {
+  if (*len < URI_LINKS_NAME_MAX) {
+    name[(*len)++] = toLOWER(c);
+  } else {
+    *len = URI_LINKS_NAME_MAX + 1;
+  }
+}
+
+#define LINKS_NAME_IS(name, len, lit) \
+  ((len) == sizeof(lit) - 1 && memcmp((name), (lit), sizeof(lit) - 1) == 0)
+
+// Elements whose contents are not parsed for tags
+static
+int links_is_raw(const char *tag, U8 len) {
+  return LINKS_NAME_IS(tag, len, "script")
+      || LINKS_NAME_IS(tag, len, "style")
+      || LINKS_NAME_IS(tag, len, "textarea")
+      || LINKS_NAME_IS(tag, len, "title")
+      || LINKS_NAME_IS(tag, len, "xmp")
+      || LINKS_NAME_IS(tag, len, "iframe")
+      || LINKS_NAME_IS(tag, len, "noembed")
+      || LINKS_NAME_IS(tag, len, "noframes");
+}
+
+/*
+ * Decodes character references in place: the numeric forms and the named
+ * references amp, lt, gt, quot, and apos. Named references must be terminated
+ * by a semicolon. The decoded form is never longer than the reference.
+ */
+static
+size_t links_decode_refs(char *s, size_t len) {
+  static const struct { const char *name; size_t len; char c; } named[] = {
+    {"amp;", 4, '&'}, {"lt;", 3, '<'}, {"gt;", 3, '>'}, {"quot;", 5, '"'}, {"apos;", 5, '\''},
+  };
+
+  size_t r = 0, w = 0, i, n;
+  U32 cp;
+  int hex;
+
+  while (r < len) {
+    if (s[r] != '&') {
+      s[w++] = s[r++];
+      continue;
+    }
+
+    if (r + 2 < len && s[r + 1] == '#') {
+      hex = (s[r + 2] == 'x' || s[r + 2] == 'X');
+      i   = r + 2 + hex;
+      cp  = 0;
+
+      for (n = 0; i < len && (hex ? isXDIGIT(s[i]) : isDIGIT(s[i])); ++i, ++n) {
+        if (cp <= 0x10FFFF) {
+          cp = cp * (hex ? 16 : 10) + (isDIGIT(s[i]) ? s[i] - '0' : (toLOWER(s[i]) - 'a' + 10));
+        }
+      }
+
+      if (n > 0) {
+        if (i < len && s[i] == ';') ++i;
+        if (cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) cp = 0xFFFD;
+        w += idn_utf8_encode(cp, &s[w]);
+        r  = i;
+        continue;
+      }
+    }
+    else {
+      for (i = 0; i < sizeof(named) / sizeof(named[0]); ++i) {
+        if (len - r - 1 >= named[i].len && memcmp(&s[r + 1], named[i].name, named[i].len) == 0) {
+          break;
+        }
+      }
+
+      if (i < sizeof(named) / sizeof(named[0])) {
+        s[w++] = named[i].c;
+        r += 1 + named[i].len;
+        continue;
+      }
+    }
+
+    s[w++] = s[r++];
+  }
+
+  return w;
+}
+
+/*
+ * Turns the completed attribute value into a URI::Fast object, applying the
+ * same clean up as html_url and resolving it against the base, if any.
+ */
+static
+SV* links_resolve(pTHX_ uri_links_t *links) {
+  char *s = links->value->string;
+  size_t len = links_decode_refs(s, links->value->length);
+  size_t i, w = 0;
+  SV *out;
+
+  for (i = 0; i < len; ++i) {
+    switch (s[i]) {
+      case '\t':
+      case '\r':
+      case '\n':
+        break;
+      case '\\':
+        s[w++] = '/';
+        break;
+      default:
+        s[w++] = s[i];
+        break;
+    }
+  }
+
+  out = new(aTHX_ "URI::Fast", &PL_sv_undef, 0);
+
+  if (links->base == NULL) {
+    uri_scan(aTHX_ URI(out), s, w);
+  }
+  else {
+    uri_t *rel = URI(links->rel);
+    uri_clear(aTHX_ rel);
+    uri_scan(aTHX_ rel, s, w);
+    absolute(aTHX_ out, links->rel, links->base);
+  }
+
+  normalize(aTHX_ out, 0);
+
+  return out;
+}
+
+// Called at the end of each attribute value
+static
+void links_value(pTHX_ uri_links_t *links, AV *found) {
+  SV *uri;
+
+  if (links->end_tag) {
+    return;
+  }
+
+  if (LINKS_NAME_IS(links->attr, links->attr_len, "href")) {
+    uri = links_resolve(aTHX_ links);
+
+    // The first <base href> sets the base for subsequent links
+    if (LINKS_NAME_IS(links->tag, links->tag_len, "base")) {
+      if (!links->base_seen) {
+        if (links->base != NULL) SvREFCNT_dec(links->base);
+        links->base = uri;
+        links->base_seen = 1;
+      } else {
+        SvREFCNT_dec(uri);
+      }
+
+      return;
+    }
+
+    av_push(found, uri);
+  }
+  else if (LINKS_NAME_IS(links->attr, links->attr_len, "src")) {
+    av_push(found, links_resolve(aTHX_ links));
+  }
+}
+
+// Called at the end of each tag
+static inline
+void links_tag_end(uri_links_t *links) {
+  if (!links->end_tag && links_is_raw(links->tag, links->tag_len)) {
+    Copy(links->tag, links->raw, links->tag_len, char);
+    links->raw_len = links->tag_len;
+    links->matched = 0;
+    links->state   = LINKS_RAW;
+  } else {
+    links->state = LINKS_DATA;
+  }
+}
+
+#define LINKS_IS_WS(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r' || (c) == '\f')
+
+/*
+ * Feeds a chunk of HTML to the tokenizer, pushing a URI::Fast object onto
+ * found for each link completed within it.
+ */
+static
+void links_push(pTHX_ uri_links_t *links, const char *src, size_t len, AV *found) {
+  const char *hit;
+  size_t i = 0;
+  char c, q;
+
+  while (i < len) {
+    c = src[i];
+
+    switch (links->state) {
+      case LINKS_DATA:
+        hit = (const char*) memchr(&src[i], '<', len - i);
+        if (hit == NULL) return;
+        i = hit - src + 1;
+        links->state = LINKS_TAG_OPEN;
+        continue;
+
+      case LINKS_TAG_OPEN:
+        if (c == '!') {
+          links->matched = 0;
+          links->state = LINKS_MARKUP;
+        }
+        else if (c == '/') {
+          links->state = LINKS_END_TAG_OPEN;
+        }
+        else if (isALPHA(c)) {
+          links->tag_len = 0;
+          links->end_tag = 0;
+          links_name_add(links->tag, &links->tag_len, c);
+          links->state = LINKS_TAG_NAME;
+        }
+        else if (c == '?') {
+          links->state = LINKS_BOGUS;
+        }
+        else if (c != '<') {
+          links->state = LINKS_DATA;
+        }
+        break;
+
+      case LINKS_END_TAG_OPEN:
+        if (isALPHA(c)) {
+          links->tag_len = 0;
+          links->end_tag = 1;
+          links_name_add(links->tag, &links->tag_len, c);
+          links->state = LINKS_TAG_NAME;
+        }
+        else {
+          links->state = c == '>' ? LINKS_DATA : LINKS_BOGUS;
+        }
+        break;
+
+      case LINKS_TAG_NAME:
+        if (LINKS_IS_WS(c) || c == '/') {
+          links->state = LINKS_BEFORE_ATTR;
+        }
+        else if (c == '>') {
+          links_tag_end(links);
+        }
+        else {
+          links_name_add(links->tag, &links->tag_len, c);
+        }
+        break;
+
+      case LINKS_BEFORE_ATTR:
+        if (c == '>') {
+          links_tag_end(links);
+        }
+        else if (!LINKS_IS_WS(c) && c != '/') {
+          links->attr_len = 0;
+          links_name_add(links->attr, &links->attr_len, c);
+          links->state = LINKS_ATTR_NAME;
+        }
+        break;
+
+      case LINKS_ATTR_NAME:
+        if (LINKS_IS_WS(c)) {
+          links->state = LINKS_AFTER_ATTR;
+        }
+        else if (c == '/') {
+          links->state = LINKS_BEFORE_ATTR;
+        }
+        else if (c == '=') {
+          links->state = LINKS_BEFORE_VALUE;
+        }
+        else if (c == '>') {
+          links_tag_end(links);
+        }
+        else {
+          links_name_add(links->attr, &links->attr_len, c);
+        }
+        break;
+
+      case LINKS_AFTER_ATTR:
+        if (c == '/') {
+          links->state = LINKS_BEFORE_ATTR;
+        }
+        else if (c == '=') {
+          links->state = LINKS_BEFORE_VALUE;
+        }
+        else if (c == '>') {
+          links_tag_end(links);
+        }
+        else if (!LINKS_IS_WS(c)) {
+          links->attr_len = 0;
+          links_name_add(links->attr, &links->attr_len, c);
+          links->state = LINKS_ATTR_NAME;
+        }
+        break;
+
+      case LINKS_BEFORE_VALUE:
+        if (LINKS_IS_WS(c)) {
+          break;
+        }
+
+        str_clear(aTHX_ links->value);
+
+        if (c == '"') {
+          links->state = LINKS_VALUE_DQ;
+        }
+        else if (c == '\'') {
+          links->state = LINKS_VALUE_SQ;
+        }
+        else if (c == '>') {
+          links_tag_end(links);
+        }
+        else {
+          str_append(aTHX_ links->value, &c, 1);
+          links->state = LINKS_VALUE_UQ;
+        }
+        break;
+
+      case LINKS_VALUE_DQ:
+      case LINKS_VALUE_SQ:
+        q   = links->state == LINKS_VALUE_DQ ? '"' : '\'';
+        hit = (const char*) memchr(&src[i], q, len - i);
+
+        if (hit == NULL) {
+          str_append(aTHX_ links->value, &src[i], len - i);
+          return;
+        }
+
+        str_append(aTHX_ links->value, &src[i], hit - &src[i]);
+        i = hit - src + 1;
+        links_value(aTHX_ links, found);
+        links->state = LINKS_BEFORE_ATTR;
+        continue;
+
+      case LINKS_VALUE_UQ:
+        if (LINKS_IS_WS(c)) {
+          links_value(aTHX_ links, found);
+          links->state = LINKS_BEFORE_ATTR;
+        }
+        else if (c == '>') {
+          links_value(aTHX_ links, found);
+          links_tag_end(links);
+        }
+        else {
+          str_append(aTHX_ links->value, &c, 1);
+        }
+        break;
+
+      // After "<!"; two dashes begin a comment, anything else is skipped
+      case LINKS_MARKUP:
+        if (c == '-' && links->matched == 0) {
+          links->matched = 1;
+        }
+        else if (c == '-') {
+          // "<!--" is treated as if already followed by "--", so that the
+          // abruptly closed "<!-->" and "<!--->" end the comment
+          links->matched = 2;
+          links->state = LINKS_COMMENT;
+        }
+        else {
+          links->state = c == '>' ? LINKS_DATA : LINKS_BOGUS;
+        }
+        break;
+
+      // matched counts the dashes preceding the current char
+      case LINKS_COMMENT:
+        if (c == '-') {
+          ++links->matched;
+        }
+        else if (c == '>' && links->matched >= 2) {
+          links->state = LINKS_DATA;
+        }
+        else {
+          links->matched = 0;
+        }
+        break;
+
+      case LINKS_BOGUS:
+        hit = (const char*) memchr(&src[i], '>', len - i);
+        if (hit == NULL) return;
+        i = hit - src + 1;
+        links->state = LINKS_DATA;
+        continue;
+
+      // Skips to the end tag of a raw text element
+      case LINKS_RAW:
+        hit = (const char*) memchr(&src[i], '<', len - i);
+        if (hit == NULL) return;
+        i = hit - src + 1;
+        links->matched = 0;
+        links->state = LINKS_RAW_END;
+        continue;
+
+      // matched counts the chars of "/name" seen following "<"
+      case LINKS_RAW_END:
+        if (links->matched == 0) {
+          links->matched = c == '/';
+        }
+        else if (links->matched <= links->raw_len) {
+          links->matched = toLOWER(c) == links->raw[links->matched - 1] ? links->matched + 1 : 0;
+        }
+        else if (LINKS_IS_WS(c) || c == '/' || c == '>') {
+          links->state = c == '>' ? LINKS_DATA : LINKS_BOGUS;
+          break;
+        }
+        else {
+          links->matched = 0;
+        }
+
+        if (links->matched == 0) {
+          links->state = LINKS_RAW;
+
+          // Reconsume: this char may begin another end tag
+          if (c == '<') {
+            links->state = LINKS_RAW_END;
+          }
+        }
+        break;
+    }
+
+    ++i;
+  }
+}
+
+static
+void links_reset(pTHX_ uri_links_t *links, SV *base) {
+  links->state     = LINKS_DATA;
+  links->base_seen = 0;
+  str_clear(aTHX_ links->value);
+
+  if (links->base != NULL) {
+    SvREFCNT_dec(links->base);
+    links->base = NULL;
+  }
+
+  if (base != NULL && SvOK(base)) {
+    links->base = new(aTHX_ "URI::Fast", base, 0);
+  }
+}
+
+
+MODULE = URI::Fast  PACKAGE = URI::Fast
+
+PROTOTYPES: DISABLE
 
 FALLBACK: TRUE
 
+BOOT:
+{
+  MY_CXT_INIT;
+  MY_CXT.psl = NULL;
+  call_atexit(psl_teardown, NULL);
+}
+
+#-------------------------------------------------------------------------------
+# Threads
+#-------------------------------------------------------------------------------
+void CLONE(class)
+  const char *class
+  CODE:
+    // Perl calls CLONE for each package, including subclasses which inherit it
+    if (strEQ(class, "URI::Fast")) {
+      MY_CXT_CLONE; // copies the parent's context, including its psl pointer
+
+      if (MY_CXT.psl != NULL) {
+        MY_CXT.psl = psl_copy(aTHX_ MY_CXT.psl);
+      }
+
+      call_atexit(psl_teardown, NULL);
+    }
+
+#-------------------------------------------------------------------------------
+# Serialization
+#-------------------------------------------------------------------------------
+SV* STORABLE_freeze(uri_obj, cloning)
+  SV *uri_obj
+  SV *cloning
+  ALIAS:
+    FREEZE = 1
+  CODE:
+    PERL_UNUSED_VAR(cloning);
+    PERL_UNUSED_VAR(ix);
+    RETVAL = uri_freeze(aTHX_ URI(uri_obj));
+  OUTPUT:
+    RETVAL
+
+void STORABLE_thaw(uri_obj, cloning, frozen)
+  SV *uri_obj
+  SV *cloning
+  SV *frozen
+  PREINIT:
+    SV *inner;
+  CODE:
+    PERL_UNUSED_VAR(cloning);
+
+    // Storable passes a new object: a blessed reference to an undefined scalar
+    if (!sv_isobject(uri_obj) || SvOK(SvRV(uri_obj))) {
+      croak("URI::Fast::STORABLE_thaw: expected a new object");
+    }
+
+    inner = SvRV(uri_obj);
+    sv_setiv(inner, (IV) uri_thaw(aTHX_ "URI::Fast::STORABLE_thaw", frozen));
+    URI_THREADSAFE(inner, uri);
+
+SV* THAW(class, serializer, frozen)
+  const char *class
+  SV *serializer
+  SV *frozen
+  CODE:
+    SV *obj;
+    PERL_UNUSED_VAR(serializer);
+    obj = newSViv((IV) uri_thaw(aTHX_ "URI::Fast::THAW", frozen));
+    URI_THREADSAFE(obj, uri);
+    RETVAL = newRV_noinc(obj);
+    sv_bless(RETVAL, gv_stashpv(class, GV_ADD));
+  OUTPUT:
+    RETVAL
+
+#-------------------------------------------------------------------------------
+# Statistics
+#-------------------------------------------------------------------------------
+SV* stats()
+  CODE:
+#ifdef URI_STATS
+    HV *stats = newHV();
+#define URI_STATS_STORE(name) hv_stores(stats, #name, newSVuv(uri_stats.name));
+    URI_STATS_MEMBERS(URI_STATS_STORE)
+#undef URI_STATS_STORE
+    RETVAL = newRV_noinc((SV*) stats);
+#else
+    RETVAL = newSV(0);
+#endif
+  OUTPUT:
+    RETVAL
+
+void reset_stats()
+  CODE:
+#ifdef URI_STATS
+    Zero(&uri_stats, sizeof(uri_stats), char);
+#endif
+
+#-------------------------------------------------------------------------------
+# URL-encoding
+#-------------------------------------------------------------------------------
+SV* encode(in, ...)
+  SV *in
+  ALIAS:
+    uri_encode = 1
+    url_encode = 2
+  PREINIT:
+    SV *temp = NULL;
+  CODE:
+    if (items > 1) {
+      temp = ST(1);
+    }
+    RETVAL = encode(aTHX_ in, temp);
+  OUTPUT:
+    RETVAL
+
+SV* decode(in)
+  SV* in
+  ALIAS:
+    uri_decode = 1
+    url_decode = 2
+  CODE:
+    RETVAL = decode(aTHX_ in);
+  OUTPUT:
+    RETVAL
+
+#-------------------------------------------------------------------------------
+# Constructors and destructors
+#-------------------------------------------------------------------------------
+void DESTROY(uri_obj)
+  SV *uri_obj
+  CODE:
+    DESTROY(aTHX_ uri_obj);
+
+SV* new(class, uri_str)
+  const char *class
+  SV* uri_str
+  ALIAS:
+    new_iri = 1
+  CODE:
+    if (ix == 1) {
+      RETVAL = new(aTHX_ "URI::Fast::IRI", uri_str, 1);
+    } else {
+      RETVAL = new(aTHX_ class, uri_str, 0);
+    }
+  OUTPUT:
+    RETVAL
+
+void reparse(uri_obj, uri_str)
+  SV *uri_obj
+  SV *uri_str
+  PPCODE:
+    reparse(aTHX_ uri_obj, uri_str);
+    XSRETURN(1);
+
+SV* new_abs(class, rel, base)
+  const char *class
+  SV *rel
+  SV *base
+  PREINIT:
+    SV *abs;
+  CODE:
+    if (!sv_isobject(rel) || !sv_derived_from(rel, class)) {
+      rel = sv_2mortal(new(aTHX_ class, rel, 0));
+    }
+
+    if (!sv_isobject(base) || !sv_derived_from(base, class)) {
+      base = sv_2mortal(new(aTHX_ class, base, 0));
+    }
+
+    abs = new(aTHX_ class, sv_2mortal(newSVpvn("", 0)), 0);
+    absolute(aTHX_ abs, rel, base);
+    RETVAL = abs;
+  OUTPUT:
+    RETVAL
+
+SV* new_html_url(class, url, ...)
+  const char *class
+  SV *url
+  PREINIT:
+    SV *base = NULL;
+    SV *rel;
+    SV *abs;
+  CODE:
+    if (items > 2) {
+      if (!sv_isobject(ST(2)) || !sv_derived_from(ST(2), "URI::Fast")) {
+        base = sv_2mortal(new(aTHX_ "URI::Fast", ST(2), 0));
+      } else {
+        base = ST(2);
+      }
+
+      rel = new(aTHX_ "URI::Fast", sv_2mortal(html_url(aTHX_ url, base)), 0);
+      abs = new(aTHX_ "URI::Fast", sv_2mortal(newSVpvn("", 0)), 0);
+      absolute(aTHX_ abs, sv_2mortal(rel), base);
+      normalize(aTHX_ abs, 0);
+      RETVAL = abs;
+    }
+    else {
+      rel = new(aTHX_ class, sv_2mortal(html_url(aTHX_ url, base)), 0);
+      normalize(aTHX_ rel, 0);
+      RETVAL = rel;
+    }
+
+  OUTPUT:
+    RETVAL
+
+#-------------------------------------------------------------------------------
+# Short-hand constructors
+#-------------------------------------------------------------------------------
+SV* uri(...)
+  ALIAS:
+    iri   = 1
+    clone = 2
+  PREINIT:
+    SV *uri_str;
+  CODE:
+    if (items == 0) {
+      uri_str = sv_2mortal(newSVpvn("", 0));
+    } else {
+      uri_str = ST(0);
+    }
+
+    if (ix == 1) {
+      RETVAL = new(aTHX_ "URI::Fast::IRI", uri_str, 1);
+    } else {
+      RETVAL = new(aTHX_ "URI::Fast", uri_str, 0);
+    }
+  OUTPUT:
+    RETVAL
+
+SV* abs_uri(rel, base)
+  SV *rel
+  SV *base
+  PREINIT:
+    SV *abs;
+  CODE:
+    if (!sv_isobject(rel) || !sv_derived_from(rel, "URI::Fast")) {
+      rel = sv_2mortal(new(aTHX_ "URI::Fast", rel, 0));
+    }
+
+    if (!sv_isobject(base) || !sv_derived_from(base, "URI::Fast")) {
+      base = sv_2mortal(new(aTHX_ "URI::Fast", base, 0));
+    }
+
+    abs = new(aTHX_ "URI::Fast", sv_2mortal(newSVpvn("", 0)), 0);
+    absolute(aTHX_ abs, rel, base);
+    RETVAL = abs;
+  OUTPUT:
+    RETVAL
+
+SV* html_url(url, ...)
+  SV *url
+  PREINIT:
+    SV *base = NULL;
+    SV *abs;
+    SV *rel;
+  CODE:
+    if (items > 1) {
+      if (!sv_isobject(ST(1)) || !sv_derived_from(ST(1), "URI::Fast")) {
+        base = sv_2mortal(new(aTHX_ "URI::Fast", ST(1), 0));
+      } else {
+        base = ST(1);
+      }
+
+      rel = new(aTHX_ "URI::Fast", sv_2mortal(html_url(aTHX_ url, base)), 0);
+      abs = new(aTHX_ "URI::Fast", sv_2mortal(newSVpvn("", 0)), 0);
+      absolute(aTHX_ abs, sv_2mortal(rel), base);
+      normalize(aTHX_ abs, 0);
+      RETVAL = abs;
+    }
+    else {
+      rel = new(aTHX_ "URI::Fast", sv_2mortal(html_url(aTHX_ url, base)), 0);
+      normalize(aTHX_ rel, 0);
+      RETVAL = rel;
+    }
+  OUTPUT:
+    RETVAL
+
+#-------------------------------------------------------------------------------
+# Clearers
+#-------------------------------------------------------------------------------
+void clear_scheme(uri_obj)
+  SV* uri_obj
+  CODE:
+    clear_scheme(aTHX_ uri_obj);
+
+void clear_path(uri_obj)
+  SV* uri_obj
+  CODE:
+    clear_path(aTHX_ uri_obj);
+
+void clear_query (uri_obj)
+  SV* uri_obj
+  CODE:
+    clear_query(aTHX_ uri_obj);
+
+void clear_frag(uri_obj)
+  SV* uri_obj
+  CODE:
+    clear_frag(aTHX_ uri_obj);
+
+void clear_usr(uri_obj)
+  SV* uri_obj
+  CODE:
+    clear_usr(aTHX_ uri_obj);
+
+void clear_pwd(uri_obj)
+  SV* uri_obj
+  CODE:
+    clear_pwd(aTHX_ uri_obj);
+
+void clear_host(uri_obj)
+  SV* uri_obj
+  CODE:
+    clear_host(aTHX_ uri_obj);
+
+void clear_port(uri_obj)
+  SV* uri_obj
+  CODE:
+    clear_port(aTHX_ uri_obj);
+
+void clear_auth(uri_obj)
+  SV* uri_obj
+  CODE:
+    clear_auth(aTHX_ uri_obj);
+
+#-------------------------------------------------------------------------------
+# Raw accessors
+#-------------------------------------------------------------------------------
+SV* raw_scheme(uri_obj, ...)
+  SV *uri_obj
+  CODE:
+    if (items > 1) set_raw_scheme(aTHX_ uri_obj, ST(1));
+    RETVAL = get_raw_scheme(aTHX_ uri_obj);
+  OUTPUT:
+    RETVAL
+
+SV* raw_auth(uri_obj, ...)
+  SV *uri_obj
+  CODE:
+    if (items > 1) set_raw_auth(aTHX_ uri_obj, ST(1));
+    RETVAL = get_raw_auth(aTHX_ uri_obj);
+  OUTPUT:
+    RETVAL
+
+SV* raw_path(uri_obj, ...)
+  SV *uri_obj
+  CODE:
+    if (items > 1) set_raw_path(aTHX_ uri_obj, ST(1));
+    RETVAL = get_raw_path(aTHX_ uri_obj);
+  OUTPUT:
+    RETVAL
+
+SV* raw_query(uri_obj, ...)
+  SV *uri_obj
+  CODE:
+    if (items > 1) set_raw_query(aTHX_ uri_obj, ST(1));
+    RETVAL = get_raw_query(aTHX_ uri_obj);
+  OUTPUT:
+    RETVAL
+
+SV* raw_frag(uri_obj, ...)
+  SV *uri_obj
+  CODE:
+    if (items > 1) set_raw_frag(aTHX_ uri_obj, ST(1));
+    RETVAL = get_raw_frag(aTHX_ uri_obj);
+  OUTPUT:
+    RETVAL
+
+SV* raw_usr(uri_obj, ...)
+  SV *uri_obj
+  CODE:
+    if (items > 1) set_raw_usr(aTHX_ uri_obj, ST(1));
+    RETVAL = get_raw_usr(aTHX_ uri_obj);
+  OUTPUT:
+    RETVAL
+
+SV* raw_pwd(uri_obj, ...)
+  SV *uri_obj
+  CODE:
+    if (items > 1) set_raw_pwd(aTHX_ uri_obj, ST(1));
+    RETVAL = get_raw_pwd(aTHX_ uri_obj);
+  OUTPUT:
+    RETVAL
+
+SV* raw_host(uri_obj, ...)
+  SV *uri_obj
+  CODE:
+    if (items > 1) set_raw_host(aTHX_ uri_obj, ST(1));
+    RETVAL = get_raw_host(aTHX_ uri_obj);
+  OUTPUT:
+    RETVAL
+
+SV* raw_port(uri_obj, ...)
+  SV *uri_obj
+  CODE:
+    if (items > 1) set_raw_port(aTHX_ uri_obj, ST(1));
+    RETVAL = get_raw_port(aTHX_ uri_obj);
+  OUTPUT:
+    RETVAL
+
+
+#-------------------------------------------------------------------------------
+# Compound getters
+#-------------------------------------------------------------------------------
+SV* get_path(uri_obj)
+  SV *uri_obj
+  CODE:
+    RETVAL = get_path(aTHX_ uri_obj);
+  OUTPUT:
+    RETVAL
+
+SV* get_query(uri_obj)
+  SV *uri_obj
+  CODE:
+    RETVAL = get_query(aTHX_ uri_obj);
+  OUTPUT:
+    RETVAL
+
+SV* get_auth(uri_obj)
+  SV *uri_obj
+  CODE:
+    RETVAL = get_auth(aTHX_ uri_obj);
+  OUTPUT:
+    RETVAL
+
+SV* split_path(uri)
+  SV* uri
+  ALIAS:
+    split_path_compat = 1
+  CODE:
+    RETVAL = split_path(aTHX_ uri, ix == 1 ? 1 : 0);
+  OUTPUT:
+    RETVAL
+
+SV* get_query_keys(uri)
+  SV* uri
+  CODE:
+    RETVAL = get_query_keys(aTHX_ uri);
+  OUTPUT:
+    RETVAL
+
+SV* get_query_hash(uri)
+  SV* uri
+  CODE:
+    RETVAL = query_hash(aTHX_ uri);
+  OUTPUT:
+    RETVAL
+
+SV* get_param(uri, sv_key)
+  SV* uri
+  SV* sv_key
+  CODE:
+    RETVAL = get_param(aTHX_ uri, sv_key);
+  OUTPUT:
+    RETVAL
+
+
+#-------------------------------------------------------------------------------
+# Compound setters
+#-------------------------------------------------------------------------------
+void set_auth(uri_obj, value)
+  SV *uri_obj
+  SV *value
+  CODE:
+    set_auth(aTHX_ uri_obj, value);
+
+void set_path(uri_obj, value)
+  SV *uri_obj
+  SV *value
+  CODE:
+    set_path(aTHX_ uri_obj, value);
+
+void set_path_array(uri_obj, segments)
+  SV *uri_obj
+  SV *segments
+  CODE:
+    set_path_array(aTHX_ uri_obj, segments);
+
+void set_query(uri_obj, value)
+  SV *uri_obj
+  SV *value
+  CODE:
+    set_query(aTHX_ uri_obj, value);
+
+void set_param(uri, sv_key, sv_values, sv_separator)
+  SV *uri
+  SV *sv_key
+  SV *sv_values
+  SV *sv_separator
+  CODE:
+    set_param(aTHX_ uri, sv_key, sv_values, sv_separator);
+
+void query_keyset(self, sv_key_set, ...)
+  SV *self
+  SV *sv_key_set
+  CODE:
+    SV *sv_separator = items > 2 ? ST(2) : sv_2mortal(newSVpvn("&", 1));
+    update_query_keyset(aTHX_ self, sv_key_set, sv_separator);
+
+
+#-------------------------------------------------------------------------------
+# Unified accessors
+#-------------------------------------------------------------------------------
+SV* scheme(self, ...)
+  SV *self
+  CODE:
+    if (items > 1) set_scheme(aTHX_ self, ST(1));
+    RETVAL = get_scheme(aTHX_ self);
+  OUTPUT:
+    RETVAL
+
+SV* usr(self, ...)
+  SV *self
+  CODE:
+    if (items > 1) set_usr(aTHX_ self, ST(1));
+    RETVAL = get_usr(aTHX_ self);
+  OUTPUT:
+    RETVAL
+
+SV* pwd(self, ...)
+  SV *self
+  CODE:
+    if (items > 1) set_pwd(aTHX_ self, ST(1));
+    RETVAL = get_pwd(aTHX_ self);
+  OUTPUT:
+    RETVAL
+
+SV* host(self, ...)
+  SV *self
+  CODE:
+    if (items > 1) set_host(aTHX_ self, ST(1));
+    RETVAL = get_host(aTHX_ self);
+  OUTPUT:
+    RETVAL
+
+SV* port(self, ...)
+  SV *self
+  CODE:
+    if (items > 1) set_port(aTHX_ self, ST(1));
+    RETVAL = get_port(aTHX_ self);
+  OUTPUT:
+    RETVAL
+
+SV* frag(self, ...)
+  SV *self
+  ALIAS:
+    fragment = 1
+  CODE:
+    if (items > 1) set_frag(aTHX_ self, ST(1));
+    RETVAL = get_frag(aTHX_ self);
+  OUTPUT:
+    RETVAL
+
+
 #-------------------------------------------------------------------------------
-# URL-encoding
+# Extras
 #-------------------------------------------------------------------------------
-SV* encode(in, ...)
-  SV *in
+SV* to_string(self, ...)
+  SV *self
   ALIAS:
-    uri_encode = 1
-    url_encode = 2
+    as_string = 1
+    TO_JSON = 2
+  OVERLOAD:
+    to_string \"\"
+  CODE:
+    RETVAL = to_string(aTHX_ self);
+  OUTPUT:
+    RETVAL
+
+void append_to(self, buf)
+  SV *self
+  SV *buf
+  CODE:
+    append_to(aTHX_ self, buf);
+
+SV* normalize(uri, ...)
+  SV *uri
+  ALIAS:
+    canonical = 1
   PREINIT:
-    SV *temp = NULL;
+    int i, idn = 0;
+    const char *opt, *val;
   CODE:
-    if (items > 1) {
-      temp = ST(1);
+    if (items % 2 == 0) {
+      croak("normalize: expected key/value pairs");
     }
-    RETVAL = encode(aTHX_ in, temp);
+
+    for (i = 1; i + 1 < items; i += 2) {
+      opt = SvPV_nolen(ST(i));
+      val = SvPV_nolen(ST(i + 1));
+
+      if (strEQ(opt, "idn") && strEQ(val, "ascii")) {
+        idn = 1;
+      }
+      else if (strEQ(opt, "idn") && strEQ(val, "unicode")) {
+        idn = -1;
+      }
+      else {
+        croak("normalize: invalid option %s => %s", opt, val);
+      }
+    }
+
+    normalize(aTHX_ uri, idn);
+  OUTPUT:
+    uri
+
+UV memory_size(uri)
+  SV *uri
+  CODE:
+    RETVAL = uri_memory_size(URI(uri));
+  OUTPUT:
+    RETVAL
+
+void compact(uri)
+  SV *uri
+  PPCODE:
+    uri_compact(aTHX_ URI(uri));
+    XSRETURN(1);
+
+SV* fingerprint(uri)
+  SV *uri
+  CODE:
+    RETVAL = fingerprint_sv(aTHX_ uri_fingerprint(aTHX_ URI(uri)));
+  OUTPUT:
+    RETVAL
+
+SV* host_type(uri)
+  SV *uri
+  PREINIT:
+    uri_t *u;
+  CODE:
+    u = uri_classified(URI(uri));
+
+    switch (u->host_type) {
+      case URI_HOST_REGNAME:   RETVAL = newSVpvs("reg-name");  break;
+      case URI_HOST_IPV4:      RETVAL = newSVpvs("ipv4");      break;
+      case URI_HOST_IPV6:      RETVAL = newSVpvs("ipv6");      break;
+      case URI_HOST_IPVFUTURE: RETVAL = newSVpvs("ipvfuture"); break;
+      case URI_HOST_INVALID:   RETVAL = newSVpvs("invalid");   break;
+      default:                 RETVAL = newSV(0);
+    }
+  OUTPUT:
+    RETVAL
+
+SV* ip_bytes(uri)
+  SV *uri
+  PREINIT:
+    uri_t *u;
+  CODE:
+    u = uri_classified(URI(uri));
+
+    switch (u->host_type) {
+      case URI_HOST_IPV4: RETVAL = newSVpvn((char*) u->ip, 4);  break;
+      case URI_HOST_IPV6: RETVAL = newSVpvn((char*) u->ip, 16); break;
+      default:            RETVAL = newSV(0);
+    }
+  OUTPUT:
+    RETVAL
+
+SV* host_ascii(uri)
+  SV *uri
+  ALIAS:
+    host_unicode = 1
+  CODE:
+    RETVAL = get_host_idn(aTHX_ uri, ix == 0);
+  OUTPUT:
+    RETVAL
+
+SV* reversed_host(uri)
+  SV *uri
+  CODE:
+    RETVAL = get_reversed_host(aTHX_ uri);
+  OUTPUT:
+    RETVAL
+
+SV* sort_uris(uris, ...)
+  SV *uris
+  PREINIT:
+    const char *by = "host_reversed,path,query";
+    const char *opt;
+    int i;
+  CODE:
+    if (items % 2 == 0) {
+      croak("sort_uris: expected key/value pairs");
+    }
+
+    for (i = 1; i + 1 < items; i += 2) {
+      opt = SvPV_nolen(ST(i));
+
+      if (strEQ(opt, "by")) {
+        by = SvPV_nolen(ST(i + 1));
+      }
+      else {
+        croak("sort_uris: invalid option %s", opt);
+      }
+    }
+
+    RETVAL = sort_uris(aTHX_ uris, by);
+  OUTPUT:
+    RETVAL
+
+SV* public_suffix(uri)
+  SV *uri
+  ALIAS:
+    registrable_domain = 1
+  CODE:
+    RETVAL = get_public_suffix(aTHX_ uri, ix);
+  OUTPUT:
+    RETVAL
+
+void _load_public_suffix_list(list)
+  SV *list
+  CODE:
+    load_public_suffix_list(aTHX_ list);
+
+SV* fingerprint_many(uris)
+  SV *uris
+  CODE:
+    RETVAL = fingerprint_many(aTHX_ uris);
+  OUTPUT:
+    RETVAL
+
+SV* parse_file_parallel(path, ...)
+  const char *path
+  PREINIT:
+    UV threads = 0;
+    int iri = 0, normalized = 0;
+    const char *opt;
+    int i;
+  CODE:
+    if (items % 2 == 0) {
+      croak("parse_file_parallel: expected key/value pairs");
+    }
+
+    for (i = 1; i + 1 < items; i += 2) {
+      opt = SvPV_nolen(ST(i));
+
+      if (strEQ(opt, "threads")) {
+        threads = is_defined(aTHX_ ST(i + 1)) ? SvUV(ST(i + 1)) : 0;
+      }
+      else if (strEQ(opt, "iri")) {
+        iri = SvTRUE(ST(i + 1));
+      }
+      else if (strEQ(opt, "normalized")) {
+        normalized = SvTRUE(ST(i + 1));
+      }
+      else {
+        croak("parse_file_parallel: invalid option %s", opt);
+      }
+    }
+
+    RETVAL = parse_file_parallel(aTHX_ path, threads, iri, normalized);
+  OUTPUT:
+    RETVAL
+
+SV* absolute(rel, base)
+  SV* rel
+  SV* base
+  ALIAS:
+    abs = 1
+  PREINIT:
+    SV *abs;
+    const char *class;
+  CODE:
+    class = class_name(aTHX_ rel);
+    abs = new(aTHX_ class, sv_2mortal(newSVpvn("", 0)), 0);
+
+    if (!sv_isobject(base) || !sv_derived_from(base, class)) {
+      base = sv_2mortal(new(aTHX_ class, base, 0));
+    }
+
+    absolute(aTHX_ abs, rel, base);
+
+    RETVAL = abs;
+  OUTPUT:
+    RETVAL
+
+void explain(uri_obj)
+  SV* uri_obj
+  CODE:
+    explain(aTHX_ uri_obj);
+
+void debug(uri_obj)
+  SV* uri_obj
+  CODE:
+    debug(aTHX_ uri_obj);
+
+SV* uri_scheme(uri)
+  SV *uri
+  ALIAS:
+    uri_host = 1
+  CODE:
+    RETVAL = peek_component(aTHX_ uri, ix);
+  OUTPUT:
+    RETVAL
+
+void uri_param(uri, key)
+  SV *uri
+  SV *key
+  PREINIT:
+    const char *src;
+    size_t len, start = 0;
+    SSize_t qlen, i;
+    SV *found;
+    AV *values;
+  PPCODE:
+    if (sv_isobject(uri) && sv_derived_from(uri, "URI::Fast")) {
+      found = get_param(aTHX_ uri, key);
+    }
+    else {
+      src  = SvTRUE(uri) ? uri_source(aTHX_ uri, &len) : "";
+      len  = SvTRUE(uri) ? len : 0;
+      qlen = peek_query(src, len, &start);
+      found = qlen < 0 ? newRV_noinc((SV*) newAV()) : query_param(aTHX_ &src[start], qlen, key, 0);
+    }
+
+    values = (AV*) SvRV(sv_2mortal(found));
+
+    if (GIMME_V == G_ARRAY) {
+      EXTEND(SP, av_len(values) + 1);
+      for (i = 0; i <= av_len(values); ++i) {
+        PUSHs(AvARRAY(values)[i]);
+      }
+    }
+    else if (av_len(values) > 0) {
+      croak("uri_param: multiple values encountered for query parameter '%s' when called in SCALAR context", SvPV_nolen(key));
+    }
+    else if (av_len(values) == 0) {
+      XPUSHs(AvARRAY(values)[0]);
+    }
+
+void uri_split(uri)
+  SV* uri
+  PREINIT:
+    I32* temp;
+  PPCODE:
+    temp = PL_markstack_ptr++;
+    uri_split(aTHX_ uri);
+
+    if (PL_markstack_ptr != temp) {
+      PL_markstack_ptr = temp;
+      XSRETURN_EMPTY;
+    }
+
+    return;
+
+
+MODULE = URI::Fast  PACKAGE = URI::Fast::Set
+
+PROTOTYPES: DISABLE
+
+SV* new(class, ...)
+  const char *class
+  PREINIT:
+    uri_set_t *set;
+    SV *obj;
+  CODE:
+    set = set_new(aTHX_ items > 1 && is_defined(aTHX_ ST(1)) ? SvUV(ST(1)) : 0);
+    obj = newSViv((IV) set);
+    URI_THREADSAFE(obj, set);
+    RETVAL = newRV_noinc(obj);
+    sv_bless(RETVAL, gv_stashpv(class, GV_ADD));
+  OUTPUT:
+    RETVAL
+
+void DESTROY(self)
+  SV *self
+  CODE:
+    set_free(aTHX_ URI_SET(self));
+
+bool add(self, uri)
+  SV *self
+  SV *uri
+  CODE:
+    RETVAL = set_add(aTHX_ URI_SET(self), uri);
+  OUTPUT:
+    RETVAL
+
+bool contains(self, uri)
+  SV *self
+  SV *uri
+  CODE:
+    RETVAL = set_contains(aTHX_ URI_SET(self), uri);
+  OUTPUT:
+    RETVAL
+
+bool remove(self, uri)
+  SV *self
+  SV *uri
+  CODE:
+    RETVAL = set_remove(aTHX_ URI_SET(self), uri);
   OUTPUT:
     RETVAL
 
-SV* decode(in)
-  SV* in
-  ALIAS:
-    uri_decode = 1
-    url_decode = 2
+UV size(self)
+  SV *self
   CODE:
-    RETVAL = decode(aTHX_ in);
+    RETVAL = URI_SET(self)->size;
   OUTPUT:
     RETVAL
 
-#-------------------------------------------------------------------------------
-# Constructors and destructors
-#-------------------------------------------------------------------------------
-void DESTROY(uri_obj)
-  SV *uri_obj
+UV memory_usage(self)
+  SV *self
   CODE:
-    DESTROY(aTHX_ uri_obj);
+    RETVAL = set_memory_usage(URI_SET(self));
+  OUTPUT:
+    RETVAL
 
-SV* new(class, uri_str)
+
+MODULE = URI::Fast  PACKAGE = URI::Fast::Bloom
+
+PROTOTYPES: DISABLE
+
+SV* _new(class, bits, hashes)
   const char *class
-  SV* uri_str
-  ALIAS:
-    new_iri = 1
+  UV bits
+  UV hashes
   CODE:
-    if (ix == 1) {
-      RETVAL = new(aTHX_ "URI::Fast::IRI", uri_str, 1);
-    } else {
-      RETVAL = new(aTHX_ class, uri_str, 0);
-    }
+    SV *obj = newSViv((IV) bloom_new(aTHX_ bits, hashes));
+    URI_THREADSAFE(obj, bloom);
+    RETVAL = newRV_noinc(obj);
+    sv_bless(RETVAL, gv_stashpv(class, GV_ADD));
   OUTPUT:
     RETVAL
 
-SV* new_abs(class, rel, base)
+SV* load(class, path)
   const char *class
-  SV *rel
-  SV *base
-  PREINIT:
-    SV *abs;
+  const char *path
   CODE:
-    if (!sv_isobject(rel) || !sv_derived_from(rel, class)) {
-      rel = sv_2mortal(new(aTHX_ class, rel, 0));
-    }
+    SV *obj = newSViv((IV) bloom_load(aTHX_ path));
+    URI_THREADSAFE(obj, bloom);
+    RETVAL = newRV_noinc(obj);
+    sv_bless(RETVAL, gv_stashpv(class, GV_ADD));
+  OUTPUT:
+    RETVAL
 
-    if (!sv_isobject(base) || !sv_derived_from(base, class)) {
-      base = sv_2mortal(new(aTHX_ class, base, 0));
-    }
+void DESTROY(self)
+  SV *self
+  CODE:
+    bloom_free(aTHX_ URI_BLOOM(self));
 
-    abs = new(aTHX_ class, sv_2mortal(newSVpvn("", 0)), 0);
-    absolute(aTHX_ abs, rel, base);
-    RETVAL = abs;
+void save(self, path)
+  SV *self
+  const char *path
+  CODE:
+    bloom_save(aTHX_ URI_BLOOM(self), path);
+
+bool add(self, uri)
+  SV *self
+  SV *uri
+  CODE:
+    RETVAL = bloom_add(aTHX_ URI_BLOOM(self), uri);
   OUTPUT:
     RETVAL
 
-SV* new_html_url(class, url, ...)
-  const char *class
-  SV *url
-  PREINIT:
-    SV *base = NULL;
-    SV *rel;
-    SV *abs;
+UV add_many(self, uris)
+  SV *self
+  SV *uris
   CODE:
-    if (items > 2) {
-      if (!sv_isobject(ST(2)) || !sv_derived_from(ST(2), "URI::Fast")) {
-        base = sv_2mortal(new(aTHX_ "URI::Fast", ST(2), 0));
-      } else {
-        base = ST(2);
-      }
+    RETVAL = bloom_add_many(aTHX_ URI_BLOOM(self), uris);
+  OUTPUT:
+    RETVAL
 
-      rel = new(aTHX_ "URI::Fast", sv_2mortal(html_url(aTHX_ url, base)), 0);
-      abs = new(aTHX_ "URI::Fast", sv_2mortal(newSVpvn("", 0)), 0);
-      absolute(aTHX_ abs, sv_2mortal(rel), base);
-      normalize(aTHX_ abs);
-      RETVAL = abs;
-    }
-    else {
-      rel = new(aTHX_ class, sv_2mortal(html_url(aTHX_ url, base)), 0);
-      normalize(aTHX_ rel);
-      RETVAL = rel;
-    }
+bool maybe_contains(self, uri)
+  SV *self
+  SV *uri
+  CODE:
+    RETVAL = bloom_maybe_contains(aTHX_ URI_BLOOM(self), uri);
+  OUTPUT:
+    RETVAL
 
+SV* maybe_contains_many(self, uris)
+  SV *self
+  SV *uris
+  CODE:
+    RETVAL = bloom_maybe_contains_many(aTHX_ URI_BLOOM(self), uris);
   OUTPUT:
     RETVAL
 
-#-------------------------------------------------------------------------------
-# Short-hand constructors
-#-------------------------------------------------------------------------------
-SV* uri(...)
-  ALIAS:
-    iri   = 1
-    clone = 2
-  PREINIT:
-    SV *uri_str;
+UV bits(self)
+  SV *self
   CODE:
-    if (items == 0) {
-      uri_str = sv_2mortal(newSVpvn("", 0));
-    } else {
-      uri_str = ST(0);
-    }
+    RETVAL = URI_BLOOM(self)->nbits;
+  OUTPUT:
+    RETVAL
 
-    if (ix == 1) {
-      RETVAL = new(aTHX_ "URI::Fast::IRI", uri_str, 1);
-    } else {
-      RETVAL = new(aTHX_ "URI::Fast", uri_str, 0);
-    }
+UV hashes(self)
+  SV *self
+  CODE:
+    RETVAL = URI_BLOOM(self)->hashes;
   OUTPUT:
     RETVAL
 
-SV* abs_uri(rel, base)
-  SV *rel
-  SV *base
-  PREINIT:
-    SV *abs;
+UV count(self)
+  SV *self
   CODE:
-    if (!sv_isobject(rel) || !sv_derived_from(rel, "URI::Fast")) {
-      rel = sv_2mortal(new(aTHX_ "URI::Fast", rel, 0));
-    }
+    RETVAL = URI_BLOOM(self)->count;
+  OUTPUT:
+    RETVAL
 
-    if (!sv_isobject(base) || !sv_derived_from(base, "URI::Fast")) {
-      base = sv_2mortal(new(aTHX_ "URI::Fast", base, 0));
-    }
+bool is_readonly(self)
+  SV *self
+  CODE:
+    RETVAL = URI_BLOOM(self)->readonly;
+  OUTPUT:
+    RETVAL
 
-    abs = new(aTHX_ "URI::Fast", sv_2mortal(newSVpvn("", 0)), 0);
-    absolute(aTHX_ abs, rel, base);
-    RETVAL = abs;
+bool is_mapped(self)
+  SV *self
+  CODE:
+#ifdef URI_USE_MMAP
+    RETVAL = URI_BLOOM(self)->map != NULL;
+#else
+    RETVAL = 0;
+#endif
   OUTPUT:
     RETVAL
 
-SV* html_url(url, ...)
-  SV *url
-  PREINIT:
-    SV *base = NULL;
-    SV *abs;
-    SV *rel;
+
+MODULE = URI::Fast  PACKAGE = URI::Fast::Table
+
+PROTOTYPES: DISABLE
+
+void _write(class, path, uris, iri, index)
+  const char *class
+  const char *path
+  SV *uris
+  bool iri
+  bool index
   CODE:
-    if (items > 1) {
-      if (!sv_isobject(ST(1)) || !sv_derived_from(ST(1), "URI::Fast")) {
-        base = sv_2mortal(new(aTHX_ "URI::Fast", ST(1), 0));
-      } else {
-        base = ST(1);
-      }
+    PERL_UNUSED_VAR(class);
+    table_write(aTHX_ path, uris, iri, index);
 
-      rel = new(aTHX_ "URI::Fast", sv_2mortal(html_url(aTHX_ url, base)), 0);
-      abs = new(aTHX_ "URI::Fast", sv_2mortal(newSVpvn("", 0)), 0);
-      absolute(aTHX_ abs, sv_2mortal(rel), base);
-      normalize(aTHX_ abs);
-      RETVAL = abs;
-    }
-    else {
-      rel = new(aTHX_ "URI::Fast", sv_2mortal(html_url(aTHX_ url, base)), 0);
-      normalize(aTHX_ rel);
-      RETVAL = rel;
-    }
+SV* load(class, path)
+  const char *class
+  const char *path
+  CODE:
+    SV *obj = newSViv((IV) table_load(aTHX_ path));
+    URI_THREADSAFE(obj, table);
+    RETVAL = newRV_noinc(obj);
+    sv_bless(RETVAL, gv_stashpv(class, GV_ADD));
   OUTPUT:
     RETVAL
 
-#-------------------------------------------------------------------------------
-# Clearers
-#-------------------------------------------------------------------------------
-void clear_scheme(uri_obj)
-  SV* uri_obj
+void DESTROY(self)
+  SV *self
   CODE:
-    clear_scheme(aTHX_ uri_obj);
+    table_free(aTHX_ URI_TABLE(self));
 
-void clear_path(uri_obj)
-  SV* uri_obj
+UV count(self)
+  SV *self
   CODE:
-    clear_path(aTHX_ uri_obj);
+    RETVAL = URI_TABLE(self)->count;
+  OUTPUT:
+    RETVAL
 
-void clear_query (uri_obj)
-  SV* uri_obj
+bool has_index(self)
+  SV *self
+  ALIAS:
+    is_iri = 1
   CODE:
-    clear_query(aTHX_ uri_obj);
+    RETVAL = (URI_TABLE(self)->flags & (ix ? URI_TABLE_IRI : URI_TABLE_INDEX)) != 0;
+  OUTPUT:
+    RETVAL
 
-void clear_frag(uri_obj)
-  SV* uri_obj
+bool is_mapped(self)
+  SV *self
   CODE:
-    clear_frag(aTHX_ uri_obj);
+    RETVAL = URI_TABLE(self)->mapped != 0;
+  OUTPUT:
+    RETVAL
 
-void clear_usr(uri_obj)
-  SV* uri_obj
+SV* get(self, i)
+  SV *self
+  IV i
+  PREINIT:
+    uri_table_t *table;
   CODE:
-    clear_usr(aTHX_ uri_obj);
+    table = URI_TABLE(self);
 
-void clear_pwd(uri_obj)
-  SV* uri_obj
+    if (i < 0) {
+      i += (IV) table->count;
+    }
+
+    RETVAL = i < 0 || (U64) i >= table->count
+      ? newSV(0)
+      : table_get(aTHX_ table, (U64) i);
+  OUTPUT:
+    RETVAL
+
+SV* find(self, uri)
+  SV *self
+  SV *uri
+  ALIAS:
+    lookup   = 1
+    contains = 2
+  PREINIT:
+    uri_table_t *table;
+    SSize_t found;
   CODE:
-    clear_pwd(aTHX_ uri_obj);
+    table = URI_TABLE(self);
 
-void clear_host(uri_obj)
-  SV* uri_obj
+    if (!(table->flags & URI_TABLE_INDEX)) {
+      croak("URI::Fast::Table: table was written without an index");
+    }
+
+    found = table_find(aTHX_ table, uri_arg(aTHX_ uri, table->scratch));
+
+    switch (ix) {
+      case 0:  RETVAL = found < 0 ? newSV(0) : newSViv(found); break;
+      case 1:  RETVAL = found < 0 ? newSV(0) : table_get(aTHX_ table, found); break;
+      default: RETVAL = boolSV(found >= 0); break;
+    }
+  OUTPUT:
+    RETVAL
+
+
+MODULE = URI::Fast  PACKAGE = URI::Fast::Array
+
+PROTOTYPES: DISABLE
+
+SV* _new(class, iri)
+  const char *class
+  bool iri
   CODE:
-    clear_host(aTHX_ uri_obj);
+    SV *obj = newSViv((IV) array_new(aTHX_ iri));
+    URI_THREADSAFE(obj, array);
+    RETVAL = newRV_noinc(obj);
+    sv_bless(RETVAL, gv_stashpv(class, GV_ADD));
+  OUTPUT:
+    RETVAL
 
-void clear_port(uri_obj)
-  SV* uri_obj
+void DESTROY(self)
+  SV *self
   CODE:
-    clear_port(aTHX_ uri_obj);
+    array_free(aTHX_ URI_ARRAY(self));
 
-void clear_auth(uri_obj)
-  SV* uri_obj
+UV push(self, ...)
+  SV *self
+  PREINIT:
+    uri_array_t *array;
+    int i;
   CODE:
-    clear_auth(aTHX_ uri_obj);
+    array = URI_ARRAY(self);
 
-#-------------------------------------------------------------------------------
-# Raw accessors
-#-------------------------------------------------------------------------------
-SV* raw_scheme(uri_obj, ...)
-  SV *uri_obj
+    for (i = 1; i < items; ++i) {
+      array_push(aTHX_ array, ST(i));
+    }
+
+    RETVAL = array->count;
+  OUTPUT:
+    RETVAL
+
+UV count(self)
+  SV *self
   CODE:
-    if (items > 1) set_raw_scheme(aTHX_ uri_obj, ST(1));
-    RETVAL = get_raw_scheme(aTHX_ uri_obj);
+    RETVAL = URI_ARRAY(self)->count;
   OUTPUT:
     RETVAL
 
-SV* raw_auth(uri_obj, ...)
-  SV *uri_obj
+bool is_iri(self)
+  SV *self
   CODE:
-    if (items > 1) set_raw_auth(aTHX_ uri_obj, ST(1));
-    RETVAL = get_raw_auth(aTHX_ uri_obj);
+    RETVAL = URI_ARRAY(self)->is_iri;
   OUTPUT:
     RETVAL
 
-SV* raw_path(uri_obj, ...)
-  SV *uri_obj
+SV* get(self, i)
+  SV *self
+  IV i
   CODE:
-    if (items > 1) set_raw_path(aTHX_ uri_obj, ST(1));
-    RETVAL = get_raw_path(aTHX_ uri_obj);
+    RETVAL = array_get(aTHX_ URI_ARRAY(self), i);
   OUTPUT:
     RETVAL
 
-SV* raw_query(uri_obj, ...)
-  SV *uri_obj
+SV* string_at(self, i)
+  SV *self
+  IV i
   CODE:
-    if (items > 1) set_raw_query(aTHX_ uri_obj, ST(1));
-    RETVAL = get_raw_query(aTHX_ uri_obj);
+    RETVAL = array_string(aTHX_ URI_ARRAY(self), i);
   OUTPUT:
     RETVAL
 
-SV* raw_frag(uri_obj, ...)
-  SV *uri_obj
+SV* scheme_at(self, i)
+  SV *self
+  IV i
+  ALIAS:
+    usr_at   = URI_RECORD_USR
+    pwd_at   = URI_RECORD_PWD
+    host_at  = URI_RECORD_HOST
+    port_at  = URI_RECORD_PORT
+    path_at  = URI_RECORD_PATH
+    query_at = URI_RECORD_QUERY
+    frag_at  = URI_RECORD_FRAG
   CODE:
-    if (items > 1) set_raw_frag(aTHX_ uri_obj, ST(1));
-    RETVAL = get_raw_frag(aTHX_ uri_obj);
+    RETVAL = array_component(aTHX_ URI_ARRAY(self), i, ix);
   OUTPUT:
     RETVAL
 
-SV* raw_usr(uri_obj, ...)
-  SV *uri_obj
+UV memory_usage(self)
+  SV *self
   CODE:
-    if (items > 1) set_raw_usr(aTHX_ uri_obj, ST(1));
-    RETVAL = get_raw_usr(aTHX_ uri_obj);
+    RETVAL = array_memory_usage(URI_ARRAY(self));
   OUTPUT:
     RETVAL
 
-SV* raw_pwd(uri_obj, ...)
-  SV *uri_obj
+
+MODULE = URI::Fast  PACKAGE = URI::Fast::Sorted
+
+PROTOTYPES: DISABLE
+
+SV* _new(class, uris)
+  const char *class
+  SV *uris
+  PREINIT:
+    uri_sorted_t *sorted;
   CODE:
-    if (items > 1) set_raw_pwd(aTHX_ uri_obj, ST(1));
-    RETVAL = get_raw_pwd(aTHX_ uri_obj);
+    sorted = sorted_new(aTHX);
+    SV *obj = newSViv((IV) sorted);
+    URI_THREADSAFE(obj, sorted);
+    RETVAL = newRV_noinc(obj);
+    sv_bless(RETVAL, gv_stashpv(class, GV_ADD));
+
+    // Blessed first, so that the list is freed if an input croaks
+    if (SvOK(uris)) {
+      sv_2mortal(SvREFCNT_inc(RETVAL));
+      sorted_add_many(aTHX_ sorted, uris);
+    }
   OUTPUT:
     RETVAL
 
-SV* raw_host(uri_obj, ...)
-  SV *uri_obj
+SV* load(class, path)
+  const char *class
+  const char *path
   CODE:
-    if (items > 1) set_raw_host(aTHX_ uri_obj, ST(1));
-    RETVAL = get_raw_host(aTHX_ uri_obj);
+    SV *obj = newSViv((IV) sorted_load(aTHX_ path));
+    URI_THREADSAFE(obj, sorted);
+    RETVAL = newRV_noinc(obj);
+    sv_bless(RETVAL, gv_stashpv(class, GV_ADD));
   OUTPUT:
     RETVAL
 
-SV* raw_port(uri_obj, ...)
-  SV *uri_obj
+void DESTROY(self)
+  SV *self
   CODE:
-    if (items > 1) set_raw_port(aTHX_ uri_obj, ST(1));
-    RETVAL = get_raw_port(aTHX_ uri_obj);
-  OUTPUT:
-    RETVAL
+    sorted_free(aTHX_ URI_SORTED(self));
 
+void save(self, path)
+  SV *self
+  const char *path
+  CODE:
+    sorted_save(aTHX_ URI_SORTED(self), path);
 
-#-------------------------------------------------------------------------------
-# Compound getters
-#-------------------------------------------------------------------------------
-SV* get_path(uri_obj)
-  SV *uri_obj
+bool add(self, uri)
+  SV *self
+  SV *uri
+  PREINIT:
+    uri_sorted_t *sorted;
   CODE:
-    RETVAL = get_path(aTHX_ uri_obj);
+    sorted = URI_SORTED(self);
+    sorted_key(aTHX_ sorted, uri);
+    RETVAL = sorted_append(aTHX_ sorted, sorted->key->string, sorted->key->length);
   OUTPUT:
     RETVAL
 
-SV* get_query(uri_obj)
-  SV *uri_obj
+UV add_all(self, uris)
+  SV *self
+  SV *uris
   CODE:
-    RETVAL = get_query(aTHX_ uri_obj);
+    RETVAL = sorted_add_many(aTHX_ URI_SORTED(self), uris);
   OUTPUT:
     RETVAL
 
-SV* get_auth(uri_obj)
-  SV *uri_obj
+UV count(self)
+  SV *self
   CODE:
-    RETVAL = get_auth(aTHX_ uri_obj);
+    RETVAL = URI_SORTED(self)->count;
   OUTPUT:
     RETVAL
 
-SV* split_path(uri)
-  SV* uri
-  ALIAS:
-    split_path_compat = 1
+bool is_readonly(self)
+  SV *self
   CODE:
-    RETVAL = split_path(aTHX_ uri, ix == 1 ? 1 : 0);
+    RETVAL = URI_SORTED(self)->readonly;
   OUTPUT:
     RETVAL
 
-SV* get_query_keys(uri)
-  SV* uri
+SV* string_at(self, i)
+  SV *self
+  IV i
+  ALIAS:
+    get = 1
+  PREINIT:
+    uri_sorted_t *sorted;
   CODE:
-    RETVAL = get_query_keys(aTHX_ uri);
+    sorted = URI_SORTED(self);
+
+    if (i < 0) {
+      i += (IV) sorted->count;
+    }
+
+    if (i < 0 || (U64) i >= sorted->count) {
+      RETVAL = newSV(0);
+    }
+    else {
+      sorted_decode(aTHX_ sorted, (U64) i);
+      RETVAL = newSVpvn(sorted->cur->string, sorted->cur->length);
+
+      if (ix == 1) {
+        RETVAL = new(aTHX_ "URI::Fast", sv_2mortal(RETVAL), 0);
+      }
+    }
   OUTPUT:
     RETVAL
 
-SV* get_query_hash(uri)
-  SV* uri
+SV* lower_bound(self, uri)
+  SV *self
+  SV *uri
+  ALIAS:
+    find     = 1
+    contains = 2
+  PREINIT:
+    uri_sorted_t *sorted;
+    U64 i;
+    int found;
   CODE:
-    RETVAL = query_hash(aTHX_ uri);
+    sorted = URI_SORTED(self);
+    sorted_key(aTHX_ sorted, uri);
+    i = sorted_lower_bound(aTHX_ sorted, sorted->key->string, sorted->key->length, &found);
+
+    switch (ix) {
+      case 0:  RETVAL = newSVuv(i); break;
+      case 1:  RETVAL = found ? newSVuv(i) : newSV(0); break;
+      default: RETVAL = boolSV(found); break;
+    }
   OUTPUT:
     RETVAL
 
-SV* get_param(uri, sv_key)
-  SV* uri
-  SV* sv_key
+UV memory_usage(self)
+  SV *self
   CODE:
-    RETVAL = get_param(aTHX_ uri, sv_key);
+    RETVAL = sorted_memory_usage(URI_SORTED(self));
   OUTPUT:
     RETVAL
 
 
-#-------------------------------------------------------------------------------
-# Compound setters
-#-------------------------------------------------------------------------------
-void set_auth(uri_obj, value)
-  SV *uri_obj
-  SV *value
-  CODE:
-    set_auth(aTHX_ uri_obj, value);
+MODULE = URI::Fast  PACKAGE = URI::Fast::Reader
 
-void set_path(uri_obj, value)
-  SV *uri_obj
-  SV *value
-  CODE:
-    set_path(aTHX_ uri_obj, value);
+PROTOTYPES: DISABLE
 
-void set_path_array(uri_obj, segments)
-  SV *uri_obj
-  SV *segments
+SV* _new_fh(class, fh, is_iri)
+  const char *class
+  SV *fh
+  int is_iri
   CODE:
-    set_path_array(aTHX_ uri_obj, segments);
+    RETVAL = newRV_noinc(newSViv((IV) reader_new_fh(aTHX_ fh, is_iri)));
+    sv_bless(RETVAL, gv_stashpv(class, GV_ADD));
+  OUTPUT:
+    RETVAL
 
-void set_query(uri_obj, value)
-  SV *uri_obj
-  SV *value
+SV* _new_path(class, path, is_iri)
+  const char *class
+  const char *path
+  int is_iri
+  PREINIT:
+    uri_reader_t *reader;
   CODE:
-    set_query(aTHX_ uri_obj, value);
+    reader = reader_new_path(aTHX_ path, is_iri);
 
-void set_param(uri, sv_key, sv_values, sv_separator)
-  SV *uri
-  SV *sv_key
-  SV *sv_values
-  SV *sv_separator
-  CODE:
-    set_param(aTHX_ uri, sv_key, sv_values, sv_separator);
+    if (reader == NULL) {
+      RETVAL = newSV(0);
+    }
+    else {
+      RETVAL = newRV_noinc(newSViv((IV) reader));
+      sv_bless(RETVAL, gv_stashpv(class, GV_ADD));
+    }
+  OUTPUT:
+    RETVAL
 
-void query_keyset(self, sv_key_set, ...)
+void DESTROY(self)
   SV *self
-  SV *sv_key_set
   CODE:
-    SV *sv_separator = items > 2 ? ST(2) : sv_2mortal(newSVpvn("&", 1));
-    update_query_keyset(aTHX_ self, sv_key_set, sv_separator);
+    reader_free(aTHX_ URI_READER(self));
 
-
-#-------------------------------------------------------------------------------
-# Unified accessors
-#-------------------------------------------------------------------------------
-SV* scheme(self, ...)
+SV* next(self)
   SV *self
+  PREINIT:
+    uri_reader_t *reader;
   CODE:
-    if (items > 1) set_scheme(aTHX_ self, ST(1));
-    RETVAL = get_scheme(aTHX_ self);
+    reader = URI_READER(self);
+    RETVAL = reader_next(aTHX_ reader) ? newSVsv(reader->obj) : newSV(0);
   OUTPUT:
     RETVAL
 
-SV* usr(self, ...)
+void next_split(self)
   SV *self
-  CODE:
-    if (items > 1) set_usr(aTHX_ self, ST(1));
-    RETVAL = get_usr(aTHX_ self);
-  OUTPUT:
-    RETVAL
+  PREINIT:
+    uri_reader_t *reader;
+    uri_t *uri;
+  PPCODE:
+    reader = URI_READER(self);
 
-SV* pwd(self, ...)
+    if (!reader_next(aTHX_ reader)) {
+      XSRETURN_EMPTY;
+    }
+
+    uri = reader->uri;
+    EXTEND(SP, 5);
+    PUSHs(uri->scheme->length > 0 ? sv_2mortal(get_raw_scheme(aTHX_ reader->obj)) : &PL_sv_undef);
+    PUSHs(has_authority(aTHX_ uri) ? sv_2mortal(get_raw_auth(aTHX_ reader->obj)) : &PL_sv_undef);
+    PUSHs(sv_2mortal(get_raw_path(aTHX_ reader->obj)));
+    PUSHs(uri->query->length > 0 ? sv_2mortal(get_raw_query(aTHX_ reader->obj)) : &PL_sv_undef);
+    PUSHs(uri->frag->length > 0 ? sv_2mortal(get_raw_frag(aTHX_ reader->obj)) : &PL_sv_undef);
+
+UV line(self)
   SV *self
   CODE:
-    if (items > 1) set_pwd(aTHX_ self, ST(1));
-    RETVAL = get_pwd(aTHX_ self);
+    RETVAL = URI_READER(self)->line;
   OUTPUT:
     RETVAL
 
-SV* host(self, ...)
-  SV *self
+MODULE = URI::Fast  PACKAGE = URI::Fast::AccessLog
+
+PROTOTYPES: DISABLE
+
+SV* _new_fh(class, fh, is_iri)
+  const char *class
+  SV *fh
+  int is_iri
+  PREINIT:
+    uri_reader_t *reader;
   CODE:
-    if (items > 1) set_host(aTHX_ self, ST(1));
-    RETVAL = get_host(aTHX_ self);
+    reader = reader_new_fh(aTHX_ fh, is_iri);
+    log_attach(aTHX_ reader);
+    RETVAL = newRV_noinc(newSViv((IV) reader));
+    sv_bless(RETVAL, gv_stashpv(class, GV_ADD));
   OUTPUT:
     RETVAL
 
-SV* port(self, ...)
-  SV *self
+SV* _new_path(class, path, is_iri)
+  const char *class
+  const char *path
+  int is_iri
+  PREINIT:
+    uri_reader_t *reader;
   CODE:
-    if (items > 1) set_port(aTHX_ self, ST(1));
-    RETVAL = get_port(aTHX_ self);
+    reader = reader_new_path(aTHX_ path, is_iri);
+
+    if (reader == NULL) {
+      RETVAL = newSV(0);
+    }
+    else {
+      log_attach(aTHX_ reader);
+      RETVAL = newRV_noinc(newSViv((IV) reader));
+      sv_bless(RETVAL, gv_stashpv(class, GV_ADD));
+    }
   OUTPUT:
     RETVAL
 
-SV* frag(self, ...)
+void DESTROY(self)
   SV *self
-  ALIAS:
-    fragment = 1
   CODE:
-    if (items > 1) set_frag(aTHX_ self, ST(1));
-    RETVAL = get_frag(aTHX_ self);
-  OUTPUT:
-    RETVAL
+    reader_free(aTHX_ URI_ACCESS_LOG(self));
 
+void next(self)
+  SV *self
+  PREINIT:
+    uri_reader_t *reader;
+  PPCODE:
+    reader = URI_ACCESS_LOG(self);
 
-#-------------------------------------------------------------------------------
-# Extras
-#-------------------------------------------------------------------------------
-SV* to_string(self, ...)
+    if (!log_next(aTHX_ reader)) {
+      XSRETURN_EMPTY;
+    }
+
+    EXTEND(SP, 2);
+    PUSHs(sv_2mortal(newSVsv(reader->obj)));
+    PUSHs(reader->has_ref ? sv_2mortal(newSVsv(reader->ref_obj)) : &PL_sv_undef);
+
+SV* columns(self, max=1000)
   SV *self
-  ALIAS:
-    as_string = 1
-    TO_JSON = 2
-  OVERLOAD:
-    to_string \"\"
+  IV max
   CODE:
-    RETVAL = to_string(aTHX_ self);
+    RETVAL = log_columns(aTHX_ URI_ACCESS_LOG(self), max);
   OUTPUT:
     RETVAL
 
-SV* normalize(uri)
-  SV *uri
-  ALIAS:
-    canonical = 1
-  CODE:
-    normalize(aTHX_ uri);
-  OUTPUT:
-    uri
-
-SV* absolute(rel, base)
-  SV* rel
-  SV* base
+UV line(self)
+  SV *self
   ALIAS:
-    abs = 1
+    skipped = 1
   PREINIT:
-    SV *abs;
-    const char *class;
+    uri_reader_t *reader;
   CODE:
-    class = class_name(aTHX_ rel);
-    abs = new(aTHX_ class, sv_2mortal(newSVpvn("", 0)), 0);
+    reader = URI_ACCESS_LOG(self);
+    RETVAL = ix == 1 ? reader->skipped : reader->line;
+  OUTPUT:
+    RETVAL
 
-    if (!sv_isobject(base) || !sv_derived_from(base, class)) {
-      base = sv_2mortal(new(aTHX_ class, base, 0));
-    }
+MODULE = URI::Fast  PACKAGE = URI::Fast::Links
 
-    absolute(aTHX_ abs, rel, base);
+PROTOTYPES: DISABLE
 
-    RETVAL = abs;
+SV* _new(class, base)
+  const char *class
+  SV *base
+  CODE:
+    RETVAL = newRV_noinc(newSViv((IV) links_new(aTHX_ base)));
+    sv_bless(RETVAL, gv_stashpv(class, GV_ADD));
   OUTPUT:
     RETVAL
 
-void explain(uri_obj)
-  SV* uri_obj
-  CODE:
-    explain(aTHX_ uri_obj);
-
-void debug(uri_obj)
-  SV* uri_obj
+void DESTROY(self)
+  SV *self
   CODE:
-    debug(aTHX_ uri_obj);
+    links_free(aTHX_ URI_LINKS(self));
 
-void uri_split(uri)
-  SV* uri
+void push(self, html)
+  SV *self
+  SV *html
   PREINIT:
-    I32* temp;
+    const char *src;
+    STRLEN len;
+    AV *found;
+    SSize_t i;
   PPCODE:
-    temp = PL_markstack_ptr++;
-    uri_split(aTHX_ uri);
+    src   = SvPV_const(html, len);
+    found = (AV*) sv_2mortal((SV*) newAV());
+    links_push(aTHX_ URI_LINKS(self), src, len, found);
 
-    if (PL_markstack_ptr != temp) {
-      PL_markstack_ptr = temp;
-      XSRETURN_EMPTY;
+    EXTEND(SP, av_len(found) + 1);
+    for (i = 0; i <= av_len(found); ++i) {
+      PUSHs(sv_2mortal(SvREFCNT_inc(AvARRAY(found)[i])));
     }
 
-    return;
+SV* base(self)
+  SV *self
+  PREINIT:
+    uri_links_t *links;
+  CODE:
+    links = URI_LINKS(self);
+    RETVAL = links->base == NULL ? newSV(0) : new(aTHX_ "URI::Fast", links->base, 0);
+  OUTPUT:
+    RETVAL
+
+void reset(self, base=NULL)
+  SV *self
+  SV *base
+  CODE:
+    links_reset(aTHX_ URI_LINKS(self), base);
@@ -0,0 +1,353 @@
+/*
+ * Times the C kernels behind URI::Fast directly, without the cost of calling
+ * them through Perl:
+ *
+ *   make bench-c
+ *   bench/kernels [-t seconds] [corpus]
+ *
+ * The corpus is a file of URIs, one per line. If none is given, a corpus of
+ * 10,000 URIs is generated from a fixed seed, so that runs on different builds
+ * are comparable. Each kernel is run over the whole corpus repeatedly for at
+ * least the given time (default 1 second) and reported as:
+ *
+ *   ns/op        nanoseconds per input (one URI, path, or query string)
+ *   MB/s         megabytes of input processed per second
+ *   cycles/byte  time stamp counter cycles per input byte (x86 only)
+ *
+ * The time stamp counter runs at a fixed rate, which is not necessarily the
+ * rate of the core under frequency scaling; compare cycles/byte between runs
+ * on the same machine.
+ *
+ * Fast.c, as generated by xsubpp, is included directly so that its static
+ * functions may be called. The kernels which take an interpreter context are
+ * given one by embedding perl.
+ */
+#include "Fast.c"
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#define bench_cycles() __rdtsc()
+#else
+#define BENCH_HAVE_TSC 0
+#define bench_cycles() 0
+#endif
+
+#define BENCH_CORPUS_SIZE 10000
+
+typedef struct {
+  size_t count;
+  char   **url;    size_t *url_len;
+  char   **path;   size_t *path_len;   // raw path
+  char   **query;  size_t *query_len;  // raw query
+  char   **plain;  size_t *plain_len;  // decoded path
+  size_t url_bytes, path_bytes, query_bytes, plain_bytes;
+} bench_corpus_t;
+
+typedef struct {
+  const char *name;
+  size_t ops;
+  size_t bytes;
+  double secs;
+  U64    cycles;
+} bench_result_t;
+
+// Keeps the compiler from discarding the kernels' results
+static volatile size_t bench_sink;
+
+static
+double bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Corpus
+ */
+static U64 bench_seed = 0x9E3779B97F4A7C15ULL;
+
+static
+U64 bench_rand(void) {
+  bench_seed ^= bench_seed << 13;
+  bench_seed ^= bench_seed >> 7;
+  bench_seed ^= bench_seed << 17;
+  return bench_seed;
+}
+
+#define BENCH_PICK(list) list[ bench_rand() % (sizeof(list) / sizeof(list[0])) ]
+
+static
+size_t bench_generate(char *buf, size_t size) {
+  static const char *schemes[]  = { "http", "https", "https", "HTTP" };
+  static const char *hosts[]    = { "www.example.com", "cdn%d.example.net", "api.example%d.co.uk", "192.168.0.%d", "[::1]" };
+  static const char *segments[] = { "foo", "bar", "..", ".", "index.html", "a%20b", "caf%C3%A9", "images", "v1", "search", "%E2%82%AC" };
+  static const char *keys[]     = { "q", "id", "page", "utm_source", "ref", "s%C3%A9l", "sort" };
+  static const char *values[]   = { "1", "foo+bar", "the%20quick%20brown", "%26amp", "", "x%3Dy", "12345" };
+  size_t len = 0;
+  int i, n;
+
+  #define BENCH_PRINT(...) len += snprintf(&buf[len], size - len, __VA_ARGS__)
+
+  BENCH_PRINT("%s://", BENCH_PICK(schemes));
+  if (bench_rand() % 8 == 0) BENCH_PRINT("user:pwd@");
+  BENCH_PRINT(BENCH_PICK(hosts), (int) (bench_rand() % 100));
+  if (bench_rand() % 6 == 0) BENCH_PRINT(":%d", (int) (8000 + bench_rand() % 100));
+
+  for (i = 0, n = 1 + bench_rand() % 6; i < n; ++i) {
+    BENCH_PRINT("/%s", BENCH_PICK(segments));
+  }
+
+  for (i = 0, n = bench_rand() % 6; i < n; ++i) {
+    BENCH_PRINT("%c%s=%s", i == 0 ? '?' : '&', BENCH_PICK(keys), BENCH_PICK(values));
+  }
+
+  if (bench_rand() % 5 == 0) BENCH_PRINT("#frag%d", (int) (bench_rand() % 10));
+
+  #undef BENCH_PRINT
+
+  return len < size ? len : size - 1;
+}
+
+static
+char* bench_strndup(const char *str, size_t len) {
+  char *copy = (char*) malloc(len + 1);
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+static
+void bench_add(pTHX_ bench_corpus_t *corpus, uri_t *uri, const char *url, size_t len) {
+  size_t i = corpus->count++;
+  char *plain;
+
+  uri_clear(aTHX_ uri);
+  uri_scan(aTHX_ uri, url, len);
+
+  corpus->url[i]       = bench_strndup(url, len);
+  corpus->url_len[i]   = len;
+  corpus->path[i]      = bench_strndup(uri->path->string, uri->path->length);
+  corpus->path_len[i]  = uri->path->length;
+  corpus->query[i]     = bench_strndup(uri->query->string, uri->query->length);
+  corpus->query_len[i] = uri->query->length;
+
+  plain = (char*) malloc(uri->path->length + 1);
+  corpus->plain_len[i] = uri_decode(uri->path->string, uri->path->length, plain, "");
+  corpus->plain[i]     = plain;
+
+  corpus->url_bytes   += corpus->url_len[i];
+  corpus->path_bytes  += corpus->path_len[i];
+  corpus->query_bytes += corpus->query_len[i];
+  corpus->plain_bytes += corpus->plain_len[i];
+}
+
+static
+void bench_reserve(bench_corpus_t *corpus, size_t n) {
+  corpus->url       = (char**)  realloc(corpus->url,       n * sizeof(char*));
+  corpus->url_len   = (size_t*) realloc(corpus->url_len,   n * sizeof(size_t));
+  corpus->path      = (char**)  realloc(corpus->path,      n * sizeof(char*));
+  corpus->path_len  = (size_t*) realloc(corpus->path_len,  n * sizeof(size_t));
+  corpus->query     = (char**)  realloc(corpus->query,     n * sizeof(char*));
+  corpus->query_len = (size_t*) realloc(corpus->query_len, n * sizeof(size_t));
+  corpus->plain     = (char**)  realloc(corpus->plain,     n * sizeof(char*));
+  corpus->plain_len = (size_t*) realloc(corpus->plain_len, n * sizeof(size_t));
+}
+
+static
+void bench_corpus(pTHX_ bench_corpus_t *corpus, const char *path) {
+  uri_t *uri = uri_alloc(aTHX_ 0);
+  size_t allocated = BENCH_CORPUS_SIZE;
+  char line[8192];
+  size_t len;
+  FILE *fh = NULL;
+
+  memset(corpus, 0, sizeof(bench_corpus_t));
+  bench_reserve(corpus, allocated);
+
+  if (path != NULL && (fh = fopen(path, "r")) == NULL) {
+    perror(path);
+    exit(1);
+  }
+
+  for (;;) {
+    if (fh == NULL) {
+      if (corpus->count == BENCH_CORPUS_SIZE) break;
+      len = bench_generate(line, sizeof(line));
+    }
+    else {
+      if (fgets(line, sizeof(line), fh) == NULL) break;
+      len = strcspn(line, "\r\n");
+      if (len == 0) continue;
+    }
+
+    if (corpus->count == allocated) {
+      bench_reserve(corpus, allocated *= 2);
+    }
+
+    bench_add(aTHX_ corpus, uri, line, len);
+  }
+
+  if (fh != NULL) fclose(fh);
+  uri_free(aTHX_ uri);
+
+  if (corpus->count == 0) {
+    fprintf(stderr, "%s: no URIs found\n", path);
+    exit(1);
+  }
+}
+
+/*
+ * Kernels. Each makes one pass over the corpus and returns the number of
+ * operations performed.
+ */
+static
+size_t bench_scan(pTHX_ bench_corpus_t *corpus, uri_t *uri, uri_str_t *out, char *buf) {
+  size_t i;
+
+  for (i = 0; i < corpus->count; ++i) {
+    uri_clear(aTHX_ uri);
+    uri_scan(aTHX_ uri, corpus->url[i], corpus->url_len[i]);
+    bench_sink += uri->path->length;
+  }
+
+  return corpus->count;
+}
+
+static
+size_t bench_encode(pTHX_ bench_corpus_t *corpus, uri_t *uri, uri_str_t *out, char *buf) {
+  size_t i;
+
+  for (i = 0; i < corpus->count; ++i) {
+    bench_sink += uri_encode(corpus->plain[i], corpus->plain_len[i], buf, URI_CHARS_PATH, 0);
+  }
+
+  return corpus->count;
+}
+
+static
+size_t bench_decode(pTHX_ bench_corpus_t *corpus, uri_t *uri, uri_str_t *out, char *buf) {
+  size_t i;
+
+  for (i = 0; i < corpus->count; ++i) {
+    bench_sink += uri_decode(corpus->url[i], corpus->url_len[i], buf, "");
+  }
+
+  return corpus->count;
+}
+
+static
+size_t bench_query(pTHX_ bench_corpus_t *corpus, uri_t *uri, uri_str_t *out, char *buf) {
+  uri_query_scanner_t scanner;
+  uri_query_token_t token;
+  size_t i;
+
+  for (i = 0; i < corpus->count; ++i) {
+    query_scanner_init(&scanner, corpus->query[i], corpus->query_len[i]);
+
+    do {
+      query_scanner_next(&scanner, &token);
+      bench_sink += token.key_length;
+    } while (token.type != DONE);
+  }
+
+  return corpus->count;
+}
+
+static
+size_t bench_dots(pTHX_ bench_corpus_t *corpus, uri_t *uri, uri_str_t *out, char *buf) {
+  size_t i;
+
+  for (i = 0; i < corpus->count; ++i) {
+    remove_dot_segments(aTHX_ out, corpus->path[i], corpus->path_len[i]);
+    bench_sink += out->length;
+  }
+
+  return corpus->count;
+}
+
+typedef size_t (*bench_kernel_t)(pTHX_ bench_corpus_t*, uri_t*, uri_str_t*, char*);
+
+static
+bench_result_t bench_run(pTHX_ const char *name, bench_kernel_t kernel, size_t bytes, bench_corpus_t *corpus, double min_secs) {
+  bench_result_t result = { name, 0, 0, 0, 0 };
+  uri_t *uri = uri_alloc(aTHX_ 0);
+  uri_str_t *out = str_new(aTHX_ 1024);
+  char *buf = (char*) malloc(sizeof(char) * 8192 * 3 + 1);
+  double start;
+  U64 cycles;
+
+  // Warm up caches and buffers
+  kernel(aTHX_ corpus, uri, out, buf);
+
+  start  = bench_now();
+  cycles = bench_cycles();
+
+  do {
+    result.ops   += kernel(aTHX_ corpus, uri, out, buf);
+    result.bytes += bytes;
+    result.secs   = bench_now() - start;
+  } while (result.secs < min_secs);
+
+  result.cycles = bench_cycles() - cycles;
+
+  free(buf);
+  str_free(aTHX_ out);
+  uri_free(aTHX_ uri);
+
+  return result;
+}
+
+static
+void bench_report(bench_result_t *r) {
+  printf("%-22s %12lu %10.1f %10.1f", r->name, (unsigned long) r->ops, r->secs * 1e9 / r->ops, r->bytes / r->secs / 1e6);
+
+  if (BENCH_HAVE_TSC) {
+    printf(" %12.2f\n", (double) r->cycles / r->bytes);
+  } else {
+    printf(" %12s\n", "-");
+  }
+}
+
+int main(int argc, char **argv, char **env) {
+  char *embedding[] = { "", "-e", "0", NULL };
+  PerlInterpreter *my_perl;
+  bench_corpus_t corpus;
+  bench_result_t result;
+  const char *path = NULL;
+  double secs = 1.0;
+  int i;
+
+  for (i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      secs = atof(argv[++i]);
+    } else {
+      path = argv[i];
+    }
+  }
+
+  PERL_SYS_INIT3(&argc, &argv, &env);
+  my_perl = perl_alloc();
+  perl_construct(my_perl);
+  perl_parse(my_perl, NULL, 3, embedding, NULL);
+  PL_exit_flags |= PERL_EXIT_DESTRUCT_END;
+
+  bench_corpus(aTHX_ &corpus, path);
+
+  printf("Corpus: %s, %lu URIs, %lu bytes\n\n", path == NULL ? "generated" : path, (unsigned long) corpus.count, (unsigned long) corpus.url_bytes);
+  printf("%-22s %12s %10s %10s %12s\n", "kernel", "ops", "ns/op", "MB/s", "cycles/byte");
+
+  result = bench_run(aTHX_ "uri_scan",            bench_scan,   corpus.url_bytes,   &corpus, secs); bench_report(&result);
+  result = bench_run(aTHX_ "uri_encode",          bench_encode, corpus.plain_bytes, &corpus, secs); bench_report(&result);
+  result = bench_run(aTHX_ "uri_decode",          bench_decode, corpus.url_bytes,   &corpus, secs); bench_report(&result);
+  result = bench_run(aTHX_ "query_scanner_next",  bench_query,  corpus.query_bytes, &corpus, secs); bench_report(&result);
+  result = bench_run(aTHX_ "remove_dot_segments", bench_dots,   corpus.path_bytes,  &corpus, secs); bench_report(&result);
+
+  perl_destruct(my_perl);
+  perl_free(my_perl);
+  PERL_SYS_TERM();
+
+  return 0;
+}
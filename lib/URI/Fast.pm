@@ -19,10 +19,17 @@ use Exporter 'import';
 
 our @EXPORT_OK = qw(
   uri_split 
+  uri_scheme
+  uri_host
+  uri_param
   uri
   iri
   abs_uri
   html_url
+  fingerprint_many
+  parse_file_parallel
+  sort_uris
+  load_public_suffix_list
   encode uri_encode url_encode
   decode uri_decode url_decode
 );
@@ -299,6 +306,14 @@ sub _walk {
   $ref;
 }
 
+sub load_public_suffix_list {
+  my $path = shift;
+  open my $fh, '<:raw', $path or croak "load_public_suffix_list: unable to open $path: $!";
+  local $/;
+  _load_public_suffix_list(<$fh>);
+  return;
+}
+
 sub escape_tree {
   my ($ref, @args) = @_;
   ref $ref || croak "escape_tree: reference expected";
@@ -368,6 +383,10 @@ Note: passing a C<URI::Fast> instance to this routine will cause the object to
 be interpolated into a string (via L</to_string>), effectively creating a clone
 of the original C<URI::Fast> object.
 
+To parse a file of newline-delimited URIs, see L<URI::Fast::Reader>. To parse
+the request and referer URIs in a web server's access log, see
+L<URI::Fast::AccessLog>.
+
 =head2 iri
 
 Similar to L</uri>, but returns a C<URI::Fast::IRI> object. A C<URI::Fast::IRI>
@@ -394,10 +413,104 @@ L</absolute> relative to that base URL.
   # Resulting URL is "https://www.slashdot.org/recent"
   my $url = html_url '//www.slashdot.org\recent', "https://www.slashdot.org";
 
+To extract and resolve the links in an HTML document, see L<URI::Fast::Links>.
+
+=head2 fingerprint_many
+
+Bulk form of L</fingerprint>. Accepts an array ref of C<URI::Fast> objects
+and/or URI strings and returns an array ref of their fingerprints, in the same
+order. Strings are scanned directly without building an object for each.
+
+  my $fps = fingerprint_many [$uri, 'http://www.example.com/foo'];
+
+=head2 parse_file_parallel
+
+Parses a file of newline-delimited URIs using a pool of native threads. The
+file is divided into one range of lines per thread, and each line is scanned,
+normalized, and fingerprinted entirely in C. Blank lines are skipped, as with
+L<URI::Fast::Reader>. Perl objects and strings are only created at the end, on
+the calling thread.
+
+Accepts the following options:
+
+=over
+
+=item threads
+
+The number of threads to use. Defaults to the number of online processors.
+
+=item normalized
+
+When true, the normalized string of each URI is returned as well.
+
+=item iri
+
+When true, lines are parsed as IRIs, and normalized strings are returned as
+decoded character strings.
+
+=back
+
+Returns a hash ref with the C<count> of URIs parsed, their C<fingerprints>
+packed into a single string of native 64-bit integers in file order, and (if
+requested) an array ref of C<normalized> strings.
+
+  my $result = parse_file_parallel '/path/to/urls.txt', threads => 8;
+  my @fps = unpack 'Q*', $result->{fingerprints};
+
+The packed fingerprints can be written to a file as-is. On perls built without
+thread support, the ranges are parsed one after another on the calling thread.
+
+=head2 load_public_suffix_list
+
+Loads a copy of the L<Public Suffix List|https://publicsuffix.org/list/> from
+a local file, enabling L</public_suffix> and L</registrable_domain>. The list
+is compiled into a compact trie which is shared by all C<URI::Fast> objects. It
+may be reloaded at any time to pick up a newer copy of the list. Each thread
+has its own copy of the list, taken from its parent when the thread is created.
+
+  load_public_suffix_list '/usr/share/publicsuffix/public_suffix_list.dat';
+
+=head2 sort_uris
+
+Accepts an array ref of C<URI::Fast> objects and/or URI strings and returns a
+new array ref of the same items, sorted by the URI components named in C<by>
+(a comma separated list). Sorting is performed entirely in C; strings are
+scanned directly without building an object for each.
+
+  my $sorted = sort_uris \@urls, by => 'host_reversed,path,query';
+
+Valid components are C<scheme>, C<usr>, C<pwd>, C<host>, C<host_reversed> (see
+L</reversed_host>), C<port>, C<path>, C<query>, and C<frag>. The default is
+C<host_reversed,path,query>, which groups URIs by site.
+
+Components are compared as raw (encoded) bytes. Schemes and hosts are compared
+case insensitively, and numeric ports are compared numerically. Items with
+equal keys retain their original order.
+
 =head2 uri_split
 
 Behaves (hopefully) identically to L<URI::Split>, but roughly twice as fast.
 
+=head2 uri_scheme
+
+=head2 uri_host
+
+Returns the scheme or host of a URI string, decoded as by the L</scheme> and
+L</host> methods, without constructing an object. The string is scanned only
+as far as the end of the requested component.
+
+  my $host = uri_host 'https://www.example.com/foo?bar=baz'; # "www.example.com"
+
+=head2 uri_param
+
+Returns the decoded value(s) of a query parameter in a URI string, as would
+L</param>, without constructing an object.
+
+  my $id  = uri_param 'https://www.example.com/item?id=42', 'id';  # "42"
+  my @ids = uri_param 'https://www.example.com/item?id=1&id=2', 'id';
+
+Each of these accepts a C<URI::Fast> object in place of a string as well.
+
 =head2 encode/decode/uri_encode/uri_decode
 
 See L</ENCODING>.
@@ -419,6 +532,20 @@ OO equivalent to L</abs_uri>.
 
 OO equivalent to L</html_url>.
 
+=head2 reparse
+
+Replaces the contents of an existing object with a new URI string, reusing
+the object's buffers. In a loop over many URIs, this avoids the allocation and
+destruction of an object for each of them. Returns the object itself. An
+L<URI::Fast::IRI> remains an IRI.
+
+  my $uri = uri;
+
+  while (my $line = <$fh>) {
+    next unless $uri->reparse($line)->host eq 'www.example.com';
+    ...
+  }
+
 =head1 ATTRIBUTES
 
 All attributes serve as full accessors, allowing the URI segment to be both
@@ -481,7 +608,8 @@ alters L</auth>.
 =head4 port
 
 The port number segment of the authorization string. Updating this value alters
-L</auth>.
+L</auth>. A numeric port in the range 0-65535 is returned as a number, without
+any string conversion; any other value is returned as a (decoded) string.
 
 =head3 path
 
@@ -650,6 +778,18 @@ the path.
 Stringifies the URI, encoding output as necessary. String interpolation is
 overloaded.
 
+=head2 append_to
+
+Appends the stringified URI to a buffer, growing the buffer once to fit,
+without creating an intermediate string. Useful when writing many URIs to a
+larger document.
+
+  my $out = '';
+  foreach my $uri (@uris) {
+    $uri->append_to($out);
+    $out .= "\n";
+  }
+
 =head2 compare
 
 =head2 $uri eq $other
@@ -701,12 +841,145 @@ Similar to L<URI/canonical>, performs a minimal normalization on the URI. Only
 generic normalization described in the rfc is performed; no scheme-specific
 normalization is done. Specifically, the scheme and host members are converted
 to lower case, dot segments are collapsed in the path, and any percent-encoded
-characters in the URI are converted to upper case.
+characters in the URI are converted to upper case. Percent-encoded unreserved
+characters (letters, digits, C<->, C<.>, C<_>, and C<~>) are decoded, while
+encoded reserved characters are left encoded.
+
+Each member of the URI is normalized in a single pass over its own buffer;
+members which are already in normal form are not copied.
+
+IPv6 addresses are rewritten in the canonical form described by
+L<RFC 5952|https://www.rfc-editor.org/rfc/rfc5952.txt> (e.g.
+C<[2001:DB8:0:0:0:0:0:1]> becomes C<[2001:db8::1]>).
+
+Optionally, the host may also be converted to the form used by DNS (C<ascii>)
+or to Unicode (C<unicode>); see L</host_ascii> and L</host_unicode>.
+
+  $uri->normalize(idn => 'ascii');
 
 =head2 canonical
 
 Alias of L</normalize>.
 
+=head2 memory_size
+
+Returns the number of bytes allocated for the URI's internal structures and
+buffers. Each component's buffer grows in fixed steps as needed and is not
+shrunk when the component becomes shorter, so a URI which has been modified
+may hold more memory than its contents need; see L</compact>.
+
+Tools such as L<Devel::Size> measure only the Perl scalar referring to the
+object, not the memory behind it. To account for both:
+
+  my $bytes = Devel::Size::total_size($uri) + $uri->memory_size;
+
+=head2 compact
+
+Shrinks the URI's buffers to fit their contents and returns the URI. This is
+useful for objects which will be held for a long time, such as in a cache,
+after they have been built or modified. A compacted URI may still be modified;
+its buffers grow again as needed.
+
+  $cache{$key} = $uri->compact;
+
+=head2 fingerprint
+
+Returns a 64-bit fingerprint of the URI, suitable for deduplication and
+sharding. URIs which are equivalent after L</normalize> have the same
+fingerprint.
+
+  my %seen;
+  next if $seen{ $uri->fingerprint }++;
+
+The fingerprint is the XXH64 hash (seed 0) of the bytes of
+C<< $uri->clone->normalize->to_string >>, although neither the normalized
+string nor any intermediate objects are actually built; the normalized bytes of
+each member are streamed through the hash. The URI itself is not modified.
+
+The algorithm is fixed and independent of platform and byte order, so
+fingerprints may safely be stored and compared across processes and releases.
+On perls without 64-bit integer support, the fingerprint is returned as a 16
+digit hex string instead.
+
+=head2 host_type
+
+Classifies the host as one of C<reg-name>, C<ipv4>, C<ipv6>, or C<ipvfuture>,
+per L<RFC 3986 section 3.2.2|https://www.rfc-editor.org/rfc/rfc3986.txt>.
+Bracketed IP literals which are malformed are classified as C<invalid>. Returns
+C<undef> if there is no host.
+
+Hosts are classified, and IP addresses parsed, when the URI is parsed, and
+again as needed after the host is modified. IPv4 addresses must be in strict
+dotted decimal form; other forms accepted by some resolvers (e.g.
+C<0x7f.1>) are considered to be reg-names. Since percent-encoded digits are
+only decoded by L</normalize>, a URI should be normalized before its host type
+is relied on for security decisions.
+
+=head2 ip_bytes
+
+Returns the host's IP address in packed, network order form (4 bytes for IPv4,
+16 for IPv6; the same form returned by L<Socket/inet_pton>), or C<undef> if the
+host is not an IP address. Any IPv6 zone identifier is ignored.
+
+  my $ip = uri('http://[::1]:8080')->ip_bytes;
+
+=head2 reversed_host
+
+Returns the labels of the host in reverse order, which groups hosts by domain
+when sorted (see L</sort_uris>). Any trailing dot is dropped. IP addresses are
+returned unchanged.
+
+  uri('http://www.example.com')->reversed_host; # "com.example.www"
+
+=head2 host_ascii
+
+Returns the host with each internationalized label converted to its ASCII
+compatible (punycode) form, as used by DNS. ASCII letters within converted
+labels are lower cased; labels which are already ASCII are returned unchanged.
+
+  iri('http://www.bücher.de')->host_ascii; # "www.xn--bcher-kva.de"
+
+Only the punycode encoding is performed; Unicode case folding and
+normalization are not.
+
+=head2 host_unicode
+
+Returns the host with each C<xn--> label decoded from punycode. Labels which
+are not valid punycode are returned unchanged.
+
+  uri('http://www.xn--bcher-kva.de')->host_unicode; # "www.bücher.de"
+
+=head2 public_suffix
+
+Returns the public suffix (also known as the effective top-level domain) of the
+host, as defined by the Public Suffix List loaded with
+L</load_public_suffix_list>, applying exception and wildcard rules. Hosts not
+matching any rule are treated as having a single label suffix, per the list's
+algorithm. Returns C<undef> for empty hosts, IP addresses, and hosts with empty
+labels. Croaks if no list has been loaded.
+
+  uri('http://www.example.co.uk')->public_suffix; # "co.uk"
+
+Rules are matched case insensitively, but the result is a substring of the
+host as it appears in the URI, minus any trailing dot. To match the list's
+rules for internationalized domain names, the host must be in the same form
+(Unicode or punycode) as the rules.
+
+=head2 registrable_domain
+
+Returns the public suffix plus the label preceding it (sometimes called
+C<eTLD+1>), which is the portion of the host registered by its owner and is
+convenient for grouping URIs by site. Returns C<undef> when the host is itself
+a public suffix or has no public suffix (see L</public_suffix>).
+
+  uri('http://www.example.co.uk')->registrable_domain; # "example.co.uk"
+
+To collect a set of unique URIs, see L<URI::Fast::Set>. For a more compact,
+probabilistic alternative, see L<URI::Fast::Bloom>. To share a large, fixed
+collection of URIs between processes, see L<URI::Fast::Table>. To hold a large
+number of parsed URIs in memory compactly, see L<URI::Fast::Array>, or, for a
+sorted list of URIs sharing long prefixes, L<URI::Fast::Sorted>.
+
 =head1 ENCODING
 
 C<URI::Fast> tries to do the right thing in most cases with regard to reserved
@@ -824,6 +1097,73 @@ attempts to parse URLs more in line with how browsers do, but no guarantees are
 made as HTML standards and browser implementations are an ever shifting
 landscape.
 
+=head1 SERIALIZATION
+
+C<URI::Fast> objects may be serialized with L<Storable> (including
+L<Storable/dclone>) and L<Sereal> (with its C<freeze_callbacks> option). The
+URI's components are stored in a compact binary form, along with whether it is
+an IRI, and are copied directly into the new object when it is thawed, so the
+URI is not parsed again.
+
+  my $copy = Storable::thaw(Storable::freeze($uri));
+
+Thawed objects are always modifiable, including those frozen from the
+read-only views returned by L<URI::Fast::Table>.
+
+=head1 THREADS
+
+C<URI::Fast> objects, along with L<URI::Fast::Set>, L<URI::Fast::Bloom>,
+L<URI::Fast::Table>, L<URI::Fast::Array>, and L<URI::Fast::Sorted> objects,
+are copied when a new thread is created, as Perl copies other data.
+Changes made to an object in one thread are not seen by the others. Readers,
+such as L<URI::Fast::Reader>, are not copied.
+
+=head1 STATISTICS
+
+When built with C<STATS=1 perl Makefile.PL>, C<URI::Fast> counts its
+allocations and calls to its core routines. The counters cost little, but are
+compiled out entirely in a normal build.
+
+=head2 URI::Fast::stats
+
+Returns a hash ref of the counts since the module was loaded or the counts
+were last reset, or C<undef> if the module was built without C<STATS=1>.
+
+=over
+
+=item allocs, reallocs, alloc_bytes
+
+String buffers and structs allocated, buffers resized, and the bytes allocated
+(counting only growth of resized buffers). Memory allocated by Perl, such as
+for the values returned by accessors, is not included.
+
+=item uri_new, uri_free
+
+URIs allocated and freed: one for each C<URI::Fast> object, as well as some
+used internally.
+
+=item scan_calls, scan_bytes
+
+URI strings parsed, and their total length in bytes.
+
+=item encode_calls, encode_bytes, decode_calls, decode_bytes
+
+Strings percent-encoded and decoded, and their total length in bytes.
+
+=item query_scans, query_tokens
+
+Query strings scanned, and the keys and key/value pairs found in them.
+
+=back
+
+The counters are shared by all threads and are not synchronized, so counts
+made while several threads are working (including L</parse_file_parallel>'s
+workers) are approximate.
+
+=head2 URI::Fast::reset_stats
+
+Resets the counters to zero.
+
 =head1 SPEED
 
 See L<URI::Fast::Benchmarks>.
@@ -0,0 +1,108 @@
+package URI::Fast::AccessLog;
+
+use strict;
+use warnings;
+
+require URI::Fast;
+require URI::Fast::Reader;
+our $VERSION = '0.55';
+
+=head1 NAME
+
+URI::Fast::AccessLog - parse request and referer URIs from web server logs
+
+=head1 SYNOPSIS
+
+  use URI::Fast::AccessLog;
+
+  my $log = URI::Fast::AccessLog->new('/var/log/httpd/access_log');
+
+  while (my ($request, $referer) = $log->next) {
+    $hits{ $request->path }++;
+    $sites{ $referer->host }++ if defined $referer;
+  }
+
+  # Or in batches of columns
+  while (my $cols = $log->columns(10_000)) {
+    my $paths = $cols->{path};
+    my $hosts = $cols->{referer_host};
+    ...
+  }
+
+=head1 DESCRIPTION
+
+Reads lines in the Common or Combined Log Format used by Apache, nginx, and
+most other web servers:
+
+  1.2.3.4 - - [10/Oct/2000:13:55:36 -0700] "GET /a?b=1 HTTP/1.1" 200 2326 "http://example.com/" "Mozilla/4.08"
+
+The request-target is taken from the first quoted field (the request line) and
+the referer from the quoted field following it. Both are parsed in place, as
+by L<URI::Fast::Reader>, without first copying the line or its fields into
+Perl strings.
+
+Lines without a request line, such as the C<"-"> logged when a client
+disconnects before sending a request, are skipped (see L</skipped>). Escape
+sequences (such as C<\">) within quoted fields are not decoded.
+
+=head1 METHODS
+
+=head2 new
+
+Accepts either a file path or an open file handle, along with the same options
+as L<URI::Fast::Reader/new>.
+
+=head2 next
+
+Parses the next line, returning a list of the request-target and the referer
+as L<URI::Fast> objects. The referer is C<undef> when it is missing or C<->.
+Returns an empty list at the end of the input.
+
+B<The same two objects are reused for every line>, as with
+L<URI::Fast::Reader/next>.
+
+=head2 columns
+
+Parses up to the specified number of lines (1000 by default) and returns a hash
+ref of array refs holding the raw (encoded) components of each, keyed by
+C<scheme>, C<host>, C<port>, C<path>, C<query>, and C<frag> for the
+request-target and C<referer_scheme>, C<referer_host>, etc. for the referer.
+Empty or missing components are C<undef>, except for the request-target's
+C<path>. Returns C<undef> at the end of the input.
+
+  my $cols = $log->columns(5000);
+  for my $i (0 .. $#{ $cols->{path} }) {
+    say $cols->{path}[$i], ' <- ', $cols->{referer_host}[$i] // '-';
+  }
+
+=head2 line
+
+Returns the number of lines read so far.
+
+=head2 skipped
+
+Returns the number of lines skipped because they did not contain a request
+line.
+
+=head1 THREADS
+
+A reader holds an open file or partial input and is not copied into new
+threads; in the new thread, it becomes an unblessed reference to C<undef>.
+
+=head1 AUTHOR
+
+Jeff Ober <sysread@fastmail.fm>
+
+=head1 COPYRIGHT AND LICENSE
+
+This software is copyright (c) 2018 by Jeff Ober. This is free software; you
+can redistribute it and/or modify it under the same terms as the Perl 5
+programming language system itself.
+
+=cut
+
+*new = \&URI::Fast::Reader::new;
+
+sub CLONE_SKIP { 1 }
+
+1;
@@ -0,0 +1,115 @@
+package URI::Fast::Array;
+
+use strict;
+use warnings;
+
+require URI::Fast;
+our $VERSION = '0.55';
+
+=head1 NAME
+
+URI::Fast::Array - a compact array of parsed URIs
+
+=head1 SYNOPSIS
+
+  use URI::Fast::Array;
+
+  my $urls = URI::Fast::Array->new;
+  $urls->push($_) for @strings;
+
+  for my $i (0 .. $urls->count - 1) {
+    say $urls->host_at($i);
+  }
+
+  my $uri = $urls->get(42);
+  say $urls->memory_usage / $urls->count, ' bytes per URI';
+
+=head1 DESCRIPTION
+
+Holding many L<URI::Fast> objects is expensive: each is a blessed reference to
+a C struct holding a separate buffer for each component. This class instead
+stores URIs as packed records, back to back in a single buffer, with the raw
+(encoded) bytes of each component but none of the separators between them, so
+that the memory used for each URI is close to the length of its string.
+
+URIs are parsed once, as they are added. Entries may be retrieved as objects,
+as strings, or one component at a time without building an object at all.
+
+Every method accepting a URI accepts either a L<URI::Fast> object or a string.
+
+=head1 METHODS
+
+=head2 new
+
+Creates a new, empty array. If the C<iri> option is true, strings are parsed
+and entries are returned as L<URI::Fast::IRI> objects.
+
+  my $iris = URI::Fast::Array->new(iri => 1);
+
+=head2 push
+
+Adds one or more URIs to the end of the array and returns the new count.
+
+=head2 count
+
+Returns the number of URIs in the array.
+
+=head2 get
+
+Returns a new L<URI::Fast> object holding a copy of the URI at the specified
+index, or C<undef> if the index is out of range. Negative indices count back
+from the end of the array. Changes to the object do not affect the array.
+
+=head2 string_at
+
+Returns the string form of the URI at the specified index, or C<undef>.
+
+=head2 scheme_at
+
+=head2 usr_at
+
+=head2 pwd_at
+
+=head2 host_at
+
+=head2 port_at
+
+=head2 path_at
+
+=head2 query_at
+
+=head2 frag_at
+
+Returns the decoded component of the URI at the specified index, as the
+matching L<URI::Fast> getter would in scalar context, or C<undef> if the index
+is out of range.
+
+  my %hosts;
+  ++$hosts{ $urls->host_at($_) } for 0 .. $urls->count - 1;
+
+=head2 memory_usage
+
+Returns the number of bytes allocated to store the array.
+
+=head2 is_iri
+
+Returns true if the array was created with the C<iri> option.
+
+=head1 AUTHOR
+
+Jeff Ober <sysread@fastmail.fm>
+
+=head1 COPYRIGHT AND LICENSE
+
+This software is copyright (c) 2018 by Jeff Ober. This is free software; you
+can redistribute it and/or modify it under the same terms as the Perl 5
+programming language system itself.
+
+=cut
+
+sub new {
+  my ($class, %opt) = @_;
+  return $class->_new($opt{iri} ? 1 : 0);
+}
+
+1;
@@ -0,0 +1,177 @@
+package URI::Fast::Bloom;
+
+use strict;
+use warnings;
+
+use Carp;
+require URI::Fast;
+our $VERSION = '0.55';
+
+=head1 NAME
+
+URI::Fast::Bloom - a Bloom filter over normalized URIs
+
+=head1 SYNOPSIS
+
+  use URI::Fast::Bloom;
+
+  my $seen = URI::Fast::Bloom->new(expected => 50_000_000, error_rate => 0.01);
+
+  for my $url (@urls) {
+    next unless $seen->add($url); # definitely new
+    ...
+  }
+
+  # Share with forked workers
+  $seen->save('/var/tmp/seen.bloom');
+
+  my $seen = URI::Fast::Bloom->load('/var/tmp/seen.bloom');
+  crawl($url) unless $seen->maybe_contains($url);
+
+=head1 DESCRIPTION
+
+A space-efficient, probabilistic set of URIs, implemented in C. A Bloom filter
+may report false positives (that a URI is present when it is not), but never
+false negatives.
+
+Keys are the L<URI::Fast/fingerprint> of each URI, so URIs which are
+equivalent after L<URI::Fast/normalize> are treated as the same key. The
+filter is I<blocked>: all of the bits for a key fall within the same 64 byte
+block, so that each operation touches a single cache line. This comes at the
+cost of a slightly higher false positive rate than a classic Bloom filter of
+the same size.
+
+Every method accepting a URI accepts either a L<URI::Fast> object or a string.
+
+=head1 METHODS
+
+=head2 new
+
+Creates a new, empty filter. The size of the filter may be given directly:
+
+=over
+
+=item bits
+
+The number of bits in the filter. This is rounded up to a multiple of 512.
+
+=item hashes
+
+The number of bits set for each key (1-32). Defaults to 7.
+
+=back
+
+...or calculated from the expected number of keys and acceptable rate of
+false positives:
+
+=over
+
+=item expected
+
+The number of URIs expected to be added.
+
+=item error_rate
+
+The acceptable rate of false positives once C<expected> URIs have been added.
+Defaults to 0.01.
+
+=back
+
+=head2 load
+
+Loads a filter previously written with L</save>. Where the platform supports
+it, the file is mapped into memory read-only and shared, so that any number
+of processes may load the same filter at the cost of a single copy. Loaded
+filters are read-only; L</add> will croak.
+
+  my $seen = URI::Fast::Bloom->load($path);
+
+=head2 save
+
+Writes the filter to a file, overwriting it if it exists. The format is
+independent of platform and byte order.
+
+=head2 add
+
+Adds a URI to the filter. Returns true if the URI was definitely not already
+present.
+
+=head2 add_many
+
+Accepts an array ref of URIs and adds each to the filter. Returns the number
+of URIs which were definitely not already present.
+
+=head2 maybe_contains
+
+Returns true if the URI may be present in the filter. Returns false if the URI
+is definitely not present.
+
+=head2 maybe_contains_many
+
+Accepts an array ref of URIs and returns an array ref of booleans as
+L</maybe_contains> would for each.
+
+=head2 bits
+
+Returns the number of bits in the filter.
+
+=head2 hashes
+
+Returns the number of bits set for each key.
+
+=head2 count
+
+Returns the number of calls to L</add> which returned true; an estimate of the
+number of distinct URIs added.
+
+=head2 is_readonly
+
+Returns true if the filter was L<loaded|/load> from a file.
+
+=head2 is_mapped
+
+Returns true if the filter was L<loaded|/load> from a file which is mapped
+into memory, rather than read, and so is shared with other processes which
+have loaded it.
+
+=head1 AUTHOR
+
+Jeff Ober <sysread@fastmail.fm>
+
+=head1 COPYRIGHT AND LICENSE
+
+This software is copyright (c) 2018 by Jeff Ober. This is free software; you
+can redistribute it and/or modify it under the same terms as the Perl 5
+programming language system itself.
+
+=cut
+
+sub new {
+  my ($class, %opt) = @_;
+  my $bits   = $opt{bits};
+  my $hashes = $opt{hashes};
+
+  croak 'URI::Fast::Bloom: hashes must be positive'
+    if defined $hashes && $hashes <= 0;
+
+  if (defined $opt{expected}) {
+    croak 'URI::Fast::Bloom: expected must be positive'
+      unless $opt{expected} > 0;
+
+    my $rate = $opt{error_rate} || 0.01;
+
+    croak 'URI::Fast::Bloom: error_rate must be between 0 and 1'
+      unless $rate > 0 && $rate < 1;
+
+    $bits ||= int(-$opt{expected} * log($rate) / (log(2) ** 2)) + 1;
+    $hashes //= int(($bits / $opt{expected}) * log(2) + 0.5) || 1;
+    $hashes = 32 if $hashes > 32;
+  }
+
+  croak 'URI::Fast::Bloom: bits or expected is required'
+    unless $bits;
+
+  return $class->_new($bits, $hashes // 7);
+}
+
+1;
@@ -0,0 +1,93 @@
+package URI::Fast::Links;
+
+use strict;
+use warnings;
+
+require URI::Fast;
+our $VERSION = '0.55';
+
+=head1 NAME
+
+URI::Fast::Links - extract links from HTML as it arrives
+
+=head1 SYNOPSIS
+
+  use URI::Fast::Links;
+
+  my $links = URI::Fast::Links->new(base => 'http://www.example.com/dir/');
+
+  while (sysread $socket, my $chunk, 65536) {
+    foreach my $uri ($links->push($chunk)) {
+      enqueue($uri) if $uri->scheme =~ /^https?$/;
+    }
+  }
+
+=head1 DESCRIPTION
+
+An incremental link extractor for HTML which may be fed a document in chunks of
+any size, such as those returned by non-blocking reads. The state of the
+tokenizer, including partial tags and attribute values, is carried from one
+chunk to the next.
+
+The values of C<href> and C<src> attributes are returned as L<URI::Fast>
+objects after decoding character references (such as C<&amp;>), applying the
+same clean up as L<URI::Fast/html_url>, resolving them against the base URI
+(if any), and normalizing them. The base URI is parsed once, rather than for
+each link.
+
+Comments, end tags, and the contents of elements such as C<script>, C<style>,
+and C<textarea> are skipped. The C<href> of the first C<base> element replaces
+the base URI for the links which follow it.
+
+Chunks are treated as bytes. A character string will be processed as its
+UTF-8 encoding.
+
+=head1 METHODS
+
+=head2 new
+
+Accepts an optional C<base> URI, as either a string or a L<URI::Fast> object.
+Without a base, relative links are left relative. Links are normalized either
+way, so C<HTTP://X.com/A b> is returned as C<http://x.com/A%20b>.
+
+=head2 push
+
+Feeds the next chunk of HTML to the extractor and returns a list of links
+completed within it.
+
+=head2 base
+
+Returns a copy of the current base URI, or C<undef>.
+
+=head2 reset
+
+Discards any partially parsed markup in order to begin a new document,
+optionally with a new base URI.
+
+  $links->reset('http://www.example.com/other/');
+
+=head1 THREADS
+
+An extractor holds partially parsed markup and is not copied into new threads;
+in the new thread, it becomes an unblessed reference to C<undef>.
+
+=head1 AUTHOR
+
+Jeff Ober <sysread@fastmail.fm>
+
+=head1 COPYRIGHT AND LICENSE
+
+This software is copyright (c) 2018 by Jeff Ober. This is free software; you
+can redistribute it and/or modify it under the same terms as the Perl 5
+programming language system itself.
+
+=cut
+
+sub new {
+  my ($class, %opt) = @_;
+  return $class->_new($opt{base});
+}
+
+sub CLONE_SKIP { 1 }
+
+1;
@@ -0,0 +1,117 @@
+package URI::Fast::Reader;
+
+use strict;
+use warnings;
+
+use Carp;
+require URI::Fast;
+our $VERSION = '0.55';
+
+=head1 NAME
+
+URI::Fast::Reader - read newline-delimited URIs quickly
+
+=head1 SYNOPSIS
+
+  use URI::Fast::Reader;
+
+  my $reader = URI::Fast::Reader->new('urls.txt');
+
+  while (defined(my $uri = $reader->next)) {
+    next unless $uri->scheme eq 'https';
+    ...
+  }
+
+  # From a pipe or other handle
+  my $reader = URI::Fast::Reader->new(\*STDIN);
+
+  while (my ($scheme, $auth, $path, $query, $frag) = $reader->next_split) {
+    ...
+  }
+
+=head1 DESCRIPTION
+
+Reads URIs, one per line, from a file or file handle. Files are mapped into
+memory when possible; handles (and files which cannot be mapped, such as named
+pipes) are read in large blocks. Line boundaries are located with C<memchr>,
+which is vectorized by most C libraries, and each line is parsed directly from
+the mapped or buffered data, avoiding the per-line C<readline>, C<chomp>, and
+scalar allocation of the usual C<while (E<lt>$fhE<gt>)> loop.
+
+Leading and trailing white space (including the carriage return of a CRLF line
+ending) is trimmed from each line, exactly as L<URI::Fast/uri> does. Blank
+lines are skipped.
+
+=head1 METHODS
+
+=head2 new
+
+Accepts either a file path or an open file handle. Handles should be in
+C<:raw> mode, as data is read without regard to I/O layers' line-ending
+translation. Optionally accepts C<iri =E<gt> 1> to return L<URI::Fast::IRI>
+objects.
+
+  my $reader = URI::Fast::Reader->new($path, iri => 1);
+
+=head2 next
+
+Parses the next line and returns it as a L<URI::Fast> object, or returns
+C<undef> at the end of the input.
+
+B<The same object is reused for every line>, so it is only valid until the
+next call to C<next>. Use L<URI::Fast/clone> to keep a copy.
+
+Test the result with C<defined> rather than for truth; otherwise the URI is
+stringified on every iteration to evaluate it in boolean context.
+
+=head2 next_split
+
+Parses the next line and returns its raw (encoded) components as a list of
+C<($scheme, $auth, $path, $query, $frag)>, as L<URI::Fast/uri_split> would.
+Missing components are C<undef>. Returns an empty list at the end of the input.
+
+=head2 line
+
+Returns the number of lines read so far, including blank lines.
+
+=head1 THREADS
+
+A reader holds an open file or partial input and is not copied into new
+threads; in the new thread, it becomes an unblessed reference to C<undef>.
+
+=head1 AUTHOR
+
+Jeff Ober <sysread@fastmail.fm>
+
+=head1 COPYRIGHT AND LICENSE
+
+This software is copyright (c) 2018 by Jeff Ober. This is free software; you
+can redistribute it and/or modify it under the same terms as the Perl 5
+programming language system itself.
+
+=cut
+
+sub new {
+  my ($class, $src, %opt) = @_;
+  my $iri = $opt{iri} ? 1 : 0;
+
+  croak "$class: file path or handle required"
+    unless defined $src;
+
+  if (ref $src || ref \$src eq 'GLOB') {
+    return $class->_new_fh($src, $iri);
+  }
+
+  if (my $reader = $class->_new_path($src, $iri)) {
+    return $reader;
+  }
+
+  open my $fh, '<:raw', $src
+    or croak "$class: unable to open $src: $!";
+
+  return $class->_new_fh($fh, $iri);
+}
+
+sub CLONE_SKIP { 1 }
+
+1;
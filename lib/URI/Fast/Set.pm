@@ -0,0 +1,84 @@
+package URI::Fast::Set;
+
+use strict;
+use warnings;
+
+require URI::Fast;
+our $VERSION = '0.55';
+
+=head1 NAME
+
+URI::Fast::Set - a compact set of normalized URIs
+
+=head1 SYNOPSIS
+
+  use URI::Fast::Set;
+
+  my $seen = URI::Fast::Set->new(100_000);
+
+  for my $url (@urls) {
+    next unless $seen->add($url);
+    ...
+  }
+
+  if ($seen->contains('HTTP://www.Example.com')) {
+    ...
+  }
+
+=head1 DESCRIPTION
+
+A hash set of URIs, implemented in C. Membership is determined by the
+normalized form of each URI (see L<URI::Fast/normalize>), so that equivalent
+URIs are treated as the same member.
+
+Members are stored as normalized strings, back to back in a single buffer,
+indexed by their L<URI::Fast/fingerprint>. No perl scalars are allocated per
+member, making this much more compact than a hash of strings for large
+numbers of URIs. Normalization, hashing, and lookup are all performed in a
+single pass without building any intermediate objects.
+
+Every method accepting a URI accepts either a L<URI::Fast> object or a string.
+
+=head1 METHODS
+
+=head2 new
+
+Creates a new, empty set. Optionally accepts the number of members expected,
+allowing the set to be presized.
+
+  my $set = URI::Fast::Set->new;
+  my $set = URI::Fast::Set->new(1_000_000);
+
+=head2 add
+
+Adds a URI to the set. Returns true if it was not already a member.
+
+=head2 contains
+
+Returns true if the URI is a member of the set.
+
+=head2 remove
+
+Removes a URI from the set. Returns true if it was a member.
+
+=head2 size
+
+Returns the number of members of the set.
+
+=head2 memory_usage
+
+Returns the number of bytes allocated by the set.
+
+=head1 AUTHOR
+
+Jeff Ober <sysread@fastmail.fm>
+
+=head1 COPYRIGHT AND LICENSE
+
+This software is copyright (c) 2018 by Jeff Ober. This is free software; you
+can redistribute it and/or modify it under the same terms as the Perl 5
+programming language system itself.
+
+=cut
+
+1;
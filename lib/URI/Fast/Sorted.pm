@@ -0,0 +1,142 @@
+package URI::Fast::Sorted;
+
+use strict;
+use warnings;
+
+require URI::Fast;
+our $VERSION = '0.55';
+
+=head1 NAME
+
+URI::Fast::Sorted - a prefix compressed, sorted list of URIs
+
+=head1 SYNOPSIS
+
+  use URI::Fast::Sorted;
+
+  my $frontier = URI::Fast::Sorted->new(\@urls);
+
+  if (!$frontier->contains($url)) {
+    ...
+  }
+
+  # Everything under a path
+  my $i = $frontier->lower_bound('https://www.example.com/blog/');
+  while (my $next = $frontier->string_at($i++)) {
+    last unless $next =~ m{^https://www\.example\.com/blog/};
+    say $next;
+  }
+
+  $frontier->save('/var/tmp/frontier.sorted');
+  my $shared = URI::Fast::Sorted->load('/var/tmp/frontier.sorted');
+
+=head1 DESCRIPTION
+
+A sorted list of distinct URIs, stored as the strings produced by
+L<URI::Fast/normalize> in byte-wise order. Sorted URIs share long prefixes:
+the scheme, the host, and often much of the path. The list is stored in blocks
+of 16 strings. The first string of each block is stored whole. Each later
+string is stored as the length of the prefix it shares with the one before it,
+followed by the rest of the string.
+
+How much memory this saves depends on how much neighbouring URIs share. A
+crawl frontier or sitemap with many URIs per host is often reduced to a
+fraction of the size of its strings. URIs with few hosts in common compress
+much less.
+
+An entry is retrieved by decoding a single block. A URI is found by a binary
+search over the first string of each block, followed by a scan of one block.
+
+Every method accepting a URI accepts either a L<URI::Fast> object or a string.
+URIs are normalized before they are added or searched for, so equivalent URIs
+are treated as the same URI.
+
+=head1 METHODS
+
+=head2 new
+
+Creates a new list. If an array ref of URIs is passed, the URIs may be in any
+order; they are normalized, sorted, and added. Duplicates are added once.
+
+=head2 load
+
+Loads a list previously written with L</save>. Where the platform supports it,
+the file is mapped into memory read-only and shared by every process which
+loads it. Loaded lists are read-only.
+
+=head2 save
+
+Writes the list to a file, overwriting it if it exists. The format is
+independent of platform and byte order.
+
+=head2 add
+
+Adds a URI to the end of the list. Because the list is built in order, the
+normalized URI must sort after the last URI added; otherwise, C<add> croaks.
+Returns false if the URI is equal to the last URI added, in which case it is
+not added again.
+
+=head2 add_all
+
+Adds an array ref of URIs, in any order, and returns the number added. As with
+L</add>, each must sort after the last URI already in the list.
+
+=head2 count
+
+Returns the number of URIs in the list.
+
+=head2 string_at
+
+Returns the normalized string at the specified index, or C<undef> if the index
+is out of range. Negative indices count back from the end of the list.
+
+=head2 get
+
+Returns a new L<URI::Fast> object parsed from the string at the specified
+index, or C<undef>.
+
+=head2 lower_bound
+
+Returns the index of the first URI which does not sort before the normalized
+URI. If every URI sorts before it, returns the number of URIs in the list.
+
+=head2 find
+
+Returns the index of the URI equivalent to the URI, or C<undef>.
+
+=head2 contains
+
+Returns true if the list includes a URI equivalent to the URI.
+
+=head2 memory_usage
+
+Returns the number of bytes allocated to store the list. For a loaded list,
+this is the size of the file.
+
+=head2 is_readonly
+
+Returns true if the list was loaded from a file.
+
+=head1 THREADS
+
+When a new thread is created, the list is copied into memory for the new
+thread.
+
+=head1 AUTHOR
+
+Jeff Ober <sysread@fastmail.fm>
+
+=head1 COPYRIGHT AND LICENSE
+
+This software is copyright (c) 2018 by Jeff Ober. This is free software; you
+can redistribute it and/or modify it under the same terms as the Perl 5
+programming language system itself.
+
+=cut
+
+sub new {
+  my ($class, $uris) = @_;
+  return $class->_new($uris);
+}
+
+1;
@@ -0,0 +1,143 @@
+package URI::Fast::Table;
+
+use strict;
+use warnings;
+use Carp;
+
+require URI::Fast;
+our $VERSION = '0.55';
+
+=head1 NAME
+
+URI::Fast::Table - a packed, memory mapped table of parsed URIs
+
+=head1 SYNOPSIS
+
+  use URI::Fast::Table;
+
+  # Once, at build time
+  URI::Fast::Table->write('/var/tmp/routes.table', \@urls);
+
+  # In each worker
+  my $routes = URI::Fast::Table->load('/var/tmp/routes.table');
+
+  if (my $route = $routes->lookup($request_url)) {
+    say $route->path;
+  }
+
+  for my $i (0 .. $routes->count - 1) {
+    say $routes->get($i)->host;
+  }
+
+=head1 DESCRIPTION
+
+A read-only collection of parsed URIs, written once to a file and then loaded
+by any number of processes. Where the platform supports it, the file is mapped
+into memory read-only, so that every process loading it shares a single copy,
+and loading it is immediate regardless of its size: nothing is parsed and no
+Perl data is built until an entry is requested. Unlike a table of URIs built
+in Perl before forking, the shared pages are never written to, so they remain
+shared for the life of each process.
+
+Each entry's components are stored ready to be copied into a L<URI::Fast>
+object. Entries are returned as I<views>: objects which may be used as any
+other, except that they are read-only. Methods which would modify a view
+croak; use L<URI::Fast/clone> to obtain a modifiable copy.
+
+The file may optionally include an index of the entries'
+L<URI::Fast/fingerprint>s, with which entries equivalent to a URI (after
+L<URI::Fast/normalize>) may be found without scanning the table.
+
+Every method accepting a URI accepts either a L<URI::Fast> object or a string.
+
+=head1 METHODS
+
+=head2 write
+
+Writes an array ref of URIs to a new table file, overwriting it if it exists.
+The format is independent of platform and byte order. Accepts the following
+options:
+
+=over
+
+=item index
+
+When true (the default), the table includes a fingerprint index, enabling
+L</find>, L</lookup>, and L</contains>.
+
+=item iri
+
+When true, entries are parsed and returned as L<URI::Fast::IRI> objects.
+
+=back
+
+  URI::Fast::Table->write($path, \@urls, index => 0);
+
+=head2 load
+
+Loads a table previously written with L</write>.
+
+=head2 count
+
+Returns the number of entries in the table.
+
+=head2 get
+
+Returns a read-only view of the entry at the specified index, or C<undef> if
+the index is out of range. Negative indices count back from the end of the
+table.
+
+=head2 find
+
+Returns the index of the first entry equivalent to the URI, or C<undef>.
+
+=head2 lookup
+
+Returns a read-only view of the first entry equivalent to the URI, or
+C<undef>.
+
+=head2 contains
+
+Returns true if the table includes an entry equivalent to the URI.
+
+=head2 has_index
+
+Returns true if the table was written with an index.
+
+=head2 is_iri
+
+Returns true if the table was written with the C<iri> option.
+
+=head2 is_mapped
+
+Returns true if the table is mapped from its file rather than read into
+memory. Tables copied into a new thread are never mapped.
+
+=head1 THREADS
+
+When a new thread is created, the table is copied into memory for the new
+thread.
+
+=head1 AUTHOR
+
+Jeff Ober <sysread@fastmail.fm>
+
+=head1 COPYRIGHT AND LICENSE
+
+This software is copyright (c) 2018 by Jeff Ober. This is free software; you
+can redistribute it and/or modify it under the same terms as the Perl 5
+programming language system itself.
+
+=cut
+
+sub write {
+  my ($class, $path, $uris, %opt) = @_;
+
+  croak "$class: file path required"
+    unless defined $path;
+
+  $class->_write($path, $uris, ($opt{iri} ? 1 : 0), (exists $opt{index} && !$opt{index} ? 0 : 1));
+  return;
+}
+
+1;
@@ -109,4 +109,24 @@ subtest 'edge cases - https://www.rfc-editor.org/rfc/rfc3986.txt 5.4.2' => sub{
   }
 };
 
+subtest 'network-path references in the path buffer' => sub{
+  my @cases = (
+    ["//g",            "http://g"],
+    ["//g/h/../i",     "http://g/i"],
+    ["//u:p\@g:81/x",  "http://u:p\@g:81/x"],
+    ["///x",           "http://a/x"],
+    ["//",             "http://a/b/c/d;p?q"],
+  );
+
+  foreach my $test (@cases) {
+    my ($path, $exp) = @$test;
+
+    my $rel = uri;
+    $rel->raw_path($path);
+
+    is $rel->absolute($base), $exp, "absolute: $path -> $exp";
+    is $rel->raw_path, $path, "relative uri unchanged: $path";
+  }
+};
+
 done_testing;
@@ -0,0 +1,114 @@
+use utf8;
+use ExtUtils::testlib;
+use Test2::V0;
+use File::Temp qw(tempfile);
+use URI::Fast qw(uri);
+use URI::Fast::AccessLog;
+
+sub write_file {
+  my ($fh, $path) = tempfile(UNLINK => 1);
+  binmode $fh;
+  print $fh @_;
+  close $fh;
+  return $path;
+}
+
+sub sources {
+  my $path = write_file(@_);
+  open my $fh, '<:raw', $path or die $!;
+  return (path => $path, handle => $fh);
+}
+
+my $prefix = '1.2.3.4 - frank [10/Oct/2000:13:55:36 -0700]';
+
+my @lines = (
+  qq{$prefix "GET /apache_pb.gif?x=1 HTTP/1.0" 200 2326 "http://www.example.com/start.html" "Mozilla/4.08"},
+  qq{$prefix "POST /form HTTP/1.1" 302 - "-" "curl/7.1"},
+  qq{$prefix "GET /common HTTP/1.1" 200 12\r},
+  '',
+  qq{$prefix "-" 408 -},
+  qq{$prefix "GET http://proxy.example.com:8080/a#b HTTP/1.1" 200 1 "https://ref.example.com/q?\\"x\\"" "agent"},
+  qq{$prefix "GET /old"},
+  'garbage',
+);
+
+my @expect = (
+  ['/apache_pb.gif?x=1', 'http://www.example.com/start.html'],
+  ['/form', undef],
+  ['/common', undef],
+  ['http://proxy.example.com:8080/a#b', 'https://ref.example.com/q?\\"x\\"'],
+  ['/old', undef],
+);
+
+subtest 'next' => sub{
+  my %sources = sources(join "\n", @lines);
+
+  foreach my $name (sort keys %sources) {
+    my $log = URI::Fast::AccessLog->new($sources{$name});
+    my @got;
+
+    while (my ($req, $ref) = $log->next) {
+      isa_ok $req, 'URI::Fast';
+      push @got, [$req->to_string, defined $ref ? $ref->to_string : undef];
+    }
+
+    is \@got, \@expect, "$name: request and referer";
+    is $log->line, scalar(@lines), "$name: line";
+    is $log->skipped, 2, "$name: skipped";
+    is [$log->next], [], "$name: empty after eof";
+  }
+};
+
+subtest 'components' => sub{
+  my $log = URI::Fast::AccessLog->new(write_file(join "\n", @lines));
+  my ($req, $ref) = $log->next;
+  is $req->path, '/apache_pb.gif', 'path';
+  is $req->param('x'), '1', 'param';
+  is $ref->host, 'www.example.com', 'referer host';
+};
+
+subtest 'columns' => sub{
+  my %sources = sources(join "\n", @lines);
+
+  foreach my $name (sort keys %sources) {
+    my $log = URI::Fast::AccessLog->new($sources{$name});
+
+    my $cols = $log->columns(3);
+    is $cols->{path}, ['/apache_pb.gif', '/form', '/common'], "$name: path";
+    is $cols->{query}, ['x=1', undef, undef], "$name: query";
+    is $cols->{referer_host}, ['www.example.com', undef, undef], "$name: referer_host";
+    is $cols->{referer_path}, ['/start.html', undef, undef], "$name: referer_path";
+
+    $cols = $log->columns;
+    is $cols->{scheme}, ['http', undef], "$name: scheme";
+    is $cols->{host}, ['proxy.example.com', undef], "$name: host";
+    is $cols->{port}, ['8080', undef], "$name: port";
+    is $cols->{frag}, ['b', undef], "$name: frag";
+    is $cols->{referer_scheme}, ['https', undef], "$name: referer_scheme";
+
+    is $log->columns, U(), "$name: undef after eof";
+  }
+
+  like dies{ URI::Fast::AccessLog->new(write_file(''))->columns(0) }, qr/positive/, 'invalid count';
+};
+
+subtest 'block boundaries' => sub{
+  my @many = map{ qq{$prefix "GET /$_/} . ('x' x ($_ % 1000)) . qq{ HTTP/1.1" 200 1 "http://ref.example.com/$_" "a"} } 1 .. 5000;
+  my %sources = sources(join "\n", @many);
+
+  foreach my $name (sort keys %sources) {
+    my $log = URI::Fast::AccessLog->new($sources{$name});
+    my ($count, $bad) = (0, 0);
+
+    while (my ($req, $ref) = $log->next) {
+      ++$count;
+      ++$bad unless $req->path eq "/$count/" . ('x' x ($count % 1000))
+                 && $ref->path eq "/$count";
+    }
+
+    is $count, 5000, "$name: count";
+    is $bad, 0, "$name: all lines match";
+  }
+};
+
+done_testing;
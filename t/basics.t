@@ -205,6 +205,33 @@ subtest 'non-standard inputs' => sub{
   };
 };
 
+subtest 'reparse' => sub{
+  my $uri = uri $uris[3];
+  is $uri->reparse($uris[2]), $uri, 'returns self';
+  is "$uri", $uris[2], 'reparsed';
+  is $uri->port, '', 'previous port cleared';
+  is $uri->frag, '', 'previous frag cleared';
+  is $uri->param('cccc'), 'dddd', 'param';
+
+  $uri->reparse($_) foreach @uris;
+  is "$uri", $uris[-1], 'repeated';
+
+  $uri->reparse(undef);
+  is "$uri", '', 'undef';
+
+  $uri->reparse(uri($uris[1]));
+  is $uri->host, 'www.test.com', 'URI::Fast object';
+
+  $uri->reparse($uri);
+  is "$uri", $uris[1], 'itself';
+
+  my $iri = URI::Fast::iri('http://www.example.com');
+  $iri->reparse('http://www.çæ∂î∫∫å.com/ƒø∫');
+  isa_ok $iri, 'URI::Fast::IRI';
+  is $iri->host, 'www.çæ∂î∫∫å.com', 'iri host';
+  is "$iri", 'http://www.çæ∂î∫∫å.com/ƒø∫', 'iri string';
+};
+
 subtest 'append' => sub{
   my $uri = uri 'http://www.example.com/foo?k=v';
   ok $uri->append('bar', 'baz/bat', '?k=v1&k=v2', '#fnord', 'slack'), 'append';
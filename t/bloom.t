@@ -0,0 +1,105 @@
+use utf8;
+use ExtUtils::testlib;
+use Test2::V0;
+use File::Temp qw(tempfile);
+use URI::Fast qw(uri);
+use URI::Fast::Bloom;
+
+subtest 'basics' => sub{
+  my $bloom = URI::Fast::Bloom->new(bits => 1000, hashes => 5);
+  is $bloom->bits, 1024, 'bits rounded up to block size';
+  is $bloom->hashes, 5, 'hashes';
+  is $bloom->count, 0, 'count';
+  ok !$bloom->is_readonly, '!is_readonly';
+
+  ok !$bloom->maybe_contains('http://www.example.com'), '!maybe_contains';
+  ok $bloom->add('http://www.example.com'), 'add';
+  ok !$bloom->add('http://www.example.com'), 'add: duplicate';
+  ok $bloom->maybe_contains('http://www.example.com'), 'maybe_contains';
+  ok $bloom->maybe_contains('HTTP://WWW.EXAMPLE.COM/'), 'maybe_contains: equivalent';
+  ok $bloom->maybe_contains(uri 'http://www.example.com/a/..'), 'maybe_contains: object';
+  is $bloom->count, 1, 'count';
+};
+
+subtest 'sizing' => sub{
+  my $bloom = URI::Fast::Bloom->new(expected => 10_000, error_rate => 0.01);
+  ok $bloom->bits >= 95_850, 'bits';
+  is $bloom->hashes, 7, 'hashes';
+
+  ok dies{ URI::Fast::Bloom->new }, 'size required';
+  ok dies{ URI::Fast::Bloom->new(bits => 1024, hashes => 33) }, 'hashes limited';
+  like dies{ URI::Fast::Bloom->new(bits => 1024, hashes => 0) }, qr/hashes must be positive/, 'hashes: zero';
+  like dies{ URI::Fast::Bloom->new(expected => 100, hashes => -1) }, qr/hashes must be positive/, 'hashes: negative';
+  ok dies{ URI::Fast::Bloom->new(expected => 100, error_rate => 2) }, 'error_rate limited';
+};
+
+subtest 'false positives' => sub{
+  my $n = 10_000;
+  my $bloom = URI::Fast::Bloom->new(expected => $n, error_rate => 0.01);
+  my @uris = map{ "http://www.example.com/in/$_" } 1 .. $n;
+
+  my $added = $bloom->add_many(\@uris);
+  ok $added > $n * 0.97 && $added <= $n, "add_many ($added)";
+  is $bloom->count, $added, 'count';
+
+  my $found = $bloom->maybe_contains_many(\@uris);
+  is scalar(@$found), $n, 'maybe_contains_many: size';
+  is scalar(grep{ !$_ } @$found), 0, 'no false negatives';
+
+  my $fp = grep{ $_ } @{ $bloom->maybe_contains_many([map{ "http://www.example.com/out/$_" } 1 .. $n]) };
+  ok $fp / $n < 0.03, "false positive rate within bounds ($fp / $n)";
+
+  ok dies{ $bloom->add_many('foo') }, 'add_many: array ref required';
+  ok dies{ $bloom->maybe_contains_many({}) }, 'maybe_contains_many: array ref required';
+};
+
+subtest 'save and load' => sub{
+  my ($fh, $path) = tempfile(UNLINK => 1);
+  close $fh;
+
+  my $bloom = URI::Fast::Bloom->new(bits => 4096, hashes => 4);
+  $bloom->add("http://www.example.com/$_") for 1 .. 100;
+  $bloom->save($path);
+  is -s $path, 64 + 4096 / 8, 'file size';
+
+  my $loaded = URI::Fast::Bloom->load($path);
+  ok $loaded->is_readonly, 'is_readonly';
+
+  if ($^O eq 'linux') {
+    ok $loaded->is_mapped, 'is_mapped';
+    open my $maps, '<', '/proc/self/maps' or die $!;
+    ok scalar(grep{ index($_, $path) >= 0 } <$maps>), 'file is mapped';
+  }
+  is $loaded->bits, 4096, 'bits';
+  is $loaded->hashes, 4, 'hashes';
+  is $loaded->count, $bloom->count, 'count';
+
+  my $same = grep{ !!$bloom->maybe_contains($_) == !!$loaded->maybe_contains($_) }
+    map{ "http://www.example.com/$_" } 1 .. 1000;
+  is $same, 1000, 'loaded filter matches';
+
+  like dies{ $loaded->add('http://www.example.com') }, qr/read-only/, 'add: read-only';
+
+  undef $bloom;
+  ok $loaded->maybe_contains('http://www.example.com/42'), 'independent of source filter';
+
+  if ($^O ne 'MSWin32') {
+    my $pid = fork;
+    if (defined $pid && $pid == 0) {
+      my $ok = $loaded->maybe_contains('http://www.example.com/42');
+      undef $loaded;
+      exit($ok ? 0 : 1);
+    }
+    waitpid $pid, 0;
+    is $?, 0, 'usable in forked child';
+    ok $loaded->maybe_contains('http://www.example.com/42'), 'usable in parent after child exits';
+  }
+
+  open $fh, '>', $path or die $!;
+  print $fh 'not a bloom filter' x 10;
+  close $fh;
+  like dies{ URI::Fast::Bloom->load($path) }, qr/not a bloom filter/, 'load: bad file';
+  like dies{ URI::Fast::Bloom->load("$path.missing") }, qr/unable to open/, 'load: missing file';
+};
+
+done_testing;
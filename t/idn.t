@@ -0,0 +1,69 @@
+use utf8;
+use ExtUtils::testlib;
+use Test2::V0;
+use URI::Fast qw(uri iri);
+
+# Sample strings from RFC 3492 section 7.1, plus a couple of common hosts
+my @labels = (
+  ['bücher',                         'xn--bcher-kva'],
+  ['例え',                           'xn--r8jz45g'],
+  ['ليهمابتكلموشعربي؟',              'xn--egbpdaj6bu4bxfgehfvwxn'],
+  ['他们为什么不说中文',             'xn--ihqwcrb4cv8a8dqg056pqjye'],
+  ['pročprostěnemluvíčesky',         'xn--proprostnemluvesky-uyb24dma41a'],
+  ['почемужеонинеговорятпорусски',   'xn--b1abfaaepdrnnbgefbadotcwatmq2g4l'],
+  ['3年b組金八先生',                 'xn--3b-ww4c5e180e575a65lsy2b'],
+  ['安室奈美恵-with-super-monkeys',  'xn---with-super-monkeys-pc58ag80a8qai00g7n9n'],
+);
+
+subtest 'host_ascii' => sub{
+  foreach (@labels) {
+    my ($unicode, $ascii) = @$_;
+    is iri("http://www.$unicode.com/foo")->host_ascii, "www.$ascii.com", "iri: $unicode";
+    is uri("http://www.$unicode.com/foo")->host_ascii, "www.$ascii.com", "uri: $unicode";
+  }
+
+  is iri('http://www.Bücher.DE')->host_ascii, 'www.xn--bcher-kva.DE', 'ascii lower cased in converted labels only';
+  is uri('http://www.example.com')->host_ascii, 'www.example.com', 'ascii host';
+  is uri('http://[::1]:80')->host_ascii, '[::1]', 'ip literal';
+  is uri('/foo')->host_ascii, '', 'no host';
+};
+
+subtest 'host_unicode' => sub{
+  foreach (@labels) {
+    my ($unicode, $ascii) = @$_;
+    is uri("http://www.$ascii.com/foo")->host_unicode, "www.$unicode.com", "$ascii";
+  }
+
+  is uri('http://XN--bcher-KVA.de')->host_unicode, 'bücher.de', 'case insensitive prefix and digits';
+  is uri('http://xn--.com')->host_unicode, 'xn--.com', 'empty';
+  is uri('http://xn--abc-.com')->host_unicode, 'xn--abc-.com', 'no encoded characters';
+  is uri('http://xn--a!b.com')->host_unicode, 'xn--a!b.com', 'invalid digit';
+  is uri('http://xn--99999999999999.com')->host_unicode, 'xn--99999999999999.com', 'overflow';
+  is uri('http://xn--bcher-kv.com')->host_unicode, 'xn--bcher-kv.com', 'truncated';
+  is uri('http://www.example.com')->host_unicode, 'www.example.com', 'ascii host';
+  is iri('http://www.bücher.de')->host_unicode, 'www.bücher.de', 'already unicode';
+};
+
+subtest 'normalize' => sub{
+  my $uri = uri 'HTTP://www.Bücher.de/foo';
+  is $uri->normalize(idn => 'ascii')->to_string, 'http://www.xn--bcher-kva.de/foo', 'uri: ascii';
+  is $uri->normalize(idn => 'unicode')->to_string, 'http://www.b%C3%BCcher.de/foo', 'uri: unicode (encoded)';
+
+  my $iri = iri 'http://www.xn--bcher-kva.de/foo';
+  is $iri->normalize(idn => 'unicode')->to_string, 'http://www.bücher.de/foo', 'iri: unicode';
+  is $iri->normalize(idn => 'ascii')->to_string, 'http://www.xn--bcher-kva.de/foo', 'iri: ascii';
+
+  is uri('http://www.bücher.de')->normalize->host_ascii, 'www.xn--bcher-kva.de', 'default normalization leaves host form unchanged';
+
+  ok dies{ uri('http://example.com')->normalize(idn => 'foo') }, 'invalid option value';
+  ok dies{ uri('http://example.com')->normalize(foo => 'ascii') }, 'invalid option';
+  ok dies{ uri('http://example.com')->normalize('idn') }, 'odd options';
+};
+
+subtest 'round trip' => sub{
+  my @hosts = map{ $_->[0] } @labels;
+  is uri('http://' . iri("http://$_")->host_ascii)->host_unicode, $_, $_
+    for @hosts;
+};
+
+done_testing;
@@ -21,4 +21,96 @@ subtest 'ipv6' => sub{
   is $uri->port, '4242', 'port';
 };
 
+subtest 'host_type' => sub{
+  my @cases = (
+    ['http://www.example.com',          'reg-name'],
+    ['http://localhost:80',             'reg-name'],
+    ['http://1.2.3',                    'reg-name'],
+    ['http://1.2.3.4.5',                'reg-name'],
+    ['http://1.2.3.256',                'reg-name'],
+    ['http://01.2.3.4',                 'reg-name'],
+    ['http://0x7f.0.0.1',               'reg-name'],
+    ['http://127.0.0.1',                'ipv4'],
+    ['http://0.0.0.0:80',               'ipv4'],
+    ['http://[::1]',                    'ipv6'],
+    ['http://[::]',                     'ipv6'],
+    ['http://[2001:db8::7]:4242',       'ipv6'],
+    ['http://[1:2:3:4:5:6:7:8]',        'ipv6'],
+    ['http://[::ffff:192.0.2.1]',       'ipv6'],
+    ['http://[fe80::1%25eth0]',         'ipv6'],
+    ['http://[v7.fe80::a+en1]',         'ipvfuture'],
+    ['http://[1:2:3:4:5:6:7:8:9]',      'invalid'],
+    ['http://[1:2:3:4:5:6:7::8]',       'invalid'],
+    ['http://[1::2::3]',                'invalid'],
+    ['http://[12345::]',                'invalid'],
+    ['http://[:1::]',                   'invalid'],
+    ['http://[1::256.0.0.1]',           'invalid'],
+    ['http://[v7.]',                    'invalid'],
+    ['http://[::1',                     'invalid'],
+  );
+
+  foreach (@cases) {
+    my ($str, $type) = @$_;
+    is uri($str)->host_type, $type, $str;
+  }
+
+  is uri('/foo/bar')->host_type, U(), 'no host';
+
+  my $uri = uri 'http://www.example.com';
+  $uri->host('10.0.0.1');
+  is $uri->host_type, 'ipv4', 'reclassified after host is set';
+  $uri->auth('[::1]:80');
+  is $uri->host_type, 'ipv6', 'reclassified after auth is set';
+  is $uri->host, '[::1]', 'ipv6 auth: host';
+  is $uri->port, 80, 'ipv6 auth: port';
+  $uri->host('[2001:db8::1]');
+  is $uri->to_string, 'http://[2001:db8::1]:80', 'ipv6 host set';
+  $uri->clear_host;
+  is $uri->host_type, U(), 'reclassified after host is cleared';
+};
+
+subtest 'ip_bytes' => sub{
+  is uri('http://192.168.0.1')->ip_bytes, pack('C4', 192, 168, 0, 1), 'ipv4';
+  is uri('http://[2001:db8::7]')->ip_bytes, pack('n8', 0x2001, 0xdb8, 0, 0, 0, 0, 0, 7), 'ipv6';
+  is uri('http://[::ffff:192.0.2.1]')->ip_bytes, pack('n6C4', 0, 0, 0, 0, 0, 0xffff, 192, 0, 2, 1), 'ipv4-mapped';
+  is uri('http://[fe80::1%25eth0]')->ip_bytes, pack('n8', 0xfe80, 0, 0, 0, 0, 0, 0, 1), 'zone id ignored';
+  is uri('http://www.example.com')->ip_bytes, U(), 'reg-name';
+  is uri('http://[v7.fe80::a+en1]')->ip_bytes, U(), 'ipvfuture';
+};
+
+subtest 'port' => sub{
+  is uri('http://example.com:8080')->port, 8080, 'numeric';
+  is uri('http://example.com:0')->port, 0, 'zero';
+  is uri('http://example.com:65536')->port, '65536', 'out of range';
+  is uri('http://example.com:http')->port, 'http', 'non-numeric';
+  is uri('http://example.com')->port, '', 'empty';
+
+  my $uri = uri 'http://example.com:80';
+  $uri->port(443);
+  is $uri->port, 443, 'set';
+};
+
+subtest 'normalize' => sub{
+  my @cases = (
+    ['http://[2001:DB8:0:0:0:0:0:7]:80/',         'http://[2001:db8::7]:80/'],
+    ['http://[2001:0db8:0000:0001:0000:0000:0000:0001]/', 'http://[2001:db8:0:1::1]/'],
+    ['http://[2001:db8:0:0:1:0:0:1]/',            'http://[2001:db8::1:0:0:1]/'],
+    ['http://[2001:db8::1:0:0:0:1]/',             'http://[2001:db8:0:1::1]/'],
+    ['http://[2001:db8:0:1:1:1:1:1]/',            'http://[2001:db8:0:1:1:1:1:1]/'],
+    ['http://[0:0:0:0:0:0:0:1]/',                 'http://[::1]/'],
+    ['http://[0:0:0:0:0:0:0:0]/',                 'http://[::]/'],
+    ['http://[::FFFF:C000:0201]/',                'http://[::ffff:192.0.2.1]/'],
+    ['http://[FE80:0::1%25ETH0]/',                'http://[fe80::1%25eth0]/'],
+    ['http://[v7.Fe80::A]/',                        'http://[v7.fe80::a]/'],
+  );
+
+  foreach (@cases) {
+    my ($str, $expected) = @$_;
+    my $uri = uri $str;
+    my $fp  = $uri->fingerprint;
+    is $uri->normalize->to_string, $expected, $str;
+    is $uri->fingerprint, $fp, "$str: fingerprint matches normalized form";
+  }
+};
+
 done_testing;
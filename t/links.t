@@ -0,0 +1,111 @@
+use utf8;
+use ExtUtils::testlib;
+use Test2::V0;
+use URI::Fast qw(uri html_url);
+use URI::Fast::Links;
+
+my $base = 'http://www.example.com/dir/page.html';
+
+my $html = <<'HTML';
+<!DOCTYPE html>
+<html><head>
+<title>Not <a href="/title">a link</a></title>
+<link rel=stylesheet href=style.css>
+<script src="/js/app.js"></script>
+<script>var s = "<a href='/script'>";</script>
+<style>a { background: url(<a href="/style">) }</style>
+</head>
+<body>
+<!-- <a href="/comment"> -->
+<!--><a href="/after-empty-comment">
+<A HREF='../up?a=1&amp;b=2'>up</A>
+<img
+  src = "  //cdn.example.com/img.png " alt="x">
+<a href="/tab	and
+newline">x</a>
+<a href="\back\slash">x</a>
+<a title="href=/nope" data-href="/nope">x</a>
+<a href="#frag">x</a>
+</a href="/end-tag">
+<a href="/x&#47;y&#x2F;z?q=&quot;">x</a>
+<?php echo '<a href="/pi">'; ?>
+</body></html>
+HTML
+
+my @expected = (
+  'http://www.example.com/dir/style.css',
+  'http://www.example.com/js/app.js',
+  'http://www.example.com/after-empty-comment',
+  'http://www.example.com/up?a=1&b=2',
+  'http://cdn.example.com/img.png',
+  'http://www.example.com/tabandnewline',
+  'http://www.example.com/back/slash',
+  'http://www.example.com/dir/page.html#frag',
+  'http://www.example.com/x/y/z?q=%22',
+);
+
+sub extract {
+  my ($links, @chunks) = @_;
+  return [map{ "$_" } map{ $links->push($_) } @chunks];
+}
+
+subtest 'whole document' => sub{
+  my $links = URI::Fast::Links->new(base => $base);
+  my @got = $links->push($html);
+  isa_ok $got[0], 'URI::Fast';
+  is [map{ "$_" } @got], \@expected, 'links';
+};
+
+subtest 'chunked' => sub{
+  my $bad = 0;
+
+  foreach my $at (1 .. length($html) - 1) {
+    my $links = URI::Fast::Links->new(base => $base);
+    my $got = extract($links, substr($html, 0, $at), substr($html, $at));
+    ++$bad unless join("\n", @$got) eq join("\n", @expected);
+  }
+
+  is $bad, 0, 'two chunks, split at every position';
+
+  my $links = URI::Fast::Links->new(base => uri($base));
+  is extract($links, split //, $html), \@expected, 'one byte at a time';
+};
+
+subtest 'matches html_url' => sub{
+  my $links = URI::Fast::Links->new(base => $base);
+
+  foreach my $href ('foo/../bar', '//example.net/a b', "/\tpath", '?q=1', 'HTTP://EXAMPLE.COM/%7e') {
+    my ($got) = $links->push(qq{<a href="$href">});
+    is "$got", html_url($href, $base)->to_string, $href;
+  }
+};
+
+subtest 'no base' => sub{
+  my $links = URI::Fast::Links->new;
+  is $links->base, U(), 'base';
+  is extract($links, '<a href="/foo\\bar">', '<img src=baz.png>'), ['/foo/bar', 'baz.png'], 'links';
+};
+
+subtest 'base element' => sub{
+  my $links = URI::Fast::Links->new(base => $base);
+
+  is extract($links, '<a href=a><base href="/other/"><a href=b><base href="/ignored/"><a href=c>'),
+    ['http://www.example.com/dir/a', 'http://www.example.com/other/b', 'http://www.example.com/other/c'],
+    'first base element applies to following links';
+
+  is $links->base->to_string, 'http://www.example.com/other/', 'base';
+
+  $links->reset('https://example.org/');
+  is $links->base->to_string, 'https://example.org/', 'reset base';
+  is extract($links, '<base href="x/"><a href=y>'), ['https://example.org/x/y'], 'base element after reset';
+};
+
+subtest 'reset' => sub{
+  my $links = URI::Fast::Links->new(base => $base);
+  is extract($links, '<a href="/unfinished'), [], 'partial value';
+  $links->reset;
+  is $links->base, U(), 'base removed';
+  is extract($links, '<a href="/next">'), ['/next'], 'partial value discarded';
+};
+
+done_testing;
@@ -24,6 +24,16 @@ subtest 'normalize casing of encoding' => sub{
 subtest 'normalize encoding' => sub{
   is uri('?foo=bar+bat')->normalize, '?foo=bar%20bat', '+ converted to %20';
   is uri(sprintf('?foo=%%%X', ord('x')))->normalize, '?foo=x', 'encoded unreserved chars decoded';
+  is uri('/a%2Fb?x=%3d&y=%26')->normalize, '/a%2Fb?x=%3D&y=%26', 'encoded reserved chars left encoded';
+  is uri('http://%57%57%57.example.com')->normalize, 'http://www.example.com/', 'decoded host chars lower cased';
+  is uri('?foo=%zz&bar=%')->normalize, '?foo=%zz&bar=%', 'invalid sequences left unchanged';
+  is uri('/foo bar+baz')->normalize, '/foo%20bar%20baz', 'chars requiring encoding are encoded';
+};
+
+subtest 'dot segments' => sub{
+  is uri('http://example.com/index.html')->normalize, 'http://example.com/index.html', 'dots within segments';
+  is uri('http://example.com/a/%2E%2E/b')->normalize, 'http://example.com/b', 'encoded dot segments';
+  is uri('http://example.com/a/b/..')->normalize, 'http://example.com/a/', 'trailing dot segment';
 };
 
 done_testing;
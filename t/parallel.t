@@ -0,0 +1,70 @@
+use utf8;
+use ExtUtils::testlib;
+use Test2::V0;
+use File::Temp qw(tempfile);
+use URI::Fast qw(uri iri parse_file_parallel);
+
+my @uris = (
+  'http://www.example.com',
+  'HTTP://WWW.EXAMPLE.COM/a/./b/../c?x=%7e#Frag',
+  '  https://user:pwd@[2001:DB8::1]:8080/foo  ',
+  "https://www.example.com/crlf\r",
+  '/relative/path?q',
+  'mailto:someone@example.com',
+  '',
+  '   ',
+  'http://www.çæ∂î∫∫å.com/ƒø∫?ƒøø=ßå®',
+  (map{ "http://www$_.example.com/p/$_?i=$_" } 1 .. 500),
+  'http://www.example.com/no-newline',
+);
+
+sub write_file {
+  my ($fh, $path) = tempfile(UNLINK => 1);
+  binmode $fh, ':utf8';
+  print $fh @_;
+  close $fh;
+  return $path;
+}
+
+my $path = write_file(join "\n", @uris);
+my @lines = grep{ /\S/ } @uris;
+
+subtest 'results' => sub{
+  my @expected = map{ my $u = uri $_; $u->normalize; $u->to_string } @lines;
+  my @fps = map{ uri($_)->fingerprint } @lines;
+
+  foreach my $threads (1 .. 5, 100) {
+    my $got = parse_file_parallel($path, threads => $threads, normalized => 1);
+    is $got->{count}, scalar(@lines), "count: $threads threads";
+    is [unpack 'Q*', $got->{fingerprints}], \@fps, "fingerprints: $threads threads";
+    is $got->{normalized}, \@expected, "normalized: $threads threads";
+  }
+
+  my $got = parse_file_parallel($path);
+  is $got->{count}, scalar(@lines), 'default threads';
+  ok !exists $got->{normalized}, 'no strings unless requested';
+};
+
+subtest 'iri' => sub{
+  my @expected = map{ my $u = iri $_; $u->normalize; $u->to_string } @lines;
+  my $got = parse_file_parallel($path, threads => 3, iri => 1, normalized => 1);
+  is $got->{normalized}, \@expected, 'normalized';
+  is $got->{normalized}[6], 'http://www.çæ∂î∫∫å.com/ƒø∫?ƒøø=ßå®', 'decoded';
+};
+
+subtest 'edge cases' => sub{
+  my $got = parse_file_parallel(write_file(''), threads => 4, normalized => 1);
+  is $got, {count => 0, fingerprints => '', normalized => []}, 'empty file';
+
+  $got = parse_file_parallel(write_file("\n\n\n"), threads => 4);
+  is $got->{count}, 0, 'blank lines';
+
+  $got = parse_file_parallel(write_file("http://a\n"), threads => 8, normalized => 1);
+  is $got->{normalized}, ['http://a/'], 'fewer lines than threads';
+
+  like dies{ parse_file_parallel('/no/such/file') }, qr/unable to open/, 'missing file';
+  like dies{ parse_file_parallel($path, threads => 2, foo => 1) }, qr/invalid option foo/, 'invalid option';
+  like dies{ parse_file_parallel($path, 'threads') }, qr/key\/value pairs/, 'odd options';
+};
+
+done_testing;
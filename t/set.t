@@ -0,0 +1,79 @@
+use utf8;
+use ExtUtils::testlib;
+use Test2::V0;
+use URI::Fast qw(uri iri);
+use URI::Fast::Set;
+
+subtest 'basics' => sub{
+  my $set = URI::Fast::Set->new;
+  is $set->size, 0, 'empty';
+  ok !$set->contains('http://www.example.com'), '!contains';
+
+  ok $set->add('http://www.example.com'), 'add';
+  is $set->size, 1, 'size';
+  ok $set->contains('http://www.example.com'), 'contains';
+
+  ok !$set->add('http://www.example.com'), 'add: duplicate';
+  is $set->size, 1, 'size';
+
+  ok $set->remove('http://www.example.com'), 'remove';
+  ok !$set->remove('http://www.example.com'), 'remove: not a member';
+  ok !$set->contains('http://www.example.com'), '!contains';
+  is $set->size, 0, 'size';
+
+  ok $set->add('http://www.example.com'), 'add: after remove';
+  is $set->size, 1, 'size';
+};
+
+subtest 'equivalent uris' => sub{
+  my $set = URI::Fast::Set->new;
+  ok $set->add('http://www.example.com'), 'add';
+  ok !$set->add($_), "duplicate: $_" for (
+    'HTTP://WWW.EXAMPLE.COM/',
+    'http://www.%65xample.com/',
+    'http://www.example.com/foo/..',
+    uri('http://www.example.com/./'),
+  );
+  ok $set->add('http://www.example.com/foo'), 'distinct path';
+  ok $set->add('https://www.example.com'), 'distinct scheme';
+  is $set->size, 3, 'size';
+};
+
+subtest 'objects and strings' => sub{
+  my $set = URI::Fast::Set->new;
+  my $uri = uri 'http://www.EXAMPLE.com/a/./b';
+  ok $set->add($uri), 'add object';
+  is "$uri", 'http://www.EXAMPLE.com/a/./b', 'object not modified';
+  ok $set->contains('http://www.example.com/a/b'), 'contains string';
+  ok $set->contains(iri 'http://www.example.com/a/b'), 'contains iri';
+  ok $set->add(''), 'empty string';
+  ok $set->contains(undef), 'undef is empty';
+};
+
+subtest 'growth and removal' => sub{
+  my $set = URI::Fast::Set->new(4);
+  my $n = 10_000;
+
+  ok $set->add("http://www.example.com/$_"), "add $_" for 1 .. $n;
+  is $set->size, $n, 'size';
+  ok $set->memory_usage > 0, 'memory_usage';
+
+  my $missing = grep{ !$set->contains("http://www.example.com/$_") } 1 .. $n;
+  is $missing, 0, 'all members found after growth';
+
+  my $removed = grep{ $set->remove("http://www.example.com/$_") } grep{ $_ % 2 } 1 .. $n;
+  is $removed, $n / 2, 'removed odd members';
+  is $set->size, $n / 2, 'size';
+
+  my $wrong = grep{ ($_ % 2 == 0) != !!$set->contains("http://www.example.com/$_") } 1 .. $n;
+  is $wrong, 0, 'only even members remain';
+
+  ok $set->add("http://www.example.com/$_"), "re-add $_" for grep{ $_ % 2 } 1 .. $n;
+  is $set->size, $n, 'size';
+};
+
+subtest 'errors' => sub{
+  ok dies{ URI::Fast::Set::add(uri('http://example.com'), 'foo') }, 'not a set';
+};
+
+done_testing;
@@ -0,0 +1,101 @@
+use utf8;
+use ExtUtils::testlib;
+use Test2::V0;
+use URI::Fast qw(uri iri sort_uris);
+
+subtest 'reversed_host' => sub{
+  is uri('http://www.example.com/foo')->reversed_host, 'com.example.www', 'reg-name';
+  is uri('http://www.Example.COM./foo')->reversed_host, 'COM.Example.www', 'trailing dot, case preserved';
+  is uri('http://localhost')->reversed_host, 'localhost', 'single label';
+  is uri('http://192.168.0.1')->reversed_host, '192.168.0.1', 'ipv4';
+  is uri('http://[::1]:80')->reversed_host, '[::1]', 'ipv6';
+  is uri('/foo')->reversed_host, '', 'no host';
+  is iri('http://www.çæ∂.com')->reversed_host, 'com.çæ∂.www', 'iri';
+  is uri('http://www.çæ∂.com')->reversed_host, 'com.çæ∂.www', 'uri (encoded host)';
+};
+
+# Reference implementation of the default sort order
+sub reference_key {
+  my $uri = uri shift;
+  my $rev = join '.', reverse split /\./, lc $uri->raw_host;
+  join "\0", $rev, $uri->raw_path, $uri->raw_query;
+}
+
+subtest 'sort_uris' => sub{
+  my @uris = (
+    'http://b.com/x',
+    'http://a.b.com/',
+    'https://www.a.com/z?q',
+    'http://www.a.com/z',
+    'http://A.com/',
+    'http://b.com/a',
+    'http://b.com/a?b=1',
+    'http://b.com/a?a=1',
+  );
+
+  is sort_uris(\@uris), [
+    'http://A.com/',
+    'http://www.a.com/z',
+    'https://www.a.com/z?q',
+    'http://b.com/a',
+    'http://b.com/a?a=1',
+    'http://b.com/a?b=1',
+    'http://b.com/x',
+    'http://a.b.com/',
+  ], 'default order';
+
+  is $uris[0], 'http://b.com/x', 'input not modified';
+
+  is sort_uris(\@uris, by => 'path, scheme'), [
+    'http://a.b.com/',
+    'http://A.com/',
+    'http://b.com/a',
+    'http://b.com/a?b=1',
+    'http://b.com/a?a=1',
+    'http://b.com/x',
+    'http://www.a.com/z',
+    'https://www.a.com/z?q',
+  ], 'by path, scheme (stable)';
+
+  is sort_uris(['http://a.com:8080', 'http://a.com:443', 'http://a.com', 'http://a.com:http'], by => 'port'), [
+    'http://a.com',
+    'http://a.com:443',
+    'http://a.com:8080',
+    'http://a.com:http',
+  ], 'numeric ports';
+
+  my @objs = map{ uri $_ } @uris;
+  my $sorted = sort_uris(\@objs);
+  is ref($sorted->[0]), 'URI::Fast', 'objects returned';
+  is [map{ "$_" } @$sorted], sort_uris(\@uris), 'objects sort like strings';
+  ok((grep{ my $s = $_; grep{ $_ == $s } @objs } @$sorted) == @objs, 'same objects returned');
+
+  is sort_uris([]), [], 'empty';
+
+  ok dies{ sort_uris('foo') }, 'array ref required';
+  ok dies{ sort_uris([], by => 'nope') }, 'unknown field';
+  ok dies{ sort_uris([], by => '') }, 'no fields';
+  ok dies{ sort_uris([], foo => 'path') }, 'unknown option';
+};
+
+subtest 'large' => sub{
+  srand 42;
+  my @labels = qw(www api cdn static a b c example test foo bar com org net);
+  my @uris = map{
+    my $host = join '.', map{ $labels[rand @labels] } 1 .. 1 + int(rand 4);
+    my $path = join '/', '', map{ $labels[rand @labels] } 0 .. int(rand 3);
+    my $query = rand() < 0.5 ? '?' . $labels[rand @labels] : '';
+    "http://$host$path$query";
+  } 1 .. 20_000;
+
+  my @expected = map{ $_->[1] } sort{ $a->[0] cmp $b->[0] } map{ [reference_key($_), $_] } @uris;
+  is sort_uris(\@uris), \@expected, 'matches reference sort';
+
+  my @dupes = ('http://a.com/') x 1000;
+  is scalar(@{ sort_uris(\@dupes) }), 1000, 'many equal keys';
+
+  my $sorted = sort_uris(\@expected);
+  is $sorted, \@expected, 'presorted input';
+};
+
+done_testing;
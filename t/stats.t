@@ -0,0 +1,46 @@
+use ExtUtils::testlib;
+use Test2::V0;
+use URI::Fast qw(uri);
+
+ok lives{ URI::Fast::reset_stats() }, 'reset_stats';
+
+my $stats = URI::Fast::stats();
+
+unless (defined $stats) {
+  is $stats, U(), 'stats: undef unless built with STATS=1';
+  done_testing;
+  exit;
+}
+
+is $stats, hash{
+  field $_ => 0 for qw(allocs reallocs alloc_bytes uri_new uri_free scan_calls scan_bytes
+                       encode_calls encode_bytes decode_calls decode_bytes query_scans query_tokens);
+  end;
+}, 'reset';
+
+my $uri = uri 'http://www.example.com/foo?a=1&b=2&c';
+my @a = $uri->param('a');
+$uri->path('/bar');
+undef $uri;
+
+$stats = URI::Fast::stats();
+is $stats->{uri_new}, 1, 'uri_new';
+is $stats->{uri_free}, 1, 'uri_free';
+is $stats->{scan_calls}, 1, 'scan_calls';
+is $stats->{scan_bytes}, length('http://www.example.com/foo?a=1&b=2&c'), 'scan_bytes';
+ok $stats->{query_scans} >= 1, 'query_scans';
+ok $stats->{query_tokens} >= 1, 'query_tokens';
+ok $stats->{encode_calls} >= 1, 'encode_calls';
+ok $stats->{decode_calls} >= 1, 'decode_calls';
+ok $stats->{allocs} >= 9, 'allocs';
+ok $stats->{alloc_bytes} > 0, 'alloc_bytes';
+
+my $reallocs = $stats->{reallocs};
+$uri = uri 'http://www.example.com/a';
+$uri->path('/' . ('x' x 1000));
+ok URI::Fast::stats()->{reallocs} > $reallocs, 'reallocs';
+
+URI::Fast::reset_stats();
+is URI::Fast::stats()->{scan_calls}, 0, 'reset_stats';
+
+done_testing;
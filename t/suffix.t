@@ -0,0 +1,101 @@
+use utf8;
+use ExtUtils::testlib;
+use Test2::V0;
+use File::Temp qw(tempfile);
+use URI::Fast qw(uri iri load_public_suffix_list);
+
+# A subset of the Public Suffix List, along with cases adapted from the list's
+# own test suite.
+my $list = <<'END';
+// Comments are ignored
+com
+uk
+co.uk
+jp
+ac.jp
+kyoto.jp
+ide.kyoto.jp
+*.kobe.jp
+!city.kobe.jp
+*.ck
+!www.ck
+us
+ak.us
+k12.ak.us
+cn
+公司.cn
+
+// Rules end at the first white space
+org some trailing text
+END
+
+like dies{ uri('http://www.example.com')->public_suffix }, qr/no public suffix list loaded/, 'croaks without list';
+like dies{ load_public_suffix_list('/does/not/exist') }, qr/unable to open/, 'croaks on missing file';
+
+my ($fh, $path) = tempfile(UNLINK => 1);
+binmode $fh, ':encoding(UTF-8)';
+print $fh $list;
+close $fh;
+
+load_public_suffix_list($path);
+
+my @cases = (
+  # host                  suffix         registrable domain
+  ['com',                 'com',         undef],
+  ['example.com',         'com',         'example.com'],
+  ['WwW.example.COM',     'COM',         'example.COM'],
+  ['example.com.',        'com',         'example.com'],
+  ['example',             'example',     undef],
+  ['example.example',     'example',     'example.example'],
+  ['b.example.example',   'example',     'example.example'],
+  ['domain.biz',          'biz',         'domain.biz'],
+  ['a.b.example.uk.com',  'com',         'uk.com'],
+  ['example.org',         'org',         'example.org'],
+  ['co.uk',               'co.uk',       undef],
+  ['www.example.co.uk',   'co.uk',       'example.co.uk'],
+  ['test.ac.jp',          'ac.jp',       'test.ac.jp'],
+  ['www.ide.kyoto.jp',    'ide.kyoto.jp', 'www.ide.kyoto.jp'],
+  ['c.kobe.jp',           'c.kobe.jp',   undef],
+  ['b.c.kobe.jp',         'c.kobe.jp',   'b.c.kobe.jp'],
+  ['a.b.c.kobe.jp',       'c.kobe.jp',   'b.c.kobe.jp'],
+  ['city.kobe.jp',        'kobe.jp',     'city.kobe.jp'],
+  ['www.city.kobe.jp',    'kobe.jp',     'city.kobe.jp'],
+  ['ck',                  'ck',          undef],
+  ['test.ck',             'test.ck',     undef],
+  ['b.test.ck',           'test.ck',     'b.test.ck'],
+  ['www.ck',              'ck',          'www.ck'],
+  ['www.www.ck',          'ck',          'www.ck'],
+  ['k12.ak.us',           'k12.ak.us',   undef],
+  ['www.test.k12.ak.us',  'k12.ak.us',   'test.k12.ak.us'],
+  ['',                    undef,         undef],
+  ['192.168.0.1',         undef,         undef],
+  ['[::1]',               undef,         undef],
+  ['a..example.com',      undef,         undef],
+  ['.example.com',        undef,         undef],
+);
+
+foreach my $case (@cases) {
+  my ($host, $suffix, $domain) = @$case;
+  my $uri = uri "http://$host/path";
+  is $uri->public_suffix, $suffix, "public_suffix: '$host'";
+  is $uri->registrable_domain, $domain, "registrable_domain: '$host'";
+}
+
+subtest 'idn' => sub{
+  is iri('http://www.食狮.公司.cn')->registrable_domain, '食狮.公司.cn', 'iri';
+  is iri('http://食狮.公司.cn')->public_suffix, '公司.cn', 'iri: suffix';
+  is iri('http://公司.cn')->registrable_domain, undef, 'iri: suffix only';
+  is uri('http://www.食狮.公司.cn')->registrable_domain, '食狮.公司.cn', 'uri (encoded host)';
+};
+
+subtest 'reload' => sub{
+  my ($fh, $path) = tempfile(UNLINK => 1);
+  print $fh "com\nexample.com\n";
+  close $fh;
+
+  load_public_suffix_list($path);
+  is uri('http://www.example.com')->registrable_domain, 'www.example.com', 'new list in effect';
+  is uri('http://www.example.co.uk')->registrable_domain, 'co.uk', 'old list replaced';
+};
+
+done_testing;
@@ -0,0 +1,122 @@
+use utf8;
+use ExtUtils::testlib;
+use Config;
+use Test2::V0;
+
+BEGIN{
+  skip_all 'perl not built with ithreads' unless $Config{useithreads};
+};
+
+use threads;
+use File::Temp qw(tempfile);
+use URI::Fast qw(uri iri load_public_suffix_list);
+use URI::Fast::Array;
+use URI::Fast::Bloom;
+use URI::Fast::Reader;
+use URI::Fast::Set;
+use URI::Fast::Sorted;
+use URI::Fast::Table;
+
+my ($fh, $psl) = tempfile(UNLINK => 1);
+print $fh "com\nco.uk\n";
+close $fh;
+load_public_suffix_list $psl;
+
+my $uri   = uri 'http://www.example.com/foo?a=1';
+my $iri   = iri 'http://www.çæ∂î∫∫å.com/ƒø∫';
+my $set   = URI::Fast::Set->new;
+my $bloom = URI::Fast::Bloom->new(bits => 4096, hashes => 4);
+
+$set->add($uri);
+$bloom->add($uri);
+
+my ($bloom_fh, $bloom_path) = tempfile(UNLINK => 1);
+close $bloom_fh;
+$bloom->save($bloom_path);
+my $loaded = URI::Fast::Bloom->load($bloom_path);
+
+my ($table_fh, $table_path) = tempfile(UNLINK => 1);
+close $table_fh;
+URI::Fast::Table->write($table_path, [map{ "http://www.example.com/t$_" } 1 .. 4]);
+my $table = URI::Fast::Table->load($table_path);
+
+my $array = URI::Fast::Array->new;
+$array->push($uri);
+
+my $sorted = URI::Fast::Sorted->new([map{ "http://www.example.com/s$_" } 1 .. 4]);
+
+subtest 'objects copied into threads' => sub{
+  my @threads = map{
+    my $n = $_;
+
+    threads->create(sub{
+      my @got;
+
+      for my $i (1 .. 1000) {
+        my $u = uri "http://www$i.example.co.uk/t$n?a=$i";
+        $u->param('b', $n);
+        push @got, "$u" if $i == 1000;
+      }
+
+      $uri->path("t$n");
+      $iri->query({n => $n});
+      push @got, "$uri", scalar($iri->query), $uri->registrable_domain;
+
+      $set->add("http://www.example.com/t$n");
+      push @got, $set->size, $set->contains("http://www.example.com/t$n") ? 1 : 0;
+
+      $bloom->add("http://www.example.com/t$n");
+      push @got, $bloom->maybe_contains("http://www.example.com/t$n") ? 1 : 0, $loaded->maybe_contains('http://www.example.com/foo?a=1') ? 1 : 0;
+      push @got, $table->find("http://www.example.com/t$n");
+
+      $array->push("$uri");
+      push @got, $array->count, $array->path_at(-1);
+
+      $sorted->add("http://www.example.com/t$n");
+      push @got, $sorted->count, $sorted->find("http://www.example.com/s$n");
+
+      return join ' ', @got;
+    });
+  } 1 .. 4;
+
+  foreach my $n (1 .. 4) {
+    is $threads[$n - 1]->join,
+      "http://www1000.example.co.uk/t$n?a=1000&b=$n http://www.example.com/t$n?a=1 n=$n example.com 2 1 1 1 " . ($n - 1) . " 2 /t$n 5 " . ($n - 1),
+      "thread $n";
+  }
+
+  is "$uri", 'http://www.example.com/foo?a=1', 'uri unchanged';
+  is $iri->path, '/ƒø∫', 'iri unchanged';
+  ok !$iri->query, 'iri query unchanged';
+  is $set->size, 1, 'set unchanged';
+  is $array->count, 1, 'array unchanged';
+  ok !$set->contains('http://www.example.com/t1'), 'set: no members from threads';
+  ok !$bloom->maybe_contains('http://www.example.com/t1'), 'bloom: no members from threads';
+  is $uri->registrable_domain, 'example.com', 'public suffix list';
+};
+
+subtest 'reloading the suffix list' => sub{
+  my $thr = threads->create(sub{
+    my ($fh, $path) = tempfile(UNLINK => 1);
+    print $fh "example.com\n";
+    close $fh;
+    load_public_suffix_list $path;
+    $uri->registrable_domain;
+  });
+
+  is $thr->join, 'www.example.com', 'thread';
+  is $uri->registrable_domain, 'example.com', 'parent';
+};
+
+subtest 'readers are not copied' => sub{
+  my ($fh, $path) = tempfile(UNLINK => 1);
+  print $fh "http://www.example.com\n";
+  close $fh;
+
+  my $reader = URI::Fast::Reader->new($path);
+  my $thr = threads->create(sub{ ref $reader });
+  is $thr->join, 'SCALAR', 'unblessed in thread';
+  is $reader->next->to_string, 'http://www.example.com', 'usable in parent';
+};
+
+done_testing;